@@ -4,7 +4,15 @@
 # Copyright, 2025, by Samuel Williams.
 
 # @parameter input [Input] The input to process.
-def analyze(input:)
+# @parameter path [String] The path to a log of JSON stalls (one per line, optionally gzip compressed), which is summarized natively, using multiple threads. The summary also includes the percentiles of each location.
+# @parameter threads [Integer] The number of threads to use when summarizing a path, by default the number of processors.
+def analyze(input: nil, path: nil, threads: nil)
+	if path
+		require "fiber/profiler/native"
+		
+		return Fiber::Profiler::Analyzer.analyze(path, threads: threads)
+	end
+	
 	summary = {}
 	
 	input.each do |sample|
@@ -15,8 +23,9 @@ def analyze(input:)
 			calls.each do |call|
 				location = "#{call["path"]}:#{call["line"]}"
 				
-				summary[location] ||= {duration: 0, calls: 0, class: call["class"], method: call["method"]}
+				summary[location] ||= {duration: 0, self_time: 0, calls: 0, class: call["class"], method: call["method"]}
 				summary[location][:duration] += call["duration"]
+				summary[location][:self_time] += call["self_time"] || 0
 				summary[location][:calls] += 1
 			end
 		end
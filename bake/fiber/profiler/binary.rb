@@ -0,0 +1,13 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+# Read the stalls from a binary profile, e.g. for use with `fiber:profiler:analyze`.
+#
+# @parameter path [String] The path to the binary profile.
+def read(path:)
+	require "fiber/profiler/binary"
+	
+	Fiber::Profiler::Binary::Reader.foreach(path)
+end
@@ -0,0 +1,194 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+# Measures the overhead of the capture hot paths, and prints the results as JSON so that they can be compared across releases:
+#
+#   $ bake build
+#   $ ruby -Ilib -Iext benchmark/capture.rb > results.json
+#
+# Each measurement is the best of several runs, with the cost of the same work without a capture subtracted where that is meaningful. Set `ITERATIONS` to change the amount of work per run.
+
+require "fiber/profiler"
+require "json"
+require "stringio"
+
+module Benchmark
+	ITERATIONS = Integer(ENV.fetch("ITERATIONS", 100_000))
+	RUNS = 5
+	
+	def self.now
+		Process.clock_gettime(Process::CLOCK_MONOTONIC)
+	end
+	
+	# The best time of several runs, which is the least affected by noise.
+	def self.measure
+		RUNS.times.map do
+			GC.start
+			start_time = self.now
+			yield
+			self.now - start_time
+		end.min
+	end
+	
+	# Run the block within a capture with the given options, or without a capture if there are none.
+	def self.capture(**options)
+		capture = Fiber::Profiler::Capture.new(output: StringIO.new, **options)
+		capture.start
+		
+		yield capture
+	ensure
+		capture&.stop
+	end
+	
+	def self.nanoseconds(duration, count)
+		(duration * 1e9 / count).round(1)
+	end
+	
+	def self.empty
+	end
+	
+	# The cost of each call and return event while a fiber is being sampled, for Ruby methods and C functions.
+	def self.call_events
+		count = ITERATIONS
+		
+		calls = proc do
+			Fiber.new do
+				count.times{self.empty}
+			end.resume
+		end
+		
+		c_calls = proc do
+			Fiber.new do
+				count.times{count.itself}
+			end.resume
+		end
+		
+		ruby_baseline = self.measure(&calls)
+		c_baseline = self.measure(&c_calls)
+		
+		# The stall threshold is high enough that nothing is printed:
+		ruby, c = self.capture(stall_threshold: 1000) do
+			[self.measure(&calls), self.measure(&c_calls)]
+		end
+		
+		# Each call is a call and a return event:
+		{
+			ruby_ns_per_event: self.nanoseconds(ruby - ruby_baseline, count * 2),
+			c_ns_per_event: self.nanoseconds(c - c_baseline, count * 2),
+		}
+	end
+	
+	# The cost of each fiber switch, with and without sampling and call tracking.
+	def self.fiber_switches
+		count = ITERATIONS
+		
+		switches = proc do
+			fiber = Fiber.new do
+				loop{Fiber.yield}
+			end
+			
+			count.times{fiber.resume}
+		end
+		
+		baseline = self.measure(&switches)
+		
+		# Each resume is two switches, into and out of the fiber:
+		configurations = {
+			unsampled: {sample_rate: 0},
+			sampled: {sample_rate: 1, track_calls: false},
+			sampled_track_calls: {sample_rate: 1, track_calls: true},
+			half_sampled_track_calls: {sample_rate: 0.5, track_calls: true},
+		}
+		
+		results = {baseline_ns_per_switch: self.nanoseconds(baseline, count * 2)}
+		
+		configurations.each do |name, options|
+			duration = self.capture(stall_threshold: 1000, **options) do
+				self.measure(&switches)
+			end
+			
+			results[:"#{name}_ns_per_switch"] = self.nanoseconds(duration - baseline, count * 2)
+		end
+		
+		return results
+	end
+	
+	def self.nested(depth, &block)
+		if depth == 0
+			yield
+		else
+			self.nested(depth - 1, &block)
+		end
+	end
+	
+	# The throughput of printing stalls in each format, where every sample is a stall with a call stack of the given depth.
+	def self.printing(depth = 10)
+		count = ITERATIONS / 10
+		
+		stalls = proc do
+			fiber = Fiber.new do
+				loop do
+					self.nested(depth){Fiber.yield}
+				end
+			end
+			
+			count.times{fiber.resume}
+		end
+		
+		results = {}
+		
+		[:tty, :json, :binary].each do |format|
+			output = StringIO.new(String.new(encoding: Encoding::BINARY))
+			capture = Fiber::Profiler::Capture.new(stall_threshold: 0, filter_threshold: 0, output: output, format: format)
+			
+			capture.start
+			duration = self.measure(&stalls)
+			capture.stop
+			
+			printed = capture.stalls
+			
+			results[format] = {
+				ns_per_stall: self.nanoseconds(duration, count),
+				bytes_per_stall: (output.string.bytesize.to_f / printed).round(1),
+			}
+		end
+		
+		return results
+	end
+	
+	# The memory used by the call log for each recorded call.
+	def self.memory(count = ITERATIONS)
+		self.capture(stall_threshold: 1000, filter_threshold: 0) do |capture|
+			Fiber.new do
+				count.times{self.empty}
+			end.resume
+			
+			# The memory is measured at the end of the sample, on the next switch:
+			Fiber.new{}.resume
+			
+			statistics = capture.statistics
+			
+			{
+				calls: statistics[:calls],
+				bytes_per_call: (statistics[:memory_maximum].to_f / statistics[:calls]).round(1),
+			}
+		end
+	end
+	
+	def self.run
+		{
+			ruby: RUBY_DESCRIPTION,
+			version: Fiber::Profiler::VERSION,
+			iterations: ITERATIONS,
+			call_events: self.call_events,
+			fiber_switches: self.fiber_switches,
+			printing: self.printing,
+			memory: self.memory,
+		}
+	end
+end
+
+puts JSON.pretty_generate(Benchmark.run)
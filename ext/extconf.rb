@@ -17,12 +17,21 @@ if ENV.key?("RUBY_DEBUG")
 	append_cflags(["-DRUBY_DEBUG", "-O0"])
 end
 
-$srcs = ["fiber/profiler/profiler.c", "fiber/profiler/time.c", "fiber/profiler/fiber.c", "fiber/profiler/capture.c"]
+$srcs = ["fiber/profiler/profiler.c", "fiber/profiler/time.c", "fiber/profiler/fiber.c", "fiber/profiler/table.c", "fiber/profiler/map.c", "fiber/profiler/frame.c", "fiber/profiler/writer.c", "fiber/profiler/timer.c", "fiber/profiler/statistics.c", "fiber/profiler/buffer.c", "fiber/profiler/compression.c", "fiber/profiler/reservoir.c", "fiber/profiler/tree.c", "fiber/profiler/capture.c", "fiber/profiler/histogram.c", "fiber/profiler/latency.c", "fiber/profiler/line.c", "fiber/profiler/analyzer.c"]
 $VPATH << "$(srcdir)/fiber/profiler"
 
 have_func("rb_fiber_current")
 have_func("rb_ext_ractor_safe")
 
+# Used for sampling call stacks at a fixed interval:
+unless have_func("timer_create", "time.h")
+	# Older versions of glibc provide it in a separate library:
+	have_library("rt", "timer_create", "time.h") and have_func("timer_create", "time.h")
+end
+
+# Used for compressing the output:
+have_header("zlib.h") and have_library("z", "deflate", "zlib.h")
+
 if ENV.key?("RUBY_SANITIZE")
 	$stderr.puts "Enabling sanitizers..."
 	
@@ -0,0 +1,1145 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "analyzer.h"
+#include "histogram.h"
+#include "compression.h"
+
+#include <ruby/thread.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Summarizes a log of JSON stalls (one per line, as written by the capture) by location. The log is memory mapped and split on line boundaries between several native threads, each of which parses only the fields it needs into its own summary, and the summaries are merged at the end. Compressed logs (as written with `output_compression: :gzip`) are decompressed in batches of complete lines, so memory use is bounded by the batch size (plus the longest line) rather than the size of the log; each batch is summarized in the same way, and the locations are copied out of it before it is reused.
+
+VALUE Fiber_Profiler_Analyzer = Qnil;
+
+enum {
+	Fiber_Profiler_Analyzer_MAXIMUM_THREADS = 64,
+};
+
+// Don't bother splitting the log into chunks smaller than this:
+static const size_t Fiber_Profiler_Analyzer_MINIMUM_CHUNK = 1024 * 1024;
+
+// The amount of a compressed log to decompress before summarizing it:
+static const size_t Fiber_Profiler_Analyzer_BATCH = 16 * 1024 * 1024;
+
+static const size_t Fiber_Profiler_Analyzer_DEFAULT_CAPACITY = 256;
+
+// The contents of a JSON string, pointing into the log, which may contain escape sequences. If `data` is NULL, the string was missing or not a string.
+struct Fiber_Profiler_Analyzer_String {
+	const char *data;
+	size_t length;
+};
+
+struct Fiber_Profiler_Analyzer_Location {
+	struct Fiber_Profiler_Analyzer_String path;
+	int line;
+	uint32_t hash;
+	
+	// The class and method of the first call at this location:
+	struct Fiber_Profiler_Analyzer_String class_name;
+	struct Fiber_Profiler_Analyzer_String method_name;
+	
+	size_t calls;
+	double duration;
+	
+	// The duration of all calls at this location, less the duration of their direct children:
+	double self_time;
+	
+	struct Fiber_Profiler_Histogram histogram;
+	
+	// If the path, class and method were copied out of the log, the memory which holds them:
+	char *strings;
+};
+
+struct Fiber_Profiler_Analyzer_Summary {
+	struct Fiber_Profiler_Analyzer_Location *locations;
+	size_t size;
+	size_t capacity;
+	
+	// An open addressing hash table of (index + 1), where 0 indicates an empty slot:
+	uint32_t *slots;
+	size_t slots_capacity;
+};
+
+// The fields of a call which are used by the summary:
+struct Fiber_Profiler_Analyzer_Call {
+	struct Fiber_Profiler_Analyzer_String path;
+	struct Fiber_Profiler_Analyzer_String class_name;
+	struct Fiber_Profiler_Analyzer_String method_name;
+	int line;
+	double duration;
+	double nesting;
+	
+	// The self time as recorded by the capture, or negative if it was not recorded:
+	double self_time;
+};
+
+// A call which may still have children, used for computing the self time of logs which don't include it:
+struct Fiber_Profiler_Analyzer_Frame {
+	uint32_t location;
+	double nesting;
+	double duration;
+	double children;
+	double self_time;
+};
+
+struct Fiber_Profiler_Analyzer_Worker {
+	// The lines to parse:
+	const char *start;
+	const char *end;
+	
+	struct Fiber_Profiler_Analyzer_Summary summary;
+	
+	// Scratch space for the calls of the current line, and the stack of their ancestors:
+	struct Fiber_Profiler_Analyzer_Call *calls;
+	size_t calls_capacity;
+	struct Fiber_Profiler_Analyzer_Frame *stack;
+	size_t stack_capacity;
+	
+	// The number of stalls which were summarized:
+	size_t stalls;
+	
+	// Whether memory could not be allocated:
+	int failed;
+	
+	// Set if the analysis is interrupted, in which case the worker stops as soon as possible:
+	volatile int *cancelled;
+	
+	pthread_t thread;
+};
+
+struct Fiber_Profiler_Analyzer_Analysis {
+	VALUE path;
+	
+	int descriptor;
+	const char *data;
+	size_t size;
+	
+	// If the log is compressed, the current batch of decompressed lines:
+	int compressed;
+	struct Fiber_Profiler_Inflater inflater;
+	struct Fiber_Profiler_Buffer inflated;
+	
+	// The locations of all the lines summarized so far, and the number of stalls:
+	struct Fiber_Profiler_Analyzer_Summary summary;
+	size_t stalls;
+	
+	// Whether memory could not be allocated:
+	int failed;
+	
+	// Set by the unblocking function, e.g. when the calling thread is interrupted:
+	volatile int cancelled;
+	
+	struct Fiber_Profiler_Analyzer_Worker *workers;
+	size_t count;
+};
+
+#pragma mark - Summary
+
+static uint32_t Fiber_Profiler_Analyzer_hash(struct Fiber_Profiler_Analyzer_String path, int line)
+{
+	uint32_t hash = 2166136261u;
+	
+	for (size_t i = 0; i < path.length; i += 1) {
+		hash ^= (unsigned char)path.data[i];
+		hash *= 16777619u;
+	}
+	
+	hash ^= (uint32_t)line;
+	hash *= 16777619u;
+	
+	return hash;
+}
+
+static int Fiber_Profiler_Analyzer_String_equal(struct Fiber_Profiler_Analyzer_String a, struct Fiber_Profiler_Analyzer_String b)
+{
+	if (a.data == NULL || b.data == NULL) return a.data == b.data;
+	
+	return a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+}
+
+static int Fiber_Profiler_Analyzer_String_literal_p(struct Fiber_Profiler_Analyzer_String string, const char *literal)
+{
+	size_t length = strlen(literal);
+	
+	return string.length == length && memcmp(string.data, literal, length) == 0;
+}
+
+static int Fiber_Profiler_Analyzer_Summary_initialize(struct Fiber_Profiler_Analyzer_Summary *summary)
+{
+	summary->size = 0;
+	summary->capacity = Fiber_Profiler_Analyzer_DEFAULT_CAPACITY;
+	summary->slots_capacity = Fiber_Profiler_Analyzer_DEFAULT_CAPACITY * 2;
+	
+	summary->locations = malloc(summary->capacity * sizeof(struct Fiber_Profiler_Analyzer_Location));
+	summary->slots = calloc(summary->slots_capacity, sizeof(uint32_t));
+	
+	if (summary->locations == NULL || summary->slots == NULL) {
+		summary->capacity = summary->slots_capacity = 0;
+		return -1;
+	}
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Analyzer_Summary_free(struct Fiber_Profiler_Analyzer_Summary *summary)
+{
+	for (size_t i = 0; i < summary->size; i += 1) {
+		free(summary->locations[i].strings);
+	}
+	
+	free(summary->locations);
+	summary->locations = NULL;
+	
+	free(summary->slots);
+	summary->slots = NULL;
+	
+	summary->size = summary->capacity = summary->slots_capacity = 0;
+}
+
+// Remove all the locations, keeping the memory for reuse.
+static void Fiber_Profiler_Analyzer_Summary_clear(struct Fiber_Profiler_Analyzer_Summary *summary)
+{
+	for (size_t i = 0; i < summary->size; i += 1) {
+		free(summary->locations[i].strings);
+	}
+	
+	summary->size = 0;
+	
+	if (summary->slots) {
+		memset(summary->slots, 0, summary->slots_capacity * sizeof(uint32_t));
+	}
+}
+
+// Copy the path, class and method of the location into memory it owns, so that it remains valid after the log it points into is reused. Returns -1 if memory could not be allocated.
+static int Fiber_Profiler_Analyzer_Location_copy(struct Fiber_Profiler_Analyzer_Location *location)
+{
+	struct Fiber_Profiler_Analyzer_String *strings[3] = {&location->path, &location->class_name, &location->method_name};
+	size_t size = 0;
+	
+	for (size_t i = 0; i < 3; i += 1) {
+		size += strings[i]->length;
+	}
+	
+	// Ensure that empty strings still have a non-NULL data pointer:
+	char *copy = malloc(size ? size : 1);
+	if (copy == NULL) return -1;
+	
+	location->strings = copy;
+	
+	for (size_t i = 0; i < 3; i += 1) {
+		if (strings[i]->data == NULL) continue;
+		
+		memcpy(copy, strings[i]->data, strings[i]->length);
+		strings[i]->data = copy;
+		copy += strings[i]->length;
+	}
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Analyzer_Summary_insert_slot(uint32_t *slots, size_t slots_capacity, uint32_t hash, uint32_t index)
+{
+	size_t mask = slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	while (slots[slot]) {
+		slot = (slot + 1) & mask;
+	}
+	
+	slots[slot] = index + 1;
+}
+
+// Find the location with the given path and line, or add a new one. Returns 1 if the location was added, 0 if it already existed, or -1 if memory could not be allocated.
+static int Fiber_Profiler_Analyzer_Summary_intern(struct Fiber_Profiler_Analyzer_Summary *summary, struct Fiber_Profiler_Analyzer_String path, int line, uint32_t hash, uint32_t *index)
+{
+	if (summary->slots == NULL) return -1;
+	
+	size_t mask = summary->slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	while (summary->slots[slot]) {
+		struct Fiber_Profiler_Analyzer_Location *location = &summary->locations[summary->slots[slot] - 1];
+		
+		if (location->hash == hash && location->line == line && Fiber_Profiler_Analyzer_String_equal(location->path, path)) {
+			*index = summary->slots[slot] - 1;
+			return 0;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	// Keep the load factor at or below 50%:
+	if ((summary->size + 1) * 2 > summary->slots_capacity) {
+		size_t slots_capacity = summary->slots_capacity * 2;
+		uint32_t *slots = calloc(slots_capacity, sizeof(uint32_t));
+		
+		if (slots == NULL) return -1;
+		
+		for (size_t i = 0; i < summary->size; i += 1) {
+			Fiber_Profiler_Analyzer_Summary_insert_slot(slots, slots_capacity, summary->locations[i].hash, (uint32_t)i);
+		}
+		
+		free(summary->slots);
+		summary->slots = slots;
+		summary->slots_capacity = slots_capacity;
+	}
+	
+	if (summary->size == summary->capacity) {
+		size_t capacity = summary->capacity * 2;
+		struct Fiber_Profiler_Analyzer_Location *locations = realloc(summary->locations, capacity * sizeof(struct Fiber_Profiler_Analyzer_Location));
+		
+		if (locations == NULL) return -1;
+		
+		summary->locations = locations;
+		summary->capacity = capacity;
+	}
+	
+	*index = (uint32_t)summary->size;
+	struct Fiber_Profiler_Analyzer_Location *location = &summary->locations[*index];
+	
+	location->path = path;
+	location->line = line;
+	location->hash = hash;
+	location->class_name.data = location->method_name.data = NULL;
+	location->class_name.length = location->method_name.length = 0;
+	location->calls = 0;
+	location->duration = 0;
+	location->self_time = 0;
+	Fiber_Profiler_Histogram_clear(&location->histogram);
+	location->strings = NULL;
+	
+	summary->size += 1;
+	
+	Fiber_Profiler_Analyzer_Summary_insert_slot(summary->slots, summary->slots_capacity, hash, *index);
+	
+	return 1;
+}
+
+// Merge the locations of `other` into `summary`, copying the strings of new locations if `copy` is set. Returns -1 if memory could not be allocated.
+static int Fiber_Profiler_Analyzer_Summary_merge(struct Fiber_Profiler_Analyzer_Summary *summary, const struct Fiber_Profiler_Analyzer_Summary *other, int copy)
+{
+	for (size_t i = 0; i < other->size; i += 1) {
+		const struct Fiber_Profiler_Analyzer_Location *source = &other->locations[i];
+		uint32_t index;
+		
+		int result = Fiber_Profiler_Analyzer_Summary_intern(summary, source->path, source->line, source->hash, &index);
+		if (result < 0) return -1;
+		
+		struct Fiber_Profiler_Analyzer_Location *location = &summary->locations[index];
+		
+		if (result) {
+			location->class_name = source->class_name;
+			location->method_name = source->method_name;
+			
+			if (copy && Fiber_Profiler_Analyzer_Location_copy(location)) return -1;
+		}
+		
+		location->calls += source->calls;
+		location->duration += source->duration;
+		location->self_time += source->self_time;
+		Fiber_Profiler_Histogram_merge(&location->histogram, &source->histogram);
+	}
+	
+	return 0;
+}
+
+#pragma mark - Parser
+
+static void Fiber_Profiler_Analyzer_skip_whitespace(const char **cursor, const char *end)
+{
+	const char *current = *cursor;
+	
+	while (current < end && (*current == ' ' || *current == '\t' || *current == '\r' || *current == '\n')) {
+		current += 1;
+	}
+	
+	*cursor = current;
+}
+
+static int Fiber_Profiler_Analyzer_expect(const char **cursor, const char *end, char character)
+{
+	Fiber_Profiler_Analyzer_skip_whitespace(cursor, end);
+	
+	if (*cursor < end && **cursor == character) {
+		*cursor += 1;
+		return 1;
+	}
+	
+	return 0;
+}
+
+static int Fiber_Profiler_Analyzer_parse_string(const char **cursor, const char *end, struct Fiber_Profiler_Analyzer_String *string)
+{
+	const char *current = *cursor;
+	
+	if (current >= end || *current != '"') return 0;
+	current += 1;
+	
+	const char *start = current;
+	
+	while (current < end && *current != '"') {
+		// Skip the escaped character, which may be a quote:
+		if (*current == '\\') current += 1;
+		current += 1;
+	}
+	
+	if (current >= end) return 0;
+	
+	string->data = start;
+	string->length = current - start;
+	
+	*cursor = current + 1;
+	
+	return 1;
+}
+
+static int Fiber_Profiler_Analyzer_digit_p(const char *current, const char *end)
+{
+	return current < end && *current >= '0' && *current <= '9';
+}
+
+// The log is not NUL terminated, so we can't use `strtod`:
+static int Fiber_Profiler_Analyzer_parse_number(const char **cursor, const char *end, double *number)
+{
+	const char *current = *cursor;
+	int negative = 0;
+	double value = 0;
+	
+	if (current < end && *current == '-') {
+		negative = 1;
+		current += 1;
+	}
+	
+	if (!Fiber_Profiler_Analyzer_digit_p(current, end)) return 0;
+	
+	while (Fiber_Profiler_Analyzer_digit_p(current, end)) {
+		value = value * 10 + (*current - '0');
+		current += 1;
+	}
+	
+	if (current < end && *current == '.') {
+		current += 1;
+		
+		double scale = 0.1;
+		while (Fiber_Profiler_Analyzer_digit_p(current, end)) {
+			value += (*current - '0') * scale;
+			scale *= 0.1;
+			current += 1;
+		}
+	}
+	
+	if (current < end && (*current == 'e' || *current == 'E')) {
+		current += 1;
+		
+		int exponent_negative = 0;
+		int exponent = 0;
+		
+		if (current < end && (*current == '-' || *current == '+')) {
+			exponent_negative = *current == '-';
+			current += 1;
+		}
+		
+		while (Fiber_Profiler_Analyzer_digit_p(current, end)) {
+			if (exponent < 1000) exponent = exponent * 10 + (*current - '0');
+			current += 1;
+		}
+		
+		value *= pow(10, exponent_negative ? -exponent : exponent);
+	}
+	
+	*number = negative ? -value : value;
+	*cursor = current;
+	
+	return 1;
+}
+
+// Skip over any value, including nested objects and arrays:
+static int Fiber_Profiler_Analyzer_skip_value(const char **cursor, const char *end)
+{
+	struct Fiber_Profiler_Analyzer_String string;
+	const char *current = *cursor;
+	
+	if (current >= end) return 0;
+	
+	if (*current == '"') {
+		return Fiber_Profiler_Analyzer_parse_string(cursor, end, &string);
+	}
+	
+	if (*current == '{' || *current == '[') {
+		size_t depth = 0;
+		
+		while (current < end) {
+			if (*current == '"') {
+				if (!Fiber_Profiler_Analyzer_parse_string(&current, end, &string)) return 0;
+				continue;
+			}
+			
+			if (*current == '{' || *current == '[') {
+				depth += 1;
+			} else if (*current == '}' || *current == ']') {
+				depth -= 1;
+				
+				if (depth == 0) {
+					*cursor = current + 1;
+					return 1;
+				}
+			}
+			
+			current += 1;
+		}
+		
+		return 0;
+	}
+	
+	// Numbers and literals:
+	while (current < end && *current != ',' && *current != '}' && *current != ']' && *current != ' ' && *current != '\n') {
+		current += 1;
+	}
+	
+	if (current == *cursor) return 0;
+	
+	*cursor = current;
+	
+	return 1;
+}
+
+// Parse the key of an object member, up to and including the colon:
+static int Fiber_Profiler_Analyzer_parse_key(const char **cursor, const char *end, struct Fiber_Profiler_Analyzer_String *key)
+{
+	Fiber_Profiler_Analyzer_skip_whitespace(cursor, end);
+	
+	if (!Fiber_Profiler_Analyzer_parse_string(cursor, end, key)) return 0;
+	if (!Fiber_Profiler_Analyzer_expect(cursor, end, ':')) return 0;
+	
+	Fiber_Profiler_Analyzer_skip_whitespace(cursor, end);
+	
+	return 1;
+}
+
+static int Fiber_Profiler_Analyzer_parse_string_value(const char **cursor, const char *end, struct Fiber_Profiler_Analyzer_String *string)
+{
+	if (*cursor < end && **cursor == '"') {
+		return Fiber_Profiler_Analyzer_parse_string(cursor, end, string);
+	}
+	
+	// e.g. null:
+	string->data = NULL;
+	string->length = 0;
+	
+	return Fiber_Profiler_Analyzer_skip_value(cursor, end);
+}
+
+static int Fiber_Profiler_Analyzer_parse_number_value(const char **cursor, const char *end, double *number)
+{
+	if (Fiber_Profiler_Analyzer_parse_number(cursor, end, number)) return 1;
+	
+	*number = 0;
+	
+	return Fiber_Profiler_Analyzer_skip_value(cursor, end);
+}
+
+static int Fiber_Profiler_Analyzer_parse_call(const char **cursor, const char *end, struct Fiber_Profiler_Analyzer_Call *call)
+{
+	struct Fiber_Profiler_Analyzer_String key;
+	double line = 0;
+	
+	call->path.data = call->class_name.data = call->method_name.data = NULL;
+	call->path.length = call->class_name.length = call->method_name.length = 0;
+	call->duration = 0;
+	call->nesting = 0;
+	call->self_time = -1;
+	
+	if (!Fiber_Profiler_Analyzer_expect(cursor, end, '{')) return 0;
+	if (Fiber_Profiler_Analyzer_expect(cursor, end, '}')) return 1;
+	
+	do {
+		if (!Fiber_Profiler_Analyzer_parse_key(cursor, end, &key)) return 0;
+		
+		int result;
+		
+		if (Fiber_Profiler_Analyzer_String_literal_p(key, "path")) {
+			result = Fiber_Profiler_Analyzer_parse_string_value(cursor, end, &call->path);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "class")) {
+			result = Fiber_Profiler_Analyzer_parse_string_value(cursor, end, &call->class_name);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "method")) {
+			result = Fiber_Profiler_Analyzer_parse_string_value(cursor, end, &call->method_name);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "line")) {
+			result = Fiber_Profiler_Analyzer_parse_number_value(cursor, end, &line);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "duration")) {
+			result = Fiber_Profiler_Analyzer_parse_number_value(cursor, end, &call->duration);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "self_time")) {
+			result = Fiber_Profiler_Analyzer_parse_number_value(cursor, end, &call->self_time);
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "nesting")) {
+			result = Fiber_Profiler_Analyzer_parse_number_value(cursor, end, &call->nesting);
+		} else {
+			result = Fiber_Profiler_Analyzer_skip_value(cursor, end);
+		}
+		
+		if (!result) return 0;
+	} while (Fiber_Profiler_Analyzer_expect(cursor, end, ','));
+	
+	call->line = (int)line;
+	
+	return Fiber_Profiler_Analyzer_expect(cursor, end, '}');
+}
+
+#pragma mark - Worker
+
+static int Fiber_Profiler_Analyzer_Worker_initialize(struct Fiber_Profiler_Analyzer_Worker *worker, volatile int *cancelled)
+{
+	worker->start = worker->end = NULL;
+	worker->stalls = 0;
+	worker->failed = 0;
+	worker->cancelled = cancelled;
+	
+	worker->calls_capacity = Fiber_Profiler_Analyzer_DEFAULT_CAPACITY;
+	worker->calls = malloc(worker->calls_capacity * sizeof(struct Fiber_Profiler_Analyzer_Call));
+	
+	worker->stack_capacity = Fiber_Profiler_Analyzer_DEFAULT_CAPACITY;
+	worker->stack = malloc(worker->stack_capacity * sizeof(struct Fiber_Profiler_Analyzer_Frame));
+	
+	if (Fiber_Profiler_Analyzer_Summary_initialize(&worker->summary) || worker->calls == NULL || worker->stack == NULL) {
+		worker->failed = 1;
+		return -1;
+	}
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Analyzer_Worker_free(struct Fiber_Profiler_Analyzer_Worker *worker)
+{
+	Fiber_Profiler_Analyzer_Summary_free(&worker->summary);
+	
+	free(worker->calls);
+	worker->calls = NULL;
+	
+	free(worker->stack);
+	worker->stack = NULL;
+}
+
+static int Fiber_Profiler_Analyzer_Worker_reserve(void **buffer, size_t *capacity, size_t size, size_t element_size)
+{
+	if (size < *capacity) return 0;
+	
+	void *resized = realloc(*buffer, *capacity * 2 * element_size);
+	if (resized == NULL) return -1;
+	
+	*buffer = resized;
+	*capacity *= 2;
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Analyzer_Worker_pop(struct Fiber_Profiler_Analyzer_Worker *worker, size_t *depth)
+{
+	*depth -= 1;
+	
+	struct Fiber_Profiler_Analyzer_Frame *frame = &worker->stack[*depth];
+	
+	// Prefer the self time recorded by the capture, which also accounts for children that were filtered or skipped:
+	if (frame->self_time >= 0) {
+		worker->summary.locations[frame->location].self_time += frame->self_time;
+	} else {
+		worker->summary.locations[frame->location].self_time += frame->duration - frame->children;
+	}
+}
+
+// Add the calls of a stall to the summary. Calls are ordered such that parents precede their children, and the nesting of each call is one more than its parent, so we can use a stack to find the direct children of each call.
+static int Fiber_Profiler_Analyzer_Worker_summarize(struct Fiber_Profiler_Analyzer_Worker *worker, size_t count)
+{
+	struct Fiber_Profiler_Analyzer_Summary *summary = &worker->summary;
+	size_t depth = 0;
+	
+	for (size_t i = 0; i < count; i += 1) {
+		struct Fiber_Profiler_Analyzer_Call *call = &worker->calls[i];
+		uint32_t index;
+		
+		int result = Fiber_Profiler_Analyzer_Summary_intern(summary, call->path, call->line, Fiber_Profiler_Analyzer_hash(call->path, call->line), &index);
+		if (result < 0) return -1;
+		
+		struct Fiber_Profiler_Analyzer_Location *location = &summary->locations[index];
+		
+		if (result) {
+			location->class_name = call->class_name;
+			location->method_name = call->method_name;
+		}
+		
+		location->calls += 1;
+		location->duration += call->duration;
+		Fiber_Profiler_Histogram_add(&location->histogram, call->duration);
+		
+		while (depth > 0 && worker->stack[depth - 1].nesting >= call->nesting) {
+			Fiber_Profiler_Analyzer_Worker_pop(worker, &depth);
+		}
+		
+		if (depth > 0) {
+			worker->stack[depth - 1].children += call->duration;
+		}
+		
+		if (Fiber_Profiler_Analyzer_Worker_reserve((void**)&worker->stack, &worker->stack_capacity, depth, sizeof(struct Fiber_Profiler_Analyzer_Frame))) return -1;
+		
+		struct Fiber_Profiler_Analyzer_Frame *frame = &worker->stack[depth++];
+		frame->location = index;
+		frame->nesting = call->nesting;
+		frame->duration = call->duration;
+		frame->children = 0;
+		frame->self_time = call->self_time;
+	}
+	
+	while (depth > 0) {
+		Fiber_Profiler_Analyzer_Worker_pop(worker, &depth);
+	}
+	
+	return 0;
+}
+
+// Parse a single stall. Lines which can't be parsed, or which don't have a duration and calls, are ignored.
+static int Fiber_Profiler_Analyzer_Worker_parse(struct Fiber_Profiler_Analyzer_Worker *worker, const char *cursor, const char *end)
+{
+	struct Fiber_Profiler_Analyzer_String key;
+	int duration = 0, calls = 0;
+	size_t count = 0;
+	
+	if (!Fiber_Profiler_Analyzer_expect(&cursor, end, '{')) return 0;
+	if (Fiber_Profiler_Analyzer_expect(&cursor, end, '}')) return 0;
+	
+	do {
+		if (!Fiber_Profiler_Analyzer_parse_key(&cursor, end, &key)) return 0;
+		
+		if (Fiber_Profiler_Analyzer_String_literal_p(key, "duration")) {
+			double value;
+			duration = Fiber_Profiler_Analyzer_parse_number(&cursor, end, &value);
+			
+			if (!duration && !Fiber_Profiler_Analyzer_skip_value(&cursor, end)) return 0;
+		} else if (Fiber_Profiler_Analyzer_String_literal_p(key, "calls") && cursor < end && *cursor == '[') {
+			cursor += 1;
+			calls = 1;
+			
+			if (!Fiber_Profiler_Analyzer_expect(&cursor, end, ']')) {
+				do {
+					if (Fiber_Profiler_Analyzer_Worker_reserve((void**)&worker->calls, &worker->calls_capacity, count, sizeof(struct Fiber_Profiler_Analyzer_Call))) return -1;
+					
+					if (!Fiber_Profiler_Analyzer_parse_call(&cursor, end, &worker->calls[count])) return 0;
+					count += 1;
+				} while (Fiber_Profiler_Analyzer_expect(&cursor, end, ','));
+				
+				if (!Fiber_Profiler_Analyzer_expect(&cursor, end, ']')) return 0;
+			}
+		} else {
+			if (!Fiber_Profiler_Analyzer_skip_value(&cursor, end)) return 0;
+		}
+	} while (Fiber_Profiler_Analyzer_expect(&cursor, end, ','));
+	
+	if (!Fiber_Profiler_Analyzer_expect(&cursor, end, '}')) return 0;
+	
+	if (duration && calls) {
+		worker->stalls += 1;
+		
+		return Fiber_Profiler_Analyzer_Worker_summarize(worker, count);
+	}
+	
+	return 0;
+}
+
+static void *Fiber_Profiler_Analyzer_Worker_run(void *argument)
+{
+	struct Fiber_Profiler_Analyzer_Worker *worker = argument;
+	const char *current = worker->start;
+	
+	while (current < worker->end && !worker->failed && !*worker->cancelled) {
+		const char *newline = memchr(current, '\n', worker->end - current);
+		const char *end = newline ? newline : worker->end;
+		
+		if (Fiber_Profiler_Analyzer_Worker_parse(worker, current, end) < 0) {
+			worker->failed = 1;
+		}
+		
+		current = end + 1;
+	}
+	
+	return NULL;
+}
+
+#pragma mark - Analysis
+
+// Summarize the lines from `start` to `end`, split into chunks which end on a newline, and merge them into the analysis. Runs without the GVL.
+static void Fiber_Profiler_Analyzer_Analysis_process(struct Fiber_Profiler_Analyzer_Analysis *analysis, const char *start, const char *end, int copy)
+{
+	struct Fiber_Profiler_Analyzer_Worker *workers = analysis->workers;
+	int started[Fiber_Profiler_Analyzer_MAXIMUM_THREADS] = {0};
+	size_t size = end - start;
+	
+	// Small batches aren't worth splitting:
+	size_t chunks = (size + Fiber_Profiler_Analyzer_MINIMUM_CHUNK - 1) / Fiber_Profiler_Analyzer_MINIMUM_CHUNK;
+	size_t count = chunks < analysis->count ? chunks : analysis->count;
+	const char *data = start;
+	
+	for (size_t i = 0; i < count; i += 1) {
+		const char *chunk_end = end;
+		
+		if (i + 1 < count) {
+			chunk_end = data + size * (i + 1) / count;
+			if (chunk_end < start) chunk_end = start;
+			
+			const char *newline = memchr(chunk_end, '\n', end - chunk_end);
+			chunk_end = newline ? newline + 1 : end;
+		}
+		
+		workers[i].start = start;
+		workers[i].end = chunk_end;
+		
+		start = chunk_end;
+	}
+	
+	for (size_t i = 1; i < count; i += 1) {
+		started[i] = pthread_create(&workers[i].thread, NULL, Fiber_Profiler_Analyzer_Worker_run, &workers[i]) == 0;
+	}
+	
+	if (count > 0) Fiber_Profiler_Analyzer_Worker_run(&workers[0]);
+	
+	for (size_t i = 1; i < count; i += 1) {
+		if (started[i]) {
+			pthread_join(workers[i].thread, NULL);
+		} else {
+			// If the thread could not be created, parse the chunk on this thread instead:
+			Fiber_Profiler_Analyzer_Worker_run(&workers[i]);
+		}
+	}
+	
+	// Merge in order, so that the class and method of each location come from its first call, as if the log was read sequentially:
+	for (size_t i = 0; i < count; i += 1) {
+		if (workers[i].failed || Fiber_Profiler_Analyzer_Summary_merge(&analysis->summary, &workers[i].summary, copy)) {
+			analysis->failed = 1;
+		}
+		
+		analysis->stalls += workers[i].stalls;
+		workers[i].stalls = 0;
+		Fiber_Profiler_Analyzer_Summary_clear(&workers[i].summary);
+	}
+}
+
+// Find the end of the last complete line in the given data, or NULL if there is no newline:
+static const char *Fiber_Profiler_Analyzer_last_line(const char *start, const char *end)
+{
+	while (end > start) {
+		if (end[-1] == '\n') return end;
+		end -= 1;
+	}
+	
+	return NULL;
+}
+
+// Runs without the GVL:
+static void *Fiber_Profiler_Analyzer_Analysis_run(void *argument)
+{
+	struct Fiber_Profiler_Analyzer_Analysis *analysis = argument;
+	
+	if (!analysis->compressed) {
+		Fiber_Profiler_Analyzer_Analysis_process(analysis, analysis->data, analysis->data + analysis->size, 0);
+		
+		return NULL;
+	}
+	
+	struct Fiber_Profiler_Buffer *inflated = &analysis->inflated;
+	
+	while (!analysis->failed && !analysis->cancelled) {
+		if (Fiber_Profiler_Inflater_read(&analysis->inflater, inflated, Fiber_Profiler_Analyzer_BATCH)) {
+			analysis->failed = 1;
+			break;
+		}
+		
+		const char *start = inflated->data, *end = inflated->data + inflated->size;
+		
+		if (analysis->inflater.finished) {
+			Fiber_Profiler_Analyzer_Analysis_process(analysis, start, end, 1);
+			break;
+		}
+		
+		// Summarize the complete lines, and keep the rest for the next batch; if a line is longer than the batch, keep reading until it is complete:
+		const char *last = Fiber_Profiler_Analyzer_last_line(start, end);
+		if (last == NULL) continue;
+		
+		Fiber_Profiler_Analyzer_Analysis_process(analysis, start, last, 1);
+		
+		memmove(inflated->data, last, end - last);
+		inflated->size = end - last;
+	}
+	
+	return NULL;
+}
+
+// The unblocking function, which asks the analysis to stop so that the calling thread can handle its interrupt:
+static void Fiber_Profiler_Analyzer_Analysis_cancel(void *argument)
+{
+	struct Fiber_Profiler_Analyzer_Analysis *analysis = argument;
+	
+	analysis->cancelled = 1;
+}
+
+static VALUE Fiber_Profiler_Analyzer_Analysis_release(VALUE argument)
+{
+	struct Fiber_Profiler_Analyzer_Analysis *analysis = (struct Fiber_Profiler_Analyzer_Analysis *)argument;
+	
+	if (analysis->workers) {
+		for (size_t i = 0; i < analysis->count; i += 1) {
+			Fiber_Profiler_Analyzer_Worker_free(&analysis->workers[i]);
+		}
+		
+		free(analysis->workers);
+		analysis->workers = NULL;
+	}
+	
+	Fiber_Profiler_Analyzer_Summary_free(&analysis->summary);
+	
+	if (analysis->compressed) {
+		Fiber_Profiler_Inflater_free(&analysis->inflater);
+		Fiber_Profiler_Buffer_free(&analysis->inflated);
+		analysis->compressed = 0;
+	}
+	
+	if (analysis->data) {
+		munmap((void*)analysis->data, analysis->size);
+		analysis->data = NULL;
+	}
+	
+	if (analysis->descriptor >= 0) {
+		close(analysis->descriptor);
+		analysis->descriptor = -1;
+	}
+	
+	return Qnil;
+}
+
+// Convert a JSON string to a Ruby string, decoding any escape sequences:
+static VALUE Fiber_Profiler_Analyzer_String_value(struct Fiber_Profiler_Analyzer_String string)
+{
+	if (string.data == NULL) return Qnil;
+	
+	if (memchr(string.data, '\\', string.length) == NULL) {
+		return rb_utf8_str_new(string.data, string.length);
+	}
+	
+	VALUE result = rb_utf8_str_new(NULL, 0);
+	const char *current = string.data, *end = string.data + string.length;
+	
+	while (current < end) {
+		if (*current != '\\' || current + 1 >= end) {
+			rb_str_cat(result, current, 1);
+			current += 1;
+			continue;
+		}
+		
+		char escape = current[1];
+		current += 2;
+		
+		switch (escape) {
+			case 'n': rb_str_cat(result, "\n", 1); break;
+			case 't': rb_str_cat(result, "\t", 1); break;
+			case 'r': rb_str_cat(result, "\r", 1); break;
+			case 'b': rb_str_cat(result, "\b", 1); break;
+			case 'f': rb_str_cat(result, "\f", 1); break;
+			case 'u': {
+				unsigned codepoint = 0;
+				
+				for (int i = 0; i < 4 && current < end; i += 1, current += 1) {
+					char digit = *current;
+					codepoint = codepoint * 16 + (digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+				}
+				
+				// Surrogate pairs:
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && current + 6 <= end && current[0] == '\\' && current[1] == 'u') {
+					unsigned low = 0;
+					
+					for (int i = 2; i < 6; i += 1) {
+						char digit = current[i];
+						low = low * 16 + (digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+					}
+					
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					current += 6;
+				}
+				
+				rb_str_concat(result, UINT2NUM(codepoint));
+				break;
+			}
+			default: rb_str_cat(result, &escape, 1); break;
+		}
+	}
+	
+	return result;
+}
+
+static int Fiber_Profiler_Analyzer_Location_compare(const void *a, const void *b)
+{
+	const struct Fiber_Profiler_Analyzer_Location *x = *(const struct Fiber_Profiler_Analyzer_Location **)a;
+	const struct Fiber_Profiler_Analyzer_Location *y = *(const struct Fiber_Profiler_Analyzer_Location **)b;
+	
+	if (x->duration > y->duration) return -1;
+	if (x->duration < y->duration) return 1;
+	
+	return 0;
+}
+
+static VALUE Fiber_Profiler_Analyzer_Analysis_summarize(VALUE argument)
+{
+	struct Fiber_Profiler_Analyzer_Analysis *analysis = (struct Fiber_Profiler_Analyzer_Analysis *)argument;
+	
+	rb_thread_call_without_gvl(Fiber_Profiler_Analyzer_Analysis_run, analysis, Fiber_Profiler_Analyzer_Analysis_cancel, analysis);
+	
+	if (analysis->cancelled) {
+		// Raise the pending interrupt, if any; the summary is incomplete in any case:
+		rb_thread_check_ints();
+		rb_raise(rb_eRuntimeError, "Analysis was interrupted!");
+	}
+	
+	struct Fiber_Profiler_Analyzer_Summary *summary = &analysis->summary;
+	
+	if (analysis->failed) {
+		rb_raise(rb_eNoMemError, "Failed to allocate summary!");
+	}
+	
+	VALUE result = rb_ary_new_capa(summary->size);
+	
+	VALUE buffer = 0;
+	struct Fiber_Profiler_Analyzer_Location **locations = RB_ALLOCV_N(struct Fiber_Profiler_Analyzer_Location *, buffer, summary->size);
+	
+	for (size_t i = 0; i < summary->size; i += 1) {
+		locations[i] = &summary->locations[i];
+	}
+	
+	qsort(locations, summary->size, sizeof(*locations), Fiber_Profiler_Analyzer_Location_compare);
+	
+	for (size_t i = 0; i < summary->size; i += 1) {
+		struct Fiber_Profiler_Analyzer_Location *location = locations[i];
+		
+		VALUE path = Fiber_Profiler_Analyzer_String_value(location->path);
+		VALUE key = rb_sprintf("%"PRIsVALUE":%d", path, location->line);
+		
+		VALUE data = rb_hash_new();
+		rb_hash_aset(data, ID2SYM(rb_intern("duration")), DBL2NUM(location->duration));
+		rb_hash_aset(data, ID2SYM(rb_intern("self_time")), DBL2NUM(location->self_time));
+		rb_hash_aset(data, ID2SYM(rb_intern("calls")), SIZET2NUM(location->calls));
+		rb_hash_aset(data, ID2SYM(rb_intern("class")), Fiber_Profiler_Analyzer_String_value(location->class_name));
+		rb_hash_aset(data, ID2SYM(rb_intern("method")), Fiber_Profiler_Analyzer_String_value(location->method_name));
+		rb_hash_aset(data, ID2SYM(rb_intern("p50")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&location->histogram, 0.5)));
+		rb_hash_aset(data, ID2SYM(rb_intern("p90")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&location->histogram, 0.9)));
+		rb_hash_aset(data, ID2SYM(rb_intern("p99")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&location->histogram, 0.99)));
+		
+		rb_ary_push(result, rb_assoc_new(key, data));
+	}
+	
+	RB_ALLOCV_END(buffer);
+	
+	return result;
+}
+
+// Summarize a log of JSON stalls by location.
+//
+// @parameter path [String] The path to the log, with one stall per line, which may be gzip compressed.
+// @parameter threads [Integer | Nil] The number of threads to use, by default the number of processors.
+// @returns [Array] Pairs of "path:line" and the summary of that location, ordered by duration.
+static VALUE Fiber_Profiler_Analyzer_analyze(int argc, VALUE *argv, VALUE self)
+{
+	VALUE path, options = Qnil;
+	rb_scan_args(argc, argv, "1:", &path, &options);
+	
+	ID keywords[1] = {rb_intern("threads")};
+	VALUE arguments[1] = {Qundef};
+	rb_get_kwargs(options, keywords, 0, 1, arguments);
+	
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	if (arguments[0] != Qundef && arguments[0] != Qnil) {
+		threads = NUM2LONG(arguments[0]);
+	}
+	
+	if (threads < 1) threads = 1;
+	if (threads > Fiber_Profiler_Analyzer_MAXIMUM_THREADS) threads = Fiber_Profiler_Analyzer_MAXIMUM_THREADS;
+	
+	struct Fiber_Profiler_Analyzer_Analysis analysis = {
+		.path = rb_str_new_frozen(rb_get_path(path)),
+		.descriptor = -1,
+	};
+	
+	analysis.descriptor = open(RSTRING_PTR(analysis.path), O_RDONLY | O_CLOEXEC);
+	if (analysis.descriptor < 0) rb_sys_fail_str(analysis.path);
+	
+	struct stat status;
+	if (fstat(analysis.descriptor, &status)) {
+		Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+		rb_sys_fail_str(analysis.path);
+	}
+	
+	analysis.size = status.st_size;
+	
+	if (analysis.size == 0) {
+		Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+		return rb_ary_new();
+	}
+	
+	void *data = mmap(NULL, analysis.size, PROT_READ, MAP_PRIVATE, analysis.descriptor, 0);
+	if (data == MAP_FAILED) {
+		Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+		rb_sys_fail_str(analysis.path);
+	}
+	
+	analysis.data = data;
+	madvise(data, analysis.size, MADV_SEQUENTIAL);
+	
+	size_t chunks;
+	
+	if (Fiber_Profiler_Compression_gzip_p(analysis.data, analysis.size)) {
+		analysis.compressed = 1;
+		Fiber_Profiler_Buffer_initialize(&analysis.inflated);
+		
+		if (Fiber_Profiler_Inflater_initialize(&analysis.inflater, analysis.data, analysis.size)) {
+			Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+			rb_raise(rb_eNoMemError, "Failed to decompress log!");
+		}
+		
+		chunks = Fiber_Profiler_Analyzer_BATCH / Fiber_Profiler_Analyzer_MINIMUM_CHUNK;
+	} else {
+		// Small logs aren't worth splitting:
+		chunks = (analysis.size + Fiber_Profiler_Analyzer_MINIMUM_CHUNK - 1) / Fiber_Profiler_Analyzer_MINIMUM_CHUNK;
+	}
+	
+	analysis.count = chunks < (size_t)threads ? chunks : (size_t)threads;
+	
+	analysis.workers = calloc(analysis.count, sizeof(struct Fiber_Profiler_Analyzer_Worker));
+	if (analysis.workers == NULL) {
+		analysis.count = 0;
+		Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+		rb_raise(rb_eNoMemError, "Failed to allocate workers!");
+	}
+	
+	int failed = Fiber_Profiler_Analyzer_Summary_initialize(&analysis.summary);
+	
+	for (size_t i = 0; i < analysis.count; i += 1) {
+		if (Fiber_Profiler_Analyzer_Worker_initialize(&analysis.workers[i], &analysis.cancelled)) {
+			failed = 1;
+		}
+	}
+	
+	if (failed) {
+		Fiber_Profiler_Analyzer_Analysis_release((VALUE)&analysis);
+		rb_raise(rb_eNoMemError, "Failed to allocate workers!");
+	}
+	
+	return rb_ensure(Fiber_Profiler_Analyzer_Analysis_summarize, (VALUE)&analysis, Fiber_Profiler_Analyzer_Analysis_release, (VALUE)&analysis);
+}
+
+void Init_Fiber_Profiler_Analyzer(VALUE Fiber_Profiler)
+{
+	Fiber_Profiler_Analyzer = rb_define_module_under(Fiber_Profiler, "Analyzer");
+	
+	rb_define_singleton_method(Fiber_Profiler_Analyzer, "analyze", Fiber_Profiler_Analyzer_analyze, -1);
+}
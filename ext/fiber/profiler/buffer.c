@@ -0,0 +1,348 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "buffer.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Buffers start large enough for a typical stall report, and double as required:
+static const size_t Fiber_Profiler_Buffer_MINIMUM_CAPACITY = 4096;
+
+static const uint64_t Fiber_Profiler_Buffer_POWERS[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+// Each pair of decimal digits, so that integers can be formatted two digits at a time:
+static const char Fiber_Profiler_Buffer_DIGITS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+void Fiber_Profiler_Buffer_initialize(struct Fiber_Profiler_Buffer *buffer)
+{
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->capacity = 0;
+	buffer->failed = 0;
+}
+
+void Fiber_Profiler_Buffer_free(struct Fiber_Profiler_Buffer *buffer)
+{
+	if (buffer->data) {
+		free(buffer->data);
+		buffer->data = NULL;
+	}
+	
+	buffer->size = buffer->capacity = 0;
+}
+
+int Fiber_Profiler_Buffer_grow(struct Fiber_Profiler_Buffer *buffer, size_t size)
+{
+	if (buffer->failed) return -1;
+	
+	size_t capacity = buffer->capacity ? buffer->capacity : Fiber_Profiler_Buffer_MINIMUM_CAPACITY;
+	
+	while (capacity - buffer->size < size) {
+		capacity *= 2;
+	}
+	
+	char *data = realloc(buffer->data, capacity);
+	
+	if (data == NULL) {
+		buffer->failed = 1;
+		return -1;
+	}
+	
+	buffer->data = data;
+	buffer->capacity = capacity;
+	
+	return 0;
+}
+
+void Fiber_Profiler_Buffer_append_repeated(struct Fiber_Profiler_Buffer *buffer, char character, size_t count)
+{
+	char *target = Fiber_Profiler_Buffer_reserve(buffer, count);
+	
+	if (target) {
+		memset(target, character, count);
+		buffer->size += count;
+	}
+}
+
+// Write the decimal digits of the value so that they end at `end`, returning the start of the digits.
+static char *Fiber_Profiler_Buffer_format_unsigned(char *end, uint64_t value)
+{
+	char *start = end;
+	
+	while (value >= 100) {
+		unsigned pair = (unsigned)(value % 100) * 2;
+		value /= 100;
+		
+		start -= 2;
+		start[0] = Fiber_Profiler_Buffer_DIGITS[pair];
+		start[1] = Fiber_Profiler_Buffer_DIGITS[pair + 1];
+	}
+	
+	if (value >= 10) {
+		unsigned pair = (unsigned)value * 2;
+		
+		start -= 2;
+		start[0] = Fiber_Profiler_Buffer_DIGITS[pair];
+		start[1] = Fiber_Profiler_Buffer_DIGITS[pair + 1];
+	} else {
+		*--start = (char)('0' + value);
+	}
+	
+	return start;
+}
+
+void Fiber_Profiler_Buffer_append_unsigned(struct Fiber_Profiler_Buffer *buffer, uint64_t value)
+{
+	char digits[20];
+	char *end = digits + sizeof(digits);
+	char *start = Fiber_Profiler_Buffer_format_unsigned(end, value);
+	
+	Fiber_Profiler_Buffer_append(buffer, start, end - start);
+}
+
+void Fiber_Profiler_Buffer_append_signed(struct Fiber_Profiler_Buffer *buffer, int64_t value)
+{
+	if (value < 0) {
+		Fiber_Profiler_Buffer_append_character(buffer, '-');
+		Fiber_Profiler_Buffer_append_unsigned(buffer, (uint64_t)0 - (uint64_t)value);
+	} else {
+		Fiber_Profiler_Buffer_append_unsigned(buffer, (uint64_t)value);
+	}
+}
+
+// Append `value` zero padded to `width` digits.
+static void Fiber_Profiler_Buffer_append_padded(struct Fiber_Profiler_Buffer *buffer, uint64_t value, unsigned width)
+{
+	char digits[20];
+	char *end = digits + sizeof(digits);
+	char *start = Fiber_Profiler_Buffer_format_unsigned(end, value);
+	
+	while ((unsigned)(end - start) < width) {
+		*--start = '0';
+	}
+	
+	Fiber_Profiler_Buffer_append(buffer, start, end - start);
+}
+
+// Numbers which can't be formatted as a scaled integer, including infinities and NaN, are rare enough that they can go through `snprintf`:
+static void Fiber_Profiler_Buffer_append_format(struct Fiber_Profiler_Buffer *buffer, const char *format, unsigned digits, double value)
+{
+	char string[64];
+	int length = snprintf(string, sizeof(string), format, (int)digits, value);
+	
+	if (length > 0) {
+		Fiber_Profiler_Buffer_append(buffer, string, (size_t)length < sizeof(string) ? (size_t)length : sizeof(string) - 1);
+	}
+}
+
+void Fiber_Profiler_Buffer_append_fixed(struct Fiber_Profiler_Buffer *buffer, double value, unsigned digits)
+{
+	if (digits > 9) digits = 9;
+	
+	uint64_t scale = Fiber_Profiler_Buffer_POWERS[digits];
+	double magnitude = fabs(value) * scale;
+	
+	// Beyond this the scaled value would not fit in 64 bits:
+	if (!(magnitude < 1e18)) {
+		Fiber_Profiler_Buffer_append_format(buffer, "%0.*f", digits, value);
+		return;
+	}
+	
+	double whole = floor(magnitude);
+	double fraction = magnitude - whole;
+	
+	// Scaling may itself have rounded the value, so when it is within rounding error of halfway, only the exact value can tell which way it rounds (and how exact ties are rounded depends on the C library):
+	if (fabs(fraction - 0.5) <= magnitude * DBL_EPSILON) {
+		Fiber_Profiler_Buffer_append_format(buffer, "%0.*f", digits, value);
+		return;
+	}
+	
+	uint64_t scaled = (uint64_t)whole + (fraction > 0.5);
+	
+	if (value < 0) {
+		Fiber_Profiler_Buffer_append_character(buffer, '-');
+	}
+	
+	Fiber_Profiler_Buffer_append_unsigned(buffer, scaled / scale);
+	
+	if (digits) {
+		Fiber_Profiler_Buffer_append_character(buffer, '.');
+		Fiber_Profiler_Buffer_append_padded(buffer, scaled % scale, digits);
+	}
+}
+
+void Fiber_Profiler_Buffer_append_significant(struct Fiber_Profiler_Buffer *buffer, double value, unsigned digits)
+{
+	if (digits == 0) digits = 1;
+	if (digits > 6) digits = 6;
+	
+	if (value == 0) {
+		Fiber_Profiler_Buffer_append_character(buffer, '0');
+		return;
+	}
+	
+	if (!isfinite(value)) {
+		Fiber_Profiler_Buffer_append_format(buffer, "%.*g", digits, value);
+		return;
+	}
+	
+	double magnitude = fabs(value);
+	int exponent = (int)floor(log10(magnitude));
+	
+	// Round to the given number of significant digits, which may carry into the next power of ten:
+	uint64_t scaled = (uint64_t)(magnitude * pow(10, (int)digits - 1 - exponent) + 0.5);
+	
+	if (scaled >= Fiber_Profiler_Buffer_POWERS[digits]) {
+		scaled /= 10;
+		exponent += 1;
+	} else if (scaled < Fiber_Profiler_Buffer_POWERS[digits - 1]) {
+		// `log10` may round up for values just below a power of ten:
+		scaled = (uint64_t)(magnitude * pow(10, (int)digits - exponent) + 0.5);
+		exponent -= 1;
+	}
+	
+	// Trailing zeros are removed, as `%g` does:
+	unsigned precision = digits - 1;
+	while (precision > 0 && scaled % 10 == 0) {
+		scaled /= 10;
+		precision -= 1;
+	}
+	
+	if (value < 0) {
+		Fiber_Profiler_Buffer_append_character(buffer, '-');
+	}
+	
+	if (exponent < -4 || exponent >= (int)digits) {
+		// Scientific notation, with a single digit before the decimal point:
+		uint64_t scale = Fiber_Profiler_Buffer_POWERS[precision];
+		
+		Fiber_Profiler_Buffer_append_unsigned(buffer, scaled / scale);
+		
+		if (precision) {
+			Fiber_Profiler_Buffer_append_character(buffer, '.');
+			Fiber_Profiler_Buffer_append_padded(buffer, scaled % scale, precision);
+		}
+		
+		Fiber_Profiler_Buffer_append_character(buffer, 'e');
+		Fiber_Profiler_Buffer_append_character(buffer, exponent < 0 ? '-' : '+');
+		Fiber_Profiler_Buffer_append_padded(buffer, exponent < 0 ? -exponent : exponent, 2);
+	} else {
+		// The number of decimal places, once trailing zeros are removed:
+		int decimals = (int)precision - exponent;
+		
+		if (decimals <= 0) {
+			Fiber_Profiler_Buffer_append_unsigned(buffer, scaled * Fiber_Profiler_Buffer_POWERS[-decimals]);
+		} else {
+			uint64_t scale = Fiber_Profiler_Buffer_POWERS[decimals];
+			
+			Fiber_Profiler_Buffer_append_unsigned(buffer, scaled / scale);
+			Fiber_Profiler_Buffer_append_character(buffer, '.');
+			Fiber_Profiler_Buffer_append_padded(buffer, scaled % scale, decimals);
+		}
+	}
+}
+
+// The length of the valid UTF-8 sequence at the start of the string, or 0 if it is not valid.
+static size_t Fiber_Profiler_Buffer_utf8_length(const unsigned char *string, size_t length)
+{
+	unsigned char lead = string[0];
+	size_t size;
+	unsigned char minimum = 0x80, maximum = 0xBF;
+	
+	if (lead >= 0xC2 && lead <= 0xDF) {
+		size = 2;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		size = 3;
+		
+		// Overlong encodings and surrogates are not valid:
+		if (lead == 0xE0) minimum = 0xA0;
+		if (lead == 0xED) maximum = 0x9F;
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		size = 4;
+		
+		// Overlong encodings and code points above U+10FFFF are not valid:
+		if (lead == 0xF0) minimum = 0x90;
+		if (lead == 0xF4) maximum = 0x8F;
+	} else {
+		return 0;
+	}
+	
+	if (size > length) return 0;
+	
+	if (string[1] < minimum || string[1] > maximum) return 0;
+	
+	for (size_t i = 2; i < size; i += 1) {
+		if (string[i] < 0x80 || string[i] > 0xBF) return 0;
+	}
+	
+	return size;
+}
+
+void Fiber_Profiler_Buffer_append_json_string(struct Fiber_Profiler_Buffer *buffer, const char *string, size_t length)
+{
+	static const char hexadecimal[] = "0123456789abcdef";
+	
+	if (string == NULL) {
+		Fiber_Profiler_Buffer_append(buffer, "\"(null)\"", 8);
+		return;
+	}
+	
+	const unsigned char *bytes = (const unsigned char *)string;
+	
+	Fiber_Profiler_Buffer_append_character(buffer, '"');
+	
+	size_t start = 0, i = 0;
+	
+	while (i < length) {
+		unsigned char character = bytes[i];
+		
+		// Most characters don't need escaping, so they are appended in runs:
+		if (character >= 0x20 && character < 0x80 && character != '"' && character != '\\') {
+			i += 1;
+			continue;
+		}
+		
+		if (character >= 0x80) {
+			size_t size = Fiber_Profiler_Buffer_utf8_length(bytes + i, length - i);
+			
+			if (size) {
+				i += size;
+				continue;
+			}
+		}
+		
+		Fiber_Profiler_Buffer_append(buffer, string + start, i - start);
+		
+		if (character == '"' || character == '\\') {
+			char escape[2] = {'\\', (char)character};
+			Fiber_Profiler_Buffer_append(buffer, escape, 2);
+		} else if (character < 0x20) {
+			char escape[6] = {'\\', 'u', '0', '0', hexadecimal[character >> 4], hexadecimal[character & 0xF]};
+			Fiber_Profiler_Buffer_append(buffer, escape, 6);
+		} else {
+			// The replacement character:
+			Fiber_Profiler_Buffer_append(buffer, "\xEF\xBF\xBD", 3);
+		}
+		
+		i += 1;
+		start = i;
+	}
+	
+	Fiber_Profiler_Buffer_append(buffer, string + start, i - start);
+	Fiber_Profiler_Buffer_append_character(buffer, '"');
+}
@@ -0,0 +1,89 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Provides a growable byte buffer with fast formatting of integers, fixed point numbers and JSON strings, so that output can be built without going through stdio and written in a single operation.
+
+struct Fiber_Profiler_Buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
+	
+	// Set if the buffer could not be grown, in which case the output is incomplete and should be discarded:
+	int failed;
+};
+
+void Fiber_Profiler_Buffer_initialize(struct Fiber_Profiler_Buffer *buffer);
+void Fiber_Profiler_Buffer_free(struct Fiber_Profiler_Buffer *buffer);
+
+// Discard the contents of the buffer, keeping the memory for reuse.
+static inline void Fiber_Profiler_Buffer_clear(struct Fiber_Profiler_Buffer *buffer)
+{
+	buffer->size = 0;
+	buffer->failed = 0;
+}
+
+// Grow the buffer so that at least `size` more bytes can be appended. Returns 0 on success, or -1 if the buffer could not be grown.
+int Fiber_Profiler_Buffer_grow(struct Fiber_Profiler_Buffer *buffer, size_t size);
+
+// Reserve space for `size` more bytes, returning a pointer to it, or NULL if the buffer could not be grown. The caller must then advance `buffer->size` by the number of bytes it used.
+static inline char *Fiber_Profiler_Buffer_reserve(struct Fiber_Profiler_Buffer *buffer, size_t size)
+{
+	if (buffer->capacity - buffer->size < size) {
+		if (Fiber_Profiler_Buffer_grow(buffer, size) == -1) return NULL;
+	}
+	
+	return buffer->data + buffer->size;
+}
+
+static inline void Fiber_Profiler_Buffer_append(struct Fiber_Profiler_Buffer *buffer, const char *data, size_t size)
+{
+	char *target = Fiber_Profiler_Buffer_reserve(buffer, size);
+	
+	if (target) {
+		memcpy(target, data, size);
+		buffer->size += size;
+	}
+}
+
+static inline void Fiber_Profiler_Buffer_append_character(struct Fiber_Profiler_Buffer *buffer, char character)
+{
+	char *target = Fiber_Profiler_Buffer_reserve(buffer, 1);
+	
+	if (target) {
+		*target = character;
+		buffer->size += 1;
+	}
+}
+
+// Append a string literal, whose length is known at compile time.
+#define Fiber_Profiler_Buffer_append_literal(buffer, literal) Fiber_Profiler_Buffer_append(buffer, literal, sizeof(literal) - 1)
+
+// Append a NUL terminated string. NULL is written as "(null)", as `printf` would.
+static inline void Fiber_Profiler_Buffer_append_string(struct Fiber_Profiler_Buffer *buffer, const char *string)
+{
+	if (string == NULL) string = "(null)";
+	
+	Fiber_Profiler_Buffer_append(buffer, string, strlen(string));
+}
+
+// Append the given byte the given number of times, e.g. for indentation.
+void Fiber_Profiler_Buffer_append_repeated(struct Fiber_Profiler_Buffer *buffer, char character, size_t count);
+
+// Append an integer in decimal.
+void Fiber_Profiler_Buffer_append_unsigned(struct Fiber_Profiler_Buffer *buffer, uint64_t value);
+void Fiber_Profiler_Buffer_append_signed(struct Fiber_Profiler_Buffer *buffer, int64_t value);
+
+// Append a number with the given number of decimal places (at most 9), equivalent to `printf("%0.*f", digits, value)`. Values which are too large, or too close to halfway between two results to round correctly from the scaled value, are formatted using `printf`.
+void Fiber_Profiler_Buffer_append_fixed(struct Fiber_Profiler_Buffer *buffer, double value, unsigned digits);
+
+// Append a number with the given number of significant digits (at most 6), equivalent to `printf("%.*g", digits, value)`.
+void Fiber_Profiler_Buffer_append_significant(struct Fiber_Profiler_Buffer *buffer, double value, unsigned digits);
+
+// Append a quoted JSON string, escaping quotes, backslashes and control characters. Invalid UTF-8 sequences are replaced with U+FFFD, so that the output is always valid JSON. NULL is written as "(null)".
+void Fiber_Profiler_Buffer_append_json_string(struct Fiber_Profiler_Buffer *buffer, const char *string, size_t length);
@@ -6,8 +6,24 @@
 #include "time.h"
 #include "fiber.h"
 #include "deque.h"
+#include "table.h"
+#include "frame.h"
+#include "map.h"
+#include "tree.h"
+#include "writer.h"
+#include "timer.h"
+#include "histogram.h"
+#include "statistics.h"
+#include "buffer.h"
+#include "compression.h"
+#include "reservoir.h"
+#include "latency.h"
+#include "line.h"
 
 #include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
 #include <ruby/io.h>
 #include <ruby/debug.h>
 #include <stdio.h>
@@ -21,52 +37,97 @@ int Fiber_Profiler_capture_p = 0;
 double Fiber_Profiler_Capture_stall_threshold = 0.01;
 double Fiber_Profiler_Capture_filter_threshold = 0.001;
 int Fiber_Profiler_Capture_track_calls = 1;
+int Fiber_Profiler_Capture_track_allocations = 0;
+int Fiber_Profiler_Capture_track_latency = 0;
+int Fiber_Profiler_Capture_restart_after_fork = 0;
 double Fiber_Profiler_Capture_sample_rate = 1;
+size_t Fiber_Profiler_Capture_buffer_capacity = 0;
+const char *Fiber_Profiler_Capture_format = NULL;
+const char *Fiber_Profiler_Capture_line_paths = NULL;
+double Fiber_Profiler_Capture_flush_interval = 0;
+size_t Fiber_Profiler_Capture_max_calls = 0;
+size_t Fiber_Profiler_Capture_histograms = 0;
+size_t Fiber_Profiler_Capture_retain_stalls = 0;
+double Fiber_Profiler_Capture_sample_interval = 0;
+double Fiber_Profiler_Capture_overhead_budget = 0;
+double Fiber_Profiler_Capture_arm_threshold = 0;
+enum Fiber_Profiler_Time_Clock Fiber_Profiler_Capture_clock = Fiber_Profiler_Time_CLOCK_MONOTONIC;
+enum Fiber_Profiler_Compression Fiber_Profiler_Capture_output_compression = Fiber_Profiler_Compression_NONE;
 
 VALUE Fiber_Profiler_Capture = Qnil;
 
+// Indicates that a call has no parent, or that there is no current call.
+enum {
+	Fiber_Profiler_Capture_Call_NONE = UINT32_MAX,
+};
+
+// A call in the call log. Calls are packed into 40 bytes so that long samples stay cache friendly: everything which is not needed while recording (the class, names and location) is held in the frame table, and calls refer to each other by their index in the call log.
 struct Fiber_Profiler_Capture_Call {
-	struct timespec enter_time;
-	double duration;
+	// The time the call started, in ticks of the capture's clock:
+	uint64_t enter_time;
 	
-	int nesting;
-	size_t children;
-	size_t filtered;
+	// The duration in seconds, and the total duration of all direct children, including filtered children, which is accumulated as each child finishes. Single precision is enough for the printed resolution:
+	float duration;
+	float child_duration;
 	
-	rb_event_flag_t event_flag;
-	ID id;
+	int32_t nesting;
+	uint32_t children;
+	uint32_t filtered;
 	
-	VALUE klass;
-	const char *path;
-	int line;
+	// The number of objects allocated while this was the innermost call, including by filtered children:
+	uint32_t allocations;
 	
-	struct Fiber_Profiler_Capture_Call *parent;
+	// The index of the resolved frame in `capture->frames`, and the event which started the call, as the position of its bit plus one (so that 0 is no event):
+	uint32_t frame : 24;
+	uint32_t event : 8;
+	
+	// The index of the parent call in `capture->calls`:
+	uint32_t parent;
 };
 
-struct Fiber_Profiler_Stream {
-	FILE *file;
-	char *buffer;
-	size_t size;
+// The garbage collection which happened during a sample. Collections are counted and timed using the internal events of the garbage collector, as `GC.stat` is too expensive to query on every switch, and only has millisecond resolution.
+struct Fiber_Profiler_Capture_GC {
+	// The number of garbage collections which started:
+	size_t count;
+	
+	// The time spent marking and sweeping, in seconds:
+	double mark_time;
+	double sweep_time;
+	
+	// The number of objects allocated, only if allocations are tracked. While the sample runs, this is the number of objects allocated before it began:
+	size_t allocations;
+	
+	// Whether the current garbage collection is marking, and when the current step of the garbage collector (or the part of it in the current phase) started, or 0 outside of a step. A collection can span several samples, so these are not reset when a sample begins:
+	int marking;
+	uint64_t step_time;
 };
 
-void Fiber_Profiler_Stream_initialize(struct Fiber_Profiler_Stream *stream) {
-	stream->file = open_memstream(&stream->buffer, &stream->size);
+static VALUE Fiber_Profiler_Capture_GC_total_allocated_objects = Qnil;
+
+static void Fiber_Profiler_Capture_GC_initialize(struct Fiber_Profiler_Capture_GC *gc) {
+	gc->count = 0;
+	gc->mark_time = 0;
+	gc->sweep_time = 0;
+	gc->allocations = 0;
+	gc->marking = 0;
+	gc->step_time = 0;
 }
 
-void Fiber_Profiler_Stream_free(struct Fiber_Profiler_Stream *stream) {
-	if (stream->file) {
-		fclose(stream->file);
-		stream->file = NULL;
-	}
-	
-	if (stream->buffer) {
-		free(stream->buffer);
-		stream->buffer = NULL;
+static void Fiber_Profiler_Capture_GC_begin(struct Fiber_Profiler_Capture_GC *gc, int track_allocations) {
+	gc->count = 0;
+	gc->mark_time = 0;
+	gc->sweep_time = 0;
+	gc->allocations = track_allocations ? rb_gc_stat(Fiber_Profiler_Capture_GC_total_allocated_objects) : 0;
+}
+
+static void Fiber_Profiler_Capture_GC_end(struct Fiber_Profiler_Capture_GC *gc, int track_allocations) {
+	if (track_allocations) {
+		gc->allocations = rb_gc_stat(Fiber_Profiler_Capture_GC_total_allocated_objects) - gc->allocations;
 	}
 }
 
 struct Fiber_Profiler_Capture;
-typedef void(*Fiber_Profiler_Stream_Print)(struct Fiber_Profiler_Capture*, FILE* restrict, double duration);
+typedef void(*Fiber_Profiler_Capture_Print)(struct Fiber_Profiler_Capture*, struct Fiber_Profiler_Buffer*, double duration);
 
 struct Fiber_Profiler_Capture {
 	// The threshold in seconds, which determines when a fiber is considered to have stalled the event loop.
@@ -75,44 +136,143 @@ struct Fiber_Profiler_Capture {
 	// Whether or not to track calls.
 	int track_calls;
 	
+	// When tracking calls, whether to count the objects allocated by each call.
+	int track_allocations;
+	
+	// Whether to measure how long fibers wait to run once they are ready, and the measurements.
+	int track_latency;
+	struct Fiber_Profiler_Latency latency;
+	
+	// When tracking calls, how long in seconds a sample must run before calls are tracked, or 0 to track calls from the start of every sample. Samples which finish sooner, which is most of them, do not pay for tracking calls at all.
+	double arm_threshold;
+	
 	// The sample rate of the capture, as a fraction of 1.0, which controls how often the profiler will sample between fiber context switches.
 	double sample_rate;
 	
+	// The maximum fraction of wall time to spend profiling, or 0 to always use the configured sample rate. When set, the sample rate is adjusted periodically to stay within this budget, up to the configured sample rate.
+	double overhead_budget;
+	
+	// The sample rate currently in use, which is the configured sample rate unless it is being adjusted to meet the overhead budget.
+	double effective_sample_rate;
+	
+	// The fraction of wall time spent profiling, as measured over the last adjustment interval.
+	double overhead;
+	
+	// The time spent profiling since the last adjustment, in ticks of the capture's clock, and the time of the last adjustment.
+	uint64_t overhead_ticks;
+	uint64_t adjust_time;
+	
+	// The state of the random number generator used for sampling.
+	uint64_t random;
+	
 	// Calls that are shorter than this filter threshold will be ignored.
 	double filter_threshold;
 	
+	// When not tracking calls, the interval in seconds at which to sample the call stack of a fiber while it runs, or 0 to disable sampling.
+	double sample_interval;
+	
+	// The timer which interrupts the profiled thread to take each stack sample, or to start tracking calls once the arm threshold is reached.
+	struct Fiber_Profiler_Timer timer;
+	
+	// The time of the last stack sample, or the start of the sample if there is none.
+	uint64_t stack_time;
+	
+	// The maximum number of calls recorded per sample, or 0 for no limit. The calls are preallocated when the capture is initialized, so that memory usage is bounded.
+	size_t max_calls;
+	
 	// The output object to write to.
 	VALUE output;
 	
-	// The stream print function to use.
-	Fiber_Profiler_Stream_Print print;
+	// Whether to restart the capture in a forked child process, rather than stopping it.
+	int restart_after_fork;
 	
-	// The stream buffer used for printing.
-	struct Fiber_Profiler_Stream stream;
+	// The print function to use.
+	Fiber_Profiler_Capture_Print print;
 	
-	// How many fiber context switches have been encountered. Not all of them will be sampled, based on the sample rate.
-	size_t switches;
-
-	// How many samples have been taken, not all of them will be stalls, based on the stall threshold.
-	size_t samples;
+	// Whether to merge every sample into `tree` rather than printing each stall. The tree is printed periodically according to the flush interval, and when the capture is stopped.
+	int aggregate;
+	
+	// The interval in seconds between printing the aggregated call tree, or 0 to only print it when the capture is stopped.
+	double flush_interval;
+	
+	// The time the aggregated call tree was last printed.
+	uint64_t flush_time;
+	
+	// For the binary format, the number of strings from `strings` which have been written to the output since the capture was started. Zero indicates that the header has not been written yet.
+	size_t strings_emitted;
+	
+	// Identifies the binary stream written by this capture since it was last started. Captures on different threads may share an output, so the string table of each stream is kept separately by the reader:
+	uint64_t stream_id;
+	
+	// The value of `strings_emitted` once the report being printed has been written. A report may be dropped, so the strings it includes are only counted as written once it has been:
+	size_t strings_printed;
+	
+	// The value of `strings_emitted` before anything in `preamble` was printed, so that the strings can be written again if the preamble is dropped:
+	size_t preamble_emitted;
 	
-	// The number of stalls encountered and printed.
-	size_t stalls;
+	// The buffer used for printing, which is written in a single operation once each report is complete.
+	struct Fiber_Profiler_Buffer buffer;
+	
+	// When retaining only the worst stalls, the position in the buffer at which the report of the stall itself begins. Anything before it (the binary header and strings) is needed by every later report, so it is kept in `preamble` whether or not the stall is retained.
+	size_t report_offset;
+	struct Fiber_Profiler_Buffer preamble;
+	
+	// The worst stalls since the last flush, if the `retain_stalls:` option is set, which are written when the capture is flushed rather than as they happen.
+	struct Fiber_Profiler_Reservoir reservoir;
+	
+	// The compression applied to each report before it is written, and the buffer the compressed report is written to.
+	struct Fiber_Profiler_Compressor compressor;
+	struct Fiber_Profiler_Buffer compressed;
+	
+	// The capacity of the background writer's buffer in bytes, or 0 to write synchronously.
+	size_t buffer_capacity;
+	
+	// The background writer, which is only used if the output has a file descriptor and the buffer capacity is non-zero. It is shared with any other captures writing to the same output, and reports which its thread fails to write are counted as dropped by whichever of them next writes or stops.
+	struct Fiber_Profiler_Writer *writer;
+	
+	// The counters, including the number of switches, samples and stalls. These point to `statistics_buffer`, unless they are memory mapped from the file given by the `statistics_path:` option, so that they can be read by another process.
+	struct Fiber_Profiler_Statistics *statistics;
+	struct Fiber_Profiler_Statistics statistics_buffer;
 	
 	// Whether or not the profiler is currently running.
 	int running;
 	
+	// If the capture was started by `burst`, the duration in seconds after which it stops itself, or 0.
+	double burst_duration;
+	
+	// Interrupts the thread once the burst duration has elapsed, so that the burst stops even if no fiber switches:
+	struct Fiber_Profiler_Timer burst_timer;
+	
 	// The thread being profiled.
 	VALUE thread;
 	
+	// The native identifier of the thread being profiled, which is included in every stall report so that reports from different threads can be told apart.
+	uint64_t thread_id;
+	
+	// The garbage collection which happened during the current sample, so that stalls caused by the garbage collector can be told apart from stalls caused by code.
+	struct Fiber_Profiler_Capture_GC gc;
+	
+	// The fiber being sampled, recorded when the sample begins. Its object id and annotation are only looked up if the sample is printed.
+	VALUE fiber;
+	
+	// While printing a sample, the fiber's object id and annotation (a String or nil). The annotation is only borrowed for the duration of the print, and is not marked:
+	uint64_t fiber_id;
+	VALUE annotation;
+	
 	// Whether or not to capture call data.
 	int capture;
 	
+	// Whether the call tracking event hooks are installed. They are only removed between samples when not every switch is sampled, as installing and removing them is expensive.
+	int hooked;
+	
+	// The clock used for all timestamps, which are stored in ticks of this clock.
+	enum Fiber_Profiler_Time_Clock clock;
+	
 	// The start time of the profile.
-	struct timespec start_time;
+	uint64_t start_time;
 	
 	// The time of the last fiber switch that was sampled.
-	struct timespec switch_time;
+	uint64_t switch_time;
 	
 	// The depth of the call stack (can be negative).
 	int nesting;
@@ -120,38 +280,108 @@ struct Fiber_Profiler_Capture {
 	// The minimum nesting level encountered during the profiling session.
 	int nesting_minimum;
 	
-	// The current call frame.
-	struct Fiber_Profiler_Capture_Call *current;
+	// The depth of the calls which are not being recorded because the call log is full.
+	int truncated_depth;
+	
+	// The index of the current call in the call log, or `Fiber_Profiler_Capture_Call_NONE`.
+	uint32_t current;
 	
 	// The call recorded during the profiling session.
 	struct Fiber_Profiler_Deque calls;
+	
+	// The interned source paths and names of all calls, which persists between samples so that resetting a sample does not need to free anything.
+	struct Fiber_Profiler_Table strings;
+	
+	// The resolved frames of all calls, which persists between samples so that repeated calls to the same method only need to be resolved once.
+	struct Fiber_Profiler_Frame_Table frames;
+	
+	// A cache of class names, from the class to the index of its name in the string table. Classes may move during compaction, so this cache is cleared when that happens.
+	struct Fiber_Profiler_Map class_names;
+	
+	// The aggregated call tree, where each node is a unique call path of frames.
+	struct Fiber_Profiler_Tree tree;
+	
+	// When tracking calls, a histogram of the durations of every finished call, keyed by frame, whether or not the sample was a stall. The maximum number of frames is given by the `histograms:` option, and is 0 (disabled) by default.
+	struct Fiber_Profiler_Histogram_Table histograms;
+	
+	// The stacks sampled during the current sample, merged into a tree where the duration of each node is the time attributed to the stack samples which included it.
+	struct Fiber_Profiler_Tree stacks;
+	
+	// The interned paths of the files given by the `line_paths:` option, and the time spent on each of their lines. Line events in other files are ignored, so no lines are measured unless this is set.
+	struct Fiber_Profiler_Map line_paths;
+	struct Fiber_Profiler_Line_Table lines;
+	
+	// Whether the line event hook is installed, which is independent of the call tracking hooks.
+	int lines_hooked;
+	
+	// The path of the most recent line event, as returned by `rb_sourcefile`, and its interned index if it is one of the `line_paths`, or `Fiber_Profiler_Table_NULL` otherwise. Consecutive line events are usually in the same file, so this avoids hashing the path each time. The path is owned by the VM and may be freed by garbage collection, so the cache is invalidated after each collection step:
+	const char *line_source;
+	uint32_t line_source_path;
+	
+	// The line currently running (see `Fiber_Profiler_Line_key`) or 0, the time it started, and the depth of the frame it belongs to, relative to `line_nesting`, the depth of the current frame:
+	uint64_t line;
+	uint64_t line_time;
+	int line_depth;
+	int line_nesting;
 };
 
 void Fiber_Profiler_Capture_Call_initialize(void *element) {
 	struct Fiber_Profiler_Capture_Call *call = element;
 	
-	call->enter_time.tv_sec = 0;
-	call->enter_time.tv_nsec = 0;
+	call->enter_time = 0;
 	call->duration = 0;
+	call->child_duration = 0;
 	
 	call->nesting = 0;
 	call->children = 0;
 	call->filtered = 0;
+	call->allocations = 0;
 	
-	call->event_flag = 0;
-	call->id = 0;
+	call->event = 0;
+	call->frame = Fiber_Profiler_Frame_UNKNOWN;
+	call->parent = Fiber_Profiler_Capture_Call_NONE;
+}
+
+static inline rb_event_flag_t Fiber_Profiler_Capture_Call_event_flag(const struct Fiber_Profiler_Capture_Call *call) {
+	return call->event ? (rb_event_flag_t)1 << (call->event - 1) : 0;
+}
+
+// Every event is a single flag, so only its position needs to be stored:
+static inline void Fiber_Profiler_Capture_Call_set_event_flag(struct Fiber_Profiler_Capture_Call *call, rb_event_flag_t event_flag) {
+	call->event = event_flag ? __builtin_ctz(event_flag) + 1 : 0;
+}
+
+static inline struct Fiber_Profiler_Capture_Call *Fiber_Profiler_Capture_Call_get(struct Fiber_Profiler_Capture *capture, uint32_t index) {
+	if (index == Fiber_Profiler_Capture_Call_NONE) return NULL;
 	
-	call->path = NULL;
-	call->line = 0;
+	return Fiber_Profiler_Deque_get(&capture->calls, index);
 }
 
-void Fiber_Profiler_Capture_Call_free(void *element) {
-	struct Fiber_Profiler_Capture_Call *call = element;
+static inline struct Fiber_Profiler_Capture_Call *Fiber_Profiler_Capture_Call_parent(struct Fiber_Profiler_Capture *capture, const struct Fiber_Profiler_Capture_Call *call) {
+	return Fiber_Profiler_Capture_Call_get(capture, call->parent);
+}
+
+static inline struct Fiber_Profiler_Capture_Call *Fiber_Profiler_Capture_current(struct Fiber_Profiler_Capture *capture) {
+	return Fiber_Profiler_Capture_Call_get(capture, capture->current);
+}
+
+// Add a call to the end of the call log, as a child of the current call, returning NULL if it could not be allocated.
+static struct Fiber_Profiler_Capture_Call *Fiber_Profiler_Capture_Call_push(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Deque_push(&capture->calls);
+	if (call == NULL) return NULL;
+	
+	capture->statistics->calls += 1;
+	
+	call->parent = capture->current;
 	
-	if (call->path) {
-		free((void*)call->path);
-		call->path = NULL;
+	struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_current(capture);
+	if (parent) {
+		parent->children += 1;
 	}
+	
+	capture->current = (uint32_t)(capture->calls.size - 1);
+	
+	return call;
 }
 
 static void Fiber_Profiler_Capture_mark(void *ptr) {
@@ -159,11 +389,11 @@ static void Fiber_Profiler_Capture_mark(void *ptr) {
 	
 	rb_gc_mark_movable(capture->thread);
 	rb_gc_mark_movable(capture->output);
+	rb_gc_mark_movable(capture->fiber);
 	
-	// If `klass` is stored as a VALUE in calls, we need to mark them here:
-	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
-		rb_gc_mark_movable(call->klass);
-	}
+	// Calls only refer to frames, so we only need to mark the frames, not every call:
+	Fiber_Profiler_Frame_Table_mark(&capture->frames);
+	Fiber_Profiler_Latency_mark(&capture->latency);
 }
 
 static void Fiber_Profiler_Capture_compact(void *ptr) {
@@ -171,25 +401,52 @@ static void Fiber_Profiler_Capture_compact(void *ptr) {
 	
 	capture->thread = rb_gc_location(capture->thread);
 	capture->output = rb_gc_location(capture->output);
+	capture->fiber = rb_gc_location(capture->fiber);
 	
-	// If `klass` is stored as a VALUE in calls, we need to update their locations here:
-	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
-		call->klass = rb_gc_location(call->klass);
-	}
+	Fiber_Profiler_Frame_Table_compact(&capture->frames);
+	Fiber_Profiler_Latency_compact(&capture->latency);
+	
+	// The keys may have moved, but the names themselves are still valid:
+	Fiber_Profiler_Map_clear(&capture->class_names);
 }
 
+static void Fiber_Profiler_Capture_timer_delete(struct Fiber_Profiler_Timer *timer);
+
 static void Fiber_Profiler_Capture_free(void *ptr) {
 	struct Fiber_Profiler_Capture *capture = (struct Fiber_Profiler_Capture*)ptr;
 	
-	Fiber_Profiler_Stream_free(&capture->stream);
+	// Waiting for the writer here would block garbage collection, so it finishes writing in the background:
+	if (capture->writer) {
+		Fiber_Profiler_Writer_release_detached(capture->writer);
+	}
+	
+	Fiber_Profiler_Buffer_free(&capture->buffer);
+	Fiber_Profiler_Compressor_free(&capture->compressor);
+	Fiber_Profiler_Buffer_free(&capture->compressed);
+	Fiber_Profiler_Buffer_free(&capture->preamble);
+	Fiber_Profiler_Reservoir_free(&capture->reservoir);
 	Fiber_Profiler_Deque_free(&capture->calls);
+	Fiber_Profiler_Table_free(&capture->strings);
+	Fiber_Profiler_Frame_Table_free(&capture->frames);
+	Fiber_Profiler_Histogram_Table_free(&capture->histograms);
+	Fiber_Profiler_Map_free(&capture->line_paths);
+	Fiber_Profiler_Line_Table_free(&capture->lines);
+	
+	if (capture->statistics != &capture->statistics_buffer) {
+		Fiber_Profiler_Statistics_unmap(capture->statistics);
+	}
+	Fiber_Profiler_Map_free(&capture->class_names);
+	Fiber_Profiler_Tree_free(&capture->tree);
+	Fiber_Profiler_Tree_free(&capture->stacks);
+	Fiber_Profiler_Capture_timer_delete(&capture->timer);
+	Fiber_Profiler_Capture_timer_delete(&capture->burst_timer);
 	
 	free(capture);
 }
 
 static size_t Fiber_Profiler_Capture_memsize(const void *ptr) {
 	const struct Fiber_Profiler_Capture *capture = (const struct Fiber_Profiler_Capture*)ptr;
-	return sizeof(*capture) + Fiber_Profiler_Deque_memory_size(&capture->calls);
+	return sizeof(*capture) + Fiber_Profiler_Deque_memory_size(&capture->calls) + Fiber_Profiler_Table_memory_size(&capture->strings) + Fiber_Profiler_Frame_Table_memory_size(&capture->frames) + Fiber_Profiler_Map_memory_size(&capture->class_names) + Fiber_Profiler_Tree_memory_size(&capture->tree) + Fiber_Profiler_Tree_memory_size(&capture->stacks) + Fiber_Profiler_Histogram_Table_memory_size(&capture->histograms) + Fiber_Profiler_Reservoir_memory_size(&capture->reservoir) + Fiber_Profiler_Map_memory_size(&capture->line_paths) + Fiber_Profiler_Line_Table_memory_size(&capture->lines);
 }
 
 const rb_data_type_t Fiber_Profiler_Capture_Type = {
@@ -218,8 +475,10 @@ int IO_istty(VALUE io) {
 	return 0;
 }
 
-void Fiber_Profiler_Capture_print_tty(struct Fiber_Profiler_Capture *capture, FILE *restrict stream, double duration);
-void Fiber_Profiler_Capture_print_json(struct Fiber_Profiler_Capture *capture, FILE *restrict stream, double duration);
+void Fiber_Profiler_Capture_print_tty(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration);
+void Fiber_Profiler_Capture_print_json(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration);
+void Fiber_Profiler_Capture_print_binary(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration);
+void Fiber_Profiler_Capture_print_folded(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration);
 
 static void Fiber_Profiler_Capture_output_set(struct Fiber_Profiler_Capture *capture, VALUE output) {
 	capture->output = output;
@@ -231,48 +490,190 @@ static void Fiber_Profiler_Capture_output_set(struct Fiber_Profiler_Capture *cap
 	}
 }
 
+static void Fiber_Profiler_Capture_format_set(struct Fiber_Profiler_Capture *capture, const char *format) {
+	capture->aggregate = 0;
+	
+	if (strcmp(format, "tty") == 0) {
+		capture->print = &Fiber_Profiler_Capture_print_tty;
+	} else if (strcmp(format, "json") == 0) {
+		capture->print = &Fiber_Profiler_Capture_print_json;
+	} else if (strcmp(format, "binary") == 0) {
+		capture->print = &Fiber_Profiler_Capture_print_binary;
+	} else if (strcmp(format, "folded") == 0) {
+		capture->print = &Fiber_Profiler_Capture_print_folded;
+		capture->aggregate = 1;
+	} else {
+		rb_raise(rb_eArgError, "Unknown format: %s", format);
+	}
+}
+
+// The maximum number of unique call paths in the aggregated call tree, which bounds its memory usage. Any further call paths are merged into their nearest ancestor.
+static const size_t Fiber_Profiler_Capture_TREE_MAXIMUM = 1 << 16;
+
+// The maximum number of lines measured by the `line_paths:` option, which bounds its memory usage. Any further lines are ignored.
+static const size_t Fiber_Profiler_Capture_LINES_MAXIMUM = 1024 * 16;
+
+// The maximum number of unique call paths sampled within a single sample, and the maximum depth of each stack sample:
+static const size_t Fiber_Profiler_Capture_STACKS_MAXIMUM = 1 << 12;
+enum {Fiber_Profiler_Capture_STACK_DEPTH = 128};
+
+static void Fiber_Profiler_Capture_output_compression_set(struct Fiber_Profiler_Capture *capture, VALUE value) {
+	int compression = Fiber_Profiler_Compression_NONE;
+	
+	if (RB_TEST(value)) {
+		VALUE name = rb_sym2str(value);
+		compression = Fiber_Profiler_Compression_parse(StringValueCStr(name));
+		
+		if (compression < 0) {
+			rb_raise(rb_eArgError, "Unknown output compression: %s", StringValueCStr(name));
+		}
+	}
+	
+	capture->compressor.compression = compression;
+}
+
+static void Fiber_Profiler_Capture_clock_set(struct Fiber_Profiler_Capture *capture, const char *name) {
+	int clock = Fiber_Profiler_Time_clock_parse(name);
+	
+	if (clock < 0) {
+		rb_raise(rb_eArgError, "Unknown clock: %s", name);
+	}
+	
+	// Falls back to the monotonic clock if the requested clock is not available:
+	capture->clock = Fiber_Profiler_Time_clock_initialize(clock);
+}
+
 VALUE Fiber_Profiler_Capture_allocate(VALUE klass) {
 	struct Fiber_Profiler_Capture *capture = ALLOC(struct Fiber_Profiler_Capture);
 	
 	// Initialize the profiler state:
-	Fiber_Profiler_Stream_initialize(&capture->stream);
+	Fiber_Profiler_Buffer_initialize(&capture->buffer);
+	Fiber_Profiler_Compressor_initialize(&capture->compressor, Fiber_Profiler_Capture_output_compression);
+	Fiber_Profiler_Buffer_initialize(&capture->compressed);
+	capture->report_offset = 0;
+	Fiber_Profiler_Buffer_initialize(&capture->preamble);
+	Fiber_Profiler_Reservoir_initialize(&capture->reservoir, Fiber_Profiler_Capture_retain_stalls);
 	capture->output = Qnil;
+	capture->aggregate = 0;
+	capture->flush_interval = Fiber_Profiler_Capture_flush_interval;
+	capture->strings_emitted = 0;
+	capture->strings_printed = 0;
+	capture->preamble_emitted = 0;
+	capture->stream_id = 0;
 	
-	capture->switches = 0;
-	capture->samples = 0;
-	capture->stalls = 0;
+	capture->buffer_capacity = Fiber_Profiler_Capture_buffer_capacity;
+	capture->writer = NULL;
+	
+	Fiber_Profiler_Statistics_initialize(&capture->statistics_buffer);
+	capture->statistics = &capture->statistics_buffer;
 	
 	capture->running = 0;
+	capture->burst_duration = 0;
 	capture->thread = Qnil;
+	capture->thread_id = 0;
+	Fiber_Profiler_Capture_GC_initialize(&capture->gc);
+	capture->fiber = Qnil;
+	capture->fiber_id = 0;
+	capture->annotation = Qnil;
 	
 	capture->capture = 0;
+	capture->hooked = 0;
 	capture->nesting = 0;
 	capture->nesting_minimum = 0;
-	capture->current = NULL;
+	capture->truncated_depth = 0;
+	capture->current = Fiber_Profiler_Capture_Call_NONE;
 	
 	capture->stall_threshold = Fiber_Profiler_Capture_stall_threshold;
 	capture->filter_threshold = Fiber_Profiler_Capture_filter_threshold;
 	capture->track_calls = Fiber_Profiler_Capture_track_calls;
+	capture->track_allocations = Fiber_Profiler_Capture_track_allocations;
+	capture->track_latency = Fiber_Profiler_Capture_track_latency;
+	capture->restart_after_fork = Fiber_Profiler_Capture_restart_after_fork;
+	Fiber_Profiler_Latency_initialize(&capture->latency);
+	capture->arm_threshold = Fiber_Profiler_Capture_arm_threshold;
 	capture->sample_rate = Fiber_Profiler_Capture_sample_rate;
+	capture->overhead_budget = Fiber_Profiler_Capture_overhead_budget;
+	capture->effective_sample_rate = capture->sample_rate;
+	capture->overhead = 0;
+	capture->overhead_ticks = 0;
+	capture->adjust_time = 0;
+	capture->max_calls = Fiber_Profiler_Capture_max_calls;
+	capture->sample_interval = Fiber_Profiler_Capture_sample_interval;
+	Fiber_Profiler_Timer_initialize(&capture->timer);
+	Fiber_Profiler_Timer_initialize(&capture->burst_timer);
+	capture->clock = Fiber_Profiler_Capture_clock;
 	
 	capture->calls.element_initialize = (void (*)(void*))Fiber_Profiler_Capture_Call_initialize;
-	capture->calls.element_free = (void (*)(void*))Fiber_Profiler_Capture_Call_free;
+	// Calls don't own any memory, so there is nothing to free when the deque is truncated:
+	capture->calls.element_free = NULL;
 	
 	Fiber_Profiler_Deque_initialize(&capture->calls, sizeof(struct Fiber_Profiler_Capture_Call));
 	Fiber_Profiler_Deque_reserve_default(&capture->calls);
 	
+	Fiber_Profiler_Table_initialize(&capture->strings);
+	Fiber_Profiler_Frame_Table_initialize(&capture->frames);
+	Fiber_Profiler_Histogram_Table_initialize(&capture->histograms, Fiber_Profiler_Capture_histograms);
+	Fiber_Profiler_Map_initialize(&capture->class_names);
+	Fiber_Profiler_Tree_initialize(&capture->tree, Fiber_Profiler_Capture_TREE_MAXIMUM);
+	Fiber_Profiler_Tree_initialize(&capture->stacks, Fiber_Profiler_Capture_STACKS_MAXIMUM);
+	
+	Fiber_Profiler_Map_initialize(&capture->line_paths);
+	Fiber_Profiler_Line_Table_initialize(&capture->lines, Fiber_Profiler_Capture_LINES_MAXIMUM);
+	capture->lines_hooked = 0;
+	capture->line = 0;
+	capture->line_time = 0;
+	capture->line_depth = 0;
+	capture->line_nesting = 0;
+	capture->line_source = NULL;
+	capture->line_source_path = Fiber_Profiler_Table_NULL;
+	
 	return TypedData_Wrap_Struct(klass, &Fiber_Profiler_Capture_Type, capture);
 }
 
-ID Fiber_Profiler_Capture_initialize_options[5];
+enum {
+	Fiber_Profiler_Capture_INITIALIZE_OPTIONS = 21,
+};
+
+ID Fiber_Profiler_Capture_initialize_options[Fiber_Profiler_Capture_INITIALIZE_OPTIONS];
+
+static inline int Fiber_Profiler_Capture_lines_p(struct Fiber_Profiler_Capture *capture) {
+	return capture->line_paths.size > 0;
+}
+
+// Add a file whose lines should be measured. The path is compared exactly with the path of each line event, i.e. `__FILE__`.
+static void Fiber_Profiler_Capture_line_path_add(struct Fiber_Profiler_Capture *capture, const char *path, size_t length) {
+	char *string = strndup(path, length);
+	if (string == NULL) rb_raise(rb_eNoMemError, "Could not allocate line path!");
+	
+	uint32_t index = Fiber_Profiler_Table_intern(&capture->strings, string);
+	free(string);
+	
+	if (index == Fiber_Profiler_Table_NULL || Fiber_Profiler_Map_insert(&capture->line_paths, index, 1)) {
+		rb_raise(rb_eNoMemError, "Could not intern line path!");
+	}
+}
+
+// Add the files given by the `FIBER_PROFILER_CAPTURE_LINE_PATHS` environment variable, separated by colons.
+static void Fiber_Profiler_Capture_line_paths_parse(struct Fiber_Profiler_Capture *capture, const char *paths) {
+	while (*paths) {
+		size_t length = strcspn(paths, ":");
+		
+		if (length) {
+			Fiber_Profiler_Capture_line_path_add(capture, paths, length);
+		}
+		
+		paths += length;
+		if (*paths) paths += 1;
+	}
+}
 
 VALUE Fiber_Profiler_Capture_initialize(int argc, VALUE *argv, VALUE self) {
 	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
 	
-	VALUE arguments[5] = {0};
+	VALUE arguments[Fiber_Profiler_Capture_INITIALIZE_OPTIONS] = {0};
 	VALUE options = Qnil;
 	rb_scan_args(argc, argv, ":", &options);
-	rb_get_kwargs(options, Fiber_Profiler_Capture_initialize_options, 0, 5, arguments);
+	rb_get_kwargs(options, Fiber_Profiler_Capture_initialize_options, 0, Fiber_Profiler_Capture_INITIALIZE_OPTIONS, arguments);
 	
 	if (arguments[0] != Qundef) {
 		capture->stall_threshold = NUM2DBL(arguments[0]);
@@ -297,18 +698,119 @@ VALUE Fiber_Profiler_Capture_initialize(int argc, VALUE *argv, VALUE self) {
 		Fiber_Profiler_Capture_output_set(capture, rb_obj_dup(rb_stderr));
 	}
 	
+	if (arguments[5] != Qundef) {
+		capture->buffer_capacity = NUM2SIZET(arguments[5]);
+	}
+	
+	if (arguments[6] != Qundef) {
+		VALUE format = rb_sym2str(arguments[6]);
+		Fiber_Profiler_Capture_format_set(capture, StringValueCStr(format));
+	} else if (Fiber_Profiler_Capture_format) {
+		Fiber_Profiler_Capture_format_set(capture, Fiber_Profiler_Capture_format);
+	}
+	
+	if (arguments[7] != Qundef) {
+		capture->flush_interval = NUM2DBL(arguments[7]);
+	}
+	
+	if (arguments[8] != Qundef) {
+		capture->max_calls = NUM2SIZET(arguments[8]);
+	}
+	
+	if (arguments[9] != Qundef) {
+		VALUE clock = rb_sym2str(arguments[9]);
+		Fiber_Profiler_Capture_clock_set(capture, StringValueCStr(clock));
+	}
+	
+	if (arguments[10] != Qundef) {
+		capture->sample_interval = NUM2DBL(arguments[10]);
+	}
+	
+	if (arguments[11] != Qundef) {
+		capture->overhead_budget = NUM2DBL(arguments[11]);
+	}
+	
+	if (arguments[12] != Qundef) {
+		capture->arm_threshold = NUM2DBL(arguments[12]);
+	}
+	
+	if (arguments[13] != Qundef) {
+		capture->track_allocations = RB_TEST(arguments[13]);
+	}
+	
+	if (arguments[14] != Qundef) {
+		capture->histograms.maximum = NUM2SIZET(arguments[14]);
+	}
+	
+	if (arguments[15] != Qundef && capture->statistics == &capture->statistics_buffer) {
+		VALUE path = rb_get_path(arguments[15]);
+		struct Fiber_Profiler_Statistics *statistics = Fiber_Profiler_Statistics_map(RSTRING_PTR(path));
+		
+		if (statistics == NULL) {
+			rb_sys_fail_str(path);
+		}
+		
+		capture->statistics = statistics;
+	}
+	
+	if (arguments[16] != Qundef) {
+		Fiber_Profiler_Capture_output_compression_set(capture, arguments[16]);
+	}
+	
+	if (arguments[17] != Qundef) {
+		Fiber_Profiler_Reservoir_free(&capture->reservoir);
+		capture->reservoir.capacity = NUM2SIZET(arguments[17]);
+	}
+	
+	if (arguments[18] != Qundef) {
+		capture->track_latency = RB_TEST(arguments[18]);
+	}
+	
+	if (arguments[19] != Qundef) {
+		if (!NIL_P(arguments[19])) {
+			VALUE paths = rb_Array(arguments[19]);
+			
+			for (long i = 0; i < RARRAY_LEN(paths); i += 1) {
+				VALUE path = rb_get_path(RARRAY_AREF(paths, i));
+				Fiber_Profiler_Capture_line_path_add(capture, RSTRING_PTR(path), RSTRING_LEN(path));
+			}
+			
+			RB_GC_GUARD(paths);
+		}
+	} else if (Fiber_Profiler_Capture_line_paths) {
+		Fiber_Profiler_Capture_line_paths_parse(capture, Fiber_Profiler_Capture_line_paths);
+	}
+	
+	if (arguments[20] != Qundef) {
+		capture->restart_after_fork = RB_TEST(arguments[20]);
+	}
+	
+	capture->effective_sample_rate = capture->sample_rate;
+	
+	// Allocate all the calls up front, so that recording a sample never needs to allocate:
+	if (capture->max_calls) {
+		Fiber_Profiler_Deque_reserve(&capture->calls, capture->max_calls);
+	}
+	
 	return self;
 }
 
+// The output shared by all default captures, so that stall reports from different threads are written to the same place, by the same background writer if there is one.
+static VALUE Fiber_Profiler_Capture_default_output = Qnil;
+
 VALUE Fiber_Profiler_Capture_default(VALUE klass) {
 	if (!Fiber_Profiler_capture_p) {
 		return Qnil;
 	}
 	
-	VALUE capture = Fiber_Profiler_Capture_allocate(klass);
-	Fiber_Profiler_Capture_initialize(0, NULL, capture);
+	if (NIL_P(Fiber_Profiler_Capture_default_output)) {
+		Fiber_Profiler_Capture_default_output = rb_obj_dup(rb_stderr);
+	}
+	
+	VALUE options = rb_hash_new();
+	rb_hash_aset(options, ID2SYM(rb_intern("output")), Fiber_Profiler_Capture_default_output);
 	
-	return capture;
+	return rb_class_new_instance_kw(1, &options, klass, RB_PASS_KEYWORDS);
 }
 
 int event_flag_call_p(rb_event_flag_t event_flags) {
@@ -335,117 +837,555 @@ const char *event_flag_name(rb_event_flag_t event_flag) {
 	}
 }
 
-static struct Fiber_Profiler_Capture_Call* Fiber_Profiler_Capture_Call_new(struct Fiber_Profiler_Capture *capture, rb_event_flag_t event_flag, ID id, VALUE klass) {
-	struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Deque_push(&capture->calls);
-	
-	call->event_flag = event_flag;
+// The maximum number of frames to walk when looking for the Ruby frame which invoked a C function:
+enum {Fiber_Profiler_Capture_CALLER_DEPTH = 8};
 
-	call->parent = capture->current;
-	if (call->parent) {
-		call->parent->children += 1;
-	}
+// Find the frame record for the current frame, resolving it only if it has not been seen before.
+static uint32_t Fiber_Profiler_Capture_frame(VALUE self, struct Fiber_Profiler_Capture *capture, ID id, VALUE klass) {
+	struct Fiber_Profiler_Frame_Key key = {.handle = Qnil, .caller = Qnil, .line = 0, .id = id, .klass = klass};
 	
-	capture->current = call;
+	if (rb_profile_frames(0, 1, &key.handle, &key.line) == 0) {
+		return Fiber_Profiler_Frame_UNKNOWN;
+	}
 	
-	call->nesting = capture->nesting;
-
-	if (id) {
-		call->id = id;
-		call->klass = klass;
-	} else {
-		rb_frame_method_id_and_class(&call->id, &call->klass);
+	// C functions don't have a line number, so we distinguish them by the nearest Ruby frame, which is also what `rb_sourcefile` and `rb_sourceline` report. Usually that's the immediate caller, so we only walk further if we need to:
+	for (int depth = 2; key.line == 0 && depth <= Fiber_Profiler_Capture_CALLER_DEPTH; depth *= 2) {
+		VALUE handles[Fiber_Profiler_Capture_CALLER_DEPTH];
+		int lines[Fiber_Profiler_Capture_CALLER_DEPTH];
+		
+		int count = rb_profile_frames(0, depth, handles, lines);
+		
+		for (int i = 1; i < count; i += 1) {
+			if (lines[i]) {
+				key.caller = handles[i];
+				key.line = lines[i];
+				break;
+			}
+		}
+		
+		if (count < depth) break;
 	}
 	
-	const char *path = rb_sourcefile();
-	if (path) {
-		call->path = strdup(path);
+	int created;
+	uint32_t index = Fiber_Profiler_Frame_Table_intern(&capture->frames, &key, &created);
+	
+	if (created) {
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Frame_Table_get(&capture->frames, index);
+		
+		if (id) {
+			frame->id = id;
+			frame->klass = klass;
+		} else {
+			rb_frame_method_id_and_class(&frame->id, &frame->klass);
+		}
+		
+		// Most frames are never printed, so the path is resolved from the handle when it is needed, unless no Ruby frame was found to resolve it from:
+		if (key.line == 0) {
+			frame->path = Fiber_Profiler_Table_intern(&capture->strings, rb_sourcefile());
+		} else {
+			frame->path = Fiber_Profiler_Frame_UNRESOLVED;
+		}
+		
+		frame->line = rb_sourceline();
+		
+		RB_OBJ_WRITTEN(self, Qundef, key.handle);
+		RB_OBJ_WRITTEN(self, Qundef, key.caller);
+		RB_OBJ_WRITTEN(self, Qundef, key.klass);
+		RB_OBJ_WRITTEN(self, Qundef, frame->klass);
 	}
-	call->line = rb_sourceline();
 	
-	return call;
+	return index;
 }
 
-// Finish the call by calculating the duration and filtering it if necessary.
-int Fiber_Profiler_Capture_Call_finish(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call) {
-	// Don't filter calls if we're not running:
-	if (DEBUG_FILTERED) return 0;
+static inline uint64_t Fiber_Profiler_Capture_now(struct Fiber_Profiler_Capture *capture) {
+	return Fiber_Profiler_Time_ticks(capture->clock);
+}
+
+// The duration in seconds between two timestamps of the capture's clock.
+static inline double Fiber_Profiler_Capture_delta(struct Fiber_Profiler_Capture *capture, uint64_t start, uint64_t stop) {
+	return Fiber_Profiler_Time_ticks_delta(capture->clock, start, stop);
+}
+
+// Whether the call log is full, in which case no more calls can be recorded until some of them are filtered or the sample is finished.
+static inline int Fiber_Profiler_Capture_full_p(struct Fiber_Profiler_Capture *capture) {
+	// Once a call is not recorded, none of the calls it makes can be recorded either, as they would have no parent:
+	if (capture->truncated_depth) return 1;
 	
-	if (event_flag_return_p(call->event_flag)) {
-		// We don't filter return statements, as they are always part of the call stack:
-		return 0;
-	}
+	return capture->max_calls && capture->calls.size >= capture->max_calls;
+}
+
+// Record a call that could not be added to the call log. The calls on the stack are kept, and the call is counted by the current call as filtered.
+static void Fiber_Profiler_Capture_truncate(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Capture_Call *current = Fiber_Profiler_Capture_current(capture);
 	
-	if (call->duration < capture->filter_threshold) {
-		// We can only remove calls from the end of the deque, otherwise they might be referenced by other calls:
-		if (call == Fiber_Profiler_Deque_last(&capture->calls)) {
-			if (capture->current == call) {
-				capture->current = call->parent;
-			}
-			
-			if (call->parent) {
-				call->parent->children -= 1;
-				call->parent->filtered += 1;
-				call->parent = NULL;
-			}
-			
-			Fiber_Profiler_Deque_pop(&capture->calls);
-			
-			return 1;
-		}
+	if (capture->truncated_depth == 0 && current) {
+		current->filtered += 1;
 	}
 	
-	return 0;
+	capture->statistics->truncated += 1;
 }
 
-// Whether to highlight a call as expensive. This is purely cosmetic.
-static const double Fiber_Profiler_Capture_Call_EXPENSIVE_THRESHOLD = 0.2;
+// Add a new call to the call log, or return NULL if the call log is full.
+static struct Fiber_Profiler_Capture_Call* Fiber_Profiler_Capture_Call_new(VALUE self, struct Fiber_Profiler_Capture *capture, rb_event_flag_t event_flag, ID id, VALUE klass) {
+	if (Fiber_Profiler_Capture_full_p(capture)) return NULL;
+	
+	struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_Call_push(capture);
+	if (call == NULL) return NULL;
+	
+	Fiber_Profiler_Capture_Call_set_event_flag(call, event_flag);
+	
+	call->nesting = capture->nesting;
+	
+	call->frame = Fiber_Profiler_Capture_frame(self, capture, id, klass);
+	
+	return call;
+}
 
-int Fiber_Profiler_Capture_Call_expensive_p(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call, double duration) {
-	if (call->duration > duration * Fiber_Profiler_Capture_Call_EXPENSIVE_THRESHOLD) {
-		return 1;
+// The value delivered with the signals of the capture's timers, so that they can be told apart from each other and from signals sent by other code:
+enum {
+	Fiber_Profiler_Capture_TIMER_SAMPLE = 1,
+	Fiber_Profiler_Capture_TIMER_BURST = 2,
+};
+
+// The signal used to interrupt the profiled thread when sampling its call stack. A real-time signal is used where available, so that other profilers using `SIGPROF` are not affected. It's offset from `SIGRTMIN` as other code is most likely to use the first few real-time signals:
+static int Fiber_Profiler_Capture_sample_signal_number(void) {
+#ifdef SIGRTMIN
+	return SIGRTMIN + 4;
+#else
+	return SIGPROF;
+#endif
+}
+
+#ifndef RB_THREAD_LOCAL_SPECIFIER
+#define RB_THREAD_LOCAL_SPECIFIER
+#endif
+
+// The capture which is currently sampling this thread, if any. The postponed job runs on the thread that was interrupted, so this is how it finds the capture to sample:
+static RB_THREAD_LOCAL_SPECIFIER VALUE Fiber_Profiler_Capture_sampling = Qnil;
+
+// The capture which is running a burst on this thread, if any, so that the burst job can stop it:
+static RB_THREAD_LOCAL_SPECIFIER VALUE Fiber_Profiler_Capture_bursting = Qnil;
+
+static rb_postponed_job_handle_t Fiber_Profiler_Capture_sample_job = POSTPONED_JOB_HANDLE_INVALID;
+static rb_postponed_job_handle_t Fiber_Profiler_Capture_burst_job = POSTPONED_JOB_HANDLE_INVALID;
+
+// Whether the capture samples call stacks, rather than tracing every call.
+static inline int Fiber_Profiler_Capture_sampling_p(struct Fiber_Profiler_Capture *capture) {
+	return !capture->track_calls && capture->sample_interval > 0;
+}
+
+// Whether the capture only starts tracking calls once a sample has run for the arm threshold.
+static inline int Fiber_Profiler_Capture_deferred_p(struct Fiber_Profiler_Capture *capture) {
+	return capture->track_calls && capture->arm_threshold > 0;
+}
+
+// Resolve the path of the given frame if required, from the handle of the frame or, for C functions, of its nearest Ruby caller.
+static uint32_t Fiber_Profiler_Capture_frame_path(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Frame *frame) {
+	if (frame->path == Fiber_Profiler_Frame_UNRESOLVED) {
+		VALUE path = rb_profile_frame_path(NIL_P(frame->key.caller) ? frame->key.handle : frame->key.caller);
+		
+		frame->path = Fiber_Profiler_Table_intern(&capture->strings, NIL_P(path) ? NULL : RSTRING_PTR(path));
+		
+		RB_GC_GUARD(path);
 	}
 	
-	return 0;
+	return frame->path;
 }
 
-static void Fiber_Profiler_Capture_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(data);
+// Find the frame record for a frame of a sampled stack, resolving it only if it has not been seen before. The line being executed changes from one sample to the next, so Ruby frames are identified by their handle alone and located by their first line. As with traced calls, C functions are located by their nearest Ruby caller, which is the frame sampled before it.
+static uint32_t Fiber_Profiler_Capture_stack_frame(VALUE self, struct Fiber_Profiler_Capture *capture, VALUE handle, int line, uint32_t caller) {
+	struct Fiber_Profiler_Frame_Key key = {.handle = handle, .caller = Qnil, .line = 0, .id = 0, .klass = Qnil};
 	
-	// We don't want to capture data if we're not running:
-	if (!capture->capture) return;
+	// The caller may be moved when a frame is added, so copy what we need first:
+	struct Fiber_Profiler_Frame *caller_frame = Fiber_Profiler_Frame_Table_get(&capture->frames, caller);
+	uint32_t caller_path = Fiber_Profiler_Capture_frame_path(capture, caller_frame);
+	int caller_line = caller_frame->line;
 	
-	if (event_flag_call_p(event_flag)) {
-		struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_Call_new(capture, event_flag, id, klass);
-		
-		capture->nesting += 1;
-		
-		Fiber_Profiler_Time_current(&call->enter_time);
+	if (line == 0) {
+		key.caller = NIL_P(caller_frame->key.caller) ? caller_frame->key.handle : caller_frame->key.caller;
+	}
+	
+	int created;
+	uint32_t index = Fiber_Profiler_Frame_Table_intern(&capture->frames, &key, &created);
+	
+	if (created) {
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Frame_Table_get(&capture->frames, index);
+		
+		VALUE path = rb_profile_frame_path(handle);
+		VALUE first_line = rb_profile_frame_first_lineno(handle);
+		VALUE class_path = rb_profile_frame_classpath(handle);
+		VALUE method_name = rb_profile_frame_method_name(handle);
+		
+		frame->id = 0;
+		frame->klass = Qnil;
+		
+		frame->path = NIL_P(path) ? caller_path : Fiber_Profiler_Table_intern(&capture->strings, RSTRING_PTR(path));
+		frame->line = (line && !NIL_P(first_line)) ? NUM2INT(first_line) : caller_line;
+		
+		// There is no class or method identifier to resolve later, so the names are resolved now:
+		frame->class_name = Fiber_Profiler_Table_intern(&capture->strings, NIL_P(class_path) ? NULL : RSTRING_PTR(class_path));
+		frame->method_name = Fiber_Profiler_Table_intern(&capture->strings, NIL_P(method_name) ? NULL : RSTRING_PTR(method_name));
+		
+		RB_GC_GUARD(path);
+		RB_GC_GUARD(class_path);
+		RB_GC_GUARD(method_name);
+		
+		RB_OBJ_WRITTEN(self, Qundef, key.handle);
+		RB_OBJ_WRITTEN(self, Qundef, key.caller);
+	}
+	
+	return index;
+}
+
+// Sample the call stack of the running fiber, and merge it into the sampled stacks of the current sample.
+static void Fiber_Profiler_Capture_sample_stack(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	// Signals which arrive before the job has run are coalesced (e.g. while the thread is blocked), so the sample is attributed all the time since the previous one, rather than a single interval:
+	uint64_t stack_time = Fiber_Profiler_Capture_now(capture);
+	double duration = Fiber_Profiler_Capture_delta(capture, capture->stack_time, stack_time);
+	capture->stack_time = stack_time;
+	
+	VALUE handles[Fiber_Profiler_Capture_STACK_DEPTH];
+	int lines[Fiber_Profiler_Capture_STACK_DEPTH];
+	
+	int count = rb_profile_frames(0, Fiber_Profiler_Capture_STACK_DEPTH, handles, lines);
+	
+	struct Fiber_Profiler_Tree *stacks = &capture->stacks;
+	uint32_t node = Fiber_Profiler_Tree_ROOT;
+	uint32_t frame = Fiber_Profiler_Frame_UNKNOWN;
+	
+	// Frames are reported from the innermost frame outwards, but the tree is built from the outermost frame inwards:
+	for (int i = count - 1; i >= 0; i -= 1) {
+		frame = Fiber_Profiler_Capture_stack_frame(self, capture, handles[i], lines[i], frame);
+		
+		uint32_t child = Fiber_Profiler_Tree_child(stacks, node, frame);
+		
+		// If the tree is full, the rest of the stack is attributed to the deepest frame which was recorded:
+		if (child == node) break;
+		
+		node = child;
+		
+		struct Fiber_Profiler_Tree_Node *stack_node = Fiber_Profiler_Tree_get(stacks, node);
+		stack_node->count += 1;
+		stack_node->duration += duration;
+	}
+}
+
+// The handler of the signal before it was installed, and the number of timers using it. It is restored once there are no more timers:
+static struct sigaction Fiber_Profiler_Capture_sample_signal_previous;
+static int Fiber_Profiler_Capture_sample_signal_users = 0;
+
+// It's not safe to inspect the call stack (or stop a burst) from a signal handler, so we defer the work until the thread reaches a safe point:
+static void Fiber_Profiler_Capture_sample_signal(int signal, siginfo_t *info, void *context) {
+	if (info && info->si_code == SI_TIMER) {
+		int value = info->si_value.sival_int;
+		
+		if (value == Fiber_Profiler_Capture_TIMER_SAMPLE || value == Fiber_Profiler_Capture_TIMER_BURST) {
+			int saved_errno = errno;
+			
+			rb_postponed_job_trigger(value == Fiber_Profiler_Capture_TIMER_SAMPLE ? Fiber_Profiler_Capture_sample_job : Fiber_Profiler_Capture_burst_job);
+			
+			errno = saved_errno;
+			
+			return;
+		}
+	}
+	
+	// The signal was not sent by one of our timers, so pass it on to the previous handler:
+	struct sigaction *previous = &Fiber_Profiler_Capture_sample_signal_previous;
+	
+	if (previous->sa_flags & SA_SIGINFO) {
+		if (previous->sa_sigaction) previous->sa_sigaction(signal, info, context);
+	} else if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+		previous->sa_handler(signal);
+	}
+}
+
+// Install the signal handler while any capture has a timer, so that processes which don't sample are not affected. Returns 0 on success, or -1 on failure with errno set.
+static int Fiber_Profiler_Capture_sample_signal_acquire(void) {
+	if (Fiber_Profiler_Capture_sample_signal_users == 0) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		
+		action.sa_sigaction = Fiber_Profiler_Capture_sample_signal;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		
+		if (sigaction(Fiber_Profiler_Capture_sample_signal_number(), &action, &Fiber_Profiler_Capture_sample_signal_previous) == -1) {
+			return -1;
+		}
+	}
+	
+	Fiber_Profiler_Capture_sample_signal_users += 1;
+	
+	return 0;
+}
+
+// Restore the previous handler once the last timer has been deleted. Deleting a timer discards any signal it has queued, so none can arrive afterwards:
+static void Fiber_Profiler_Capture_sample_signal_release(void) {
+	if (Fiber_Profiler_Capture_sample_signal_users == 0) return;
+	
+	Fiber_Profiler_Capture_sample_signal_users -= 1;
+	
+	if (Fiber_Profiler_Capture_sample_signal_users == 0) {
+		sigaction(Fiber_Profiler_Capture_sample_signal_number(), &Fiber_Profiler_Capture_sample_signal_previous, NULL);
+	}
+}
+
+// Create a timer which interrupts the current thread, delivering the given value with the signal. Returns 0 on success, or -1 on failure with errno set.
+static int Fiber_Profiler_Capture_timer_create(struct Fiber_Profiler_Timer *timer, int value) {
+	if (Fiber_Profiler_Capture_sample_signal_acquire()) return -1;
+	
+	if (Fiber_Profiler_Timer_create(timer, Fiber_Profiler_Capture_sample_signal_number(), value)) {
+		int saved_errno = errno;
+		Fiber_Profiler_Capture_sample_signal_release();
+		errno = saved_errno;
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Capture_timer_delete(struct Fiber_Profiler_Timer *timer) {
+	if (!timer->created) return;
+	
+	Fiber_Profiler_Timer_delete(timer);
+	Fiber_Profiler_Capture_sample_signal_release();
+}
+
+// Convert the sampled stacks into calls once the sample has finished, so that they can be printed and aggregated in the same way as traced calls. The duration of each call is estimated from the stack samples which included it.
+static void Fiber_Profiler_Capture_stacks_calls(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Tree *stacks = &capture->stacks;
+	
+	if (Fiber_Profiler_Tree_empty_p(stacks)) return;
+	
+	// Nodes are visited depth first, so that parents always precede their children:
+	struct {
+		uint32_t node;
+		uint32_t parent;
+	} *pending = malloc(stacks->size * sizeof(*pending));
+	
+	if (pending == NULL) return;
+	
+	size_t size = 0;
+	
+	// Children are listed from the most recently added, so pushing them in that order visits them in the order they were first sampled:
+	for (uint32_t child = Fiber_Profiler_Tree_get(stacks, Fiber_Profiler_Tree_ROOT)->first_child; child != Fiber_Profiler_Tree_NONE; child = Fiber_Profiler_Tree_get(stacks, child)->next_sibling) {
+		pending[size].node = child;
+		pending[size].parent = Fiber_Profiler_Capture_Call_NONE;
+		size += 1;
+	}
+	
+	while (size > 0) {
+		size -= 1;
+		
+		struct Fiber_Profiler_Tree_Node *node = Fiber_Profiler_Tree_get(stacks, pending[size].node);
+		struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_get(capture, pending[size].parent);
+		
+		double duration = node->duration;
+		
+		if (parent) {
+			parent->child_duration += duration;
+		}
+		
+		// Children are never longer than their parent, so the entire subtree is filtered:
+		if (duration < capture->filter_threshold) {
+			if (parent) parent->filtered += 1;
+			continue;
+		}
+		
+		struct Fiber_Profiler_Capture_Call *call = NULL;
+		
+		// Calls are added as children of the current call, so it is the parent:
+		capture->current = pending[size].parent;
+		
+		if (!Fiber_Profiler_Capture_full_p(capture)) {
+			call = Fiber_Profiler_Capture_Call_push(capture);
+		}
+		
+		if (call == NULL) {
+			if (parent) parent->filtered += 1;
+			capture->statistics->truncated += 1;
+			continue;
+		}
+		
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Frame_Table_get(&capture->frames, node->frame);
+		
+		Fiber_Profiler_Capture_Call_set_event_flag(call, NIL_P(frame->key.caller) ? RUBY_EVENT_CALL : RUBY_EVENT_C_CALL);
+		call->frame = node->frame;
+		
+		// Sampling does not know when the call started, only how long it ran for:
+		call->enter_time = capture->switch_time;
+		call->duration = duration;
+		
+		if (parent) {
+			call->nesting = parent->nesting + 1;
+		}
+		
+		for (uint32_t child = node->first_child; child != Fiber_Profiler_Tree_NONE; child = Fiber_Profiler_Tree_get(stacks, child)->next_sibling) {
+			pending[size].node = child;
+			pending[size].parent = capture->current;
+			size += 1;
+		}
+	}
+	
+	free(pending);
+	
+	capture->current = Fiber_Profiler_Capture_Call_NONE;
+}
+
+// The time spent in the call itself, excluding its direct children.
+static inline double Fiber_Profiler_Capture_Call_self_time(struct Fiber_Profiler_Capture_Call *call) {
+	double self_time = call->duration - call->child_duration;
+	
+	// Calls without a preceeding call are given an estimated duration, which may be shorter than their children:
+	return self_time > 0 ? self_time : 0;
+}
+
+// Finish the call by calculating the duration and filtering it if necessary.
+int Fiber_Profiler_Capture_Call_finish(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call) {
+	struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, call);
+	
+	// The call's duration is known, so it can be accounted to the parent, even if the call itself is filtered:
+	if (parent) {
+		parent->child_duration += call->duration;
+	}
+	
+	rb_event_flag_t event_flag = Fiber_Profiler_Capture_Call_event_flag(call);
+	
+	// Returns without a preceeding call don't have a meaningful duration:
+	if (capture->histograms.maximum && call->frame != Fiber_Profiler_Frame_UNKNOWN && !event_flag_return_p(event_flag)) {
+		Fiber_Profiler_Histogram_Table_add(&capture->histograms, call->frame, call->duration);
+	}
+	
+	// Don't filter calls if we're not running:
+	if (DEBUG_FILTERED) return 0;
+	
+	if (event_flag_return_p(event_flag)) {
+		// We don't filter return statements, as they are always part of the call stack:
+		return 0;
+	}
+	
+	if (call->duration < capture->filter_threshold) {
+		// We can only remove calls from the end of the deque, otherwise they might be referenced by other calls:
+		if (call == Fiber_Profiler_Deque_last(&capture->calls)) {
+			if (capture->current == capture->calls.size - 1) {
+				capture->current = call->parent;
+			}
+			
+			if (parent) {
+				parent->children -= 1;
+				parent->filtered += 1;
+				parent->allocations += call->allocations;
+				call->parent = Fiber_Profiler_Capture_Call_NONE;
+			}
+			
+			Fiber_Profiler_Deque_pop(&capture->calls);
+			capture->statistics->filtered += 1;
+			
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+// Get the name of the given class, which is cached so that printing does not need to allocate.
+static uint32_t Fiber_Profiler_Capture_class_name(struct Fiber_Profiler_Capture *capture, VALUE klass) {
+	uint32_t index;
+	
+	if (!Fiber_Profiler_Map_lookup(&capture->class_names, (uint64_t)klass, &index)) {
+		VALUE name = rb_inspect(klass);
+		index = Fiber_Profiler_Table_intern(&capture->strings, RSTRING_PTR(name));
+		RB_GC_GUARD(name);
+		
+		Fiber_Profiler_Map_insert(&capture->class_names, (uint64_t)klass, index);
+	}
+	
+	return index;
+}
+
+// Get the given frame, resolving its path, class and method names if required.
+static struct Fiber_Profiler_Frame *Fiber_Profiler_Capture_frame_names(struct Fiber_Profiler_Capture *capture, uint32_t index) {
+	struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Frame_Table_get(&capture->frames, index);
+	
+	Fiber_Profiler_Capture_frame_path(capture, frame);
+	
+	if (frame->class_name == Fiber_Profiler_Frame_UNRESOLVED) {
+		frame->class_name = Fiber_Profiler_Capture_class_name(capture, frame->klass);
+	}
+	
+	if (frame->method_name == Fiber_Profiler_Frame_UNRESOLVED) {
+		frame->method_name = Fiber_Profiler_Table_intern(&capture->strings, frame->id ? rb_id2name(frame->id) : NULL);
+	}
+	
+	return frame;
+}
+
+// Whether to highlight a call as expensive. This is purely cosmetic.
+static const double Fiber_Profiler_Capture_Call_EXPENSIVE_THRESHOLD = 0.2;
+
+int Fiber_Profiler_Capture_Call_expensive_p(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call, double duration) {
+	if (call->duration > duration * Fiber_Profiler_Capture_Call_EXPENSIVE_THRESHOLD) {
+		return 1;
+	}
+	
+	return 0;
+}
+
+// Record the given event in the call log.
+static void Fiber_Profiler_Capture_record(struct Fiber_Profiler_Capture *capture, rb_event_flag_t event_flag, VALUE data, ID id, VALUE klass) {
+	if (event_flag_call_p(event_flag)) {
+		struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_Call_new(data, capture, event_flag, id, klass);
+		
+		capture->nesting += 1;
+		
+		if (call == NULL) {
+			Fiber_Profiler_Capture_truncate(capture);
+			capture->truncated_depth += 1;
+			return;
+		}
+		
+		call->enter_time = Fiber_Profiler_Capture_now(capture);
 	}
 	
 	else if (event_flag_return_p(event_flag)) {
-		struct Fiber_Profiler_Capture_Call *call = capture->current;
+		// The matching call was not recorded:
+		if (capture->truncated_depth) {
+			capture->truncated_depth -= 1;
+			capture->nesting -= 1;
+			return;
+		}
+		
+		struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_current(capture);
 		
 		// We may encounter returns without a preceeding call. This isn't an error, but we should pretend like the call started at the beginning of the profiling session:
 		if (call == NULL) {
 			struct Fiber_Profiler_Capture_Call *last_call = Fiber_Profiler_Deque_last(&capture->calls);
-			call = Fiber_Profiler_Capture_Call_new(capture, event_flag, id, klass);
-			
-			struct timespec call_time;
+			call = Fiber_Profiler_Capture_Call_new(data, capture, event_flag, id, klass);
 			
-			if (last_call) {
-				call_time = last_call->enter_time;
+			if (call) {
+				uint64_t call_time;
+				
+				if (last_call) {
+					call_time = last_call->enter_time;
+				} else {
+					call_time = capture->switch_time;
+				}
+				
+				// For return statements, we record the current time as the enter time:
+				call->enter_time = Fiber_Profiler_Capture_now(capture);
+				call->duration = Fiber_Profiler_Capture_delta(capture, call_time, call->enter_time);
 			} else {
-				call_time = capture->switch_time;
+				Fiber_Profiler_Capture_truncate(capture);
 			}
-			
-			// For return statements, we record the current time as the enter time:
-			Fiber_Profiler_Time_current(&call->enter_time);
-			call->duration = Fiber_Profiler_Time_delta(&call_time, &call->enter_time);
 		} else {
-			call->duration = Fiber_Profiler_Time_delta_current(&call->enter_time);
+			call->duration = Fiber_Profiler_Capture_delta(capture, call->enter_time, Fiber_Profiler_Capture_now(capture));
 		}
 		
-		capture->current = call->parent;
+		if (call) {
+			capture->current = call->parent;
+		}
 		
 		// We may encounter returns without a preceeding call.
 		capture->nesting -= 1;
@@ -455,12 +1395,19 @@ static void Fiber_Profiler_Capture_callback(rb_event_flag_t event_flag, VALUE da
 			capture->nesting_minimum = capture->nesting;
 		}
 		
-		Fiber_Profiler_Capture_Call_finish(capture, call);
+		if (call) {
+			Fiber_Profiler_Capture_Call_finish(capture, call);
+		}
 	}
 	
 	else {
 		struct Fiber_Profiler_Capture_Call *last_call = Fiber_Profiler_Deque_last(&capture->calls);
-		struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_Call_new(capture, event_flag, id, klass);
+		struct Fiber_Profiler_Capture_Call *call = Fiber_Profiler_Capture_Call_new(data, capture, event_flag, id, klass);
+		
+		if (call == NULL) {
+			Fiber_Profiler_Capture_truncate(capture);
+			return;
+		}
 		
 		if (last_call) {
 			call->enter_time = last_call->enter_time;
@@ -468,358 +1415,1941 @@ static void Fiber_Profiler_Capture_callback(rb_event_flag_t event_flag, VALUE da
 			call->enter_time = capture->switch_time;
 		}
 		
-		call->duration = Fiber_Profiler_Time_delta_current(&call->enter_time);
+		call->duration = Fiber_Profiler_Capture_delta(capture, call->enter_time, Fiber_Profiler_Capture_now(capture));
 	}
 }
 
-void Fiber_Profiler_Capture_pause(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+static void Fiber_Profiler_Capture_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(data);
 	
+	// We don't want to capture data if we're not running:
 	if (!capture->capture) return;
-	capture->capture = 0;
 	
-	if (capture->track_calls) {
-		rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_callback, self);
+	// Measuring the overhead has a cost of its own, so only do it when it's needed:
+	if (capture->overhead_budget > 0) {
+		uint64_t start_time = Fiber_Profiler_Capture_now(capture);
+		Fiber_Profiler_Capture_record(capture, event_flag, data, id, klass);
+		capture->overhead_ticks += Fiber_Profiler_Capture_now(capture) - start_time;
+	} else {
+		Fiber_Profiler_Capture_record(capture, event_flag, data, id, klass);
 	}
 }
 
-void Fiber_Profiler_Capture_resume(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
-	
-	if (capture->capture) return;
-	capture->capture = 1;
-	capture->samples += 1;
+// Count the allocation against the innermost call. This is called for every object allocated, so it does nothing else:
+static void Fiber_Profiler_Capture_allocation_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(data);
 	
-	if (capture->track_calls) {
-		rb_event_flag_t event_flags = 0;
-		
-		// event_flags |= RUBY_EVENT_LINE;
-		event_flags |= RUBY_EVENT_CALL | RUBY_EVENT_RETURN;
-		event_flags |= RUBY_EVENT_C_CALL | RUBY_EVENT_C_RETURN;
-		event_flags |= RUBY_EVENT_B_CALL | RUBY_EVENT_B_RETURN;
-		
-		// CRuby will raise an exception if you try to add "INTERNAL_EVENT" hooks at the same time as other hooks, so we do it in two calls:
-		rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_callback, event_flags, self);
-		rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_callback, RUBY_INTERNAL_EVENT_GC_START | RUBY_INTERNAL_EVENT_GC_END_SWEEP, self);
+	if (capture->capture && capture->current != Fiber_Profiler_Capture_Call_NONE) {
+		Fiber_Profiler_Capture_current(capture)->allocations += 1;
 	}
 }
 
-void Fiber_Profiler_Capture_fiber_switch(VALUE self);
-
-void Fiber_Profiler_Capture_fiber_switch_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
-	Fiber_Profiler_Capture_fiber_switch(data);
-}
-
-// Reset the sample state, and truncate the call log.
-void Fiber_Profiler_Capture_reset(struct Fiber_Profiler_Capture *capture) {
-	capture->nesting = 0;
-	capture->nesting_minimum = 0;
-	capture->current = NULL;
-	Fiber_Profiler_Deque_truncate(&capture->calls);
-}
-
-VALUE Fiber_Profiler_Capture_start(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
-	
-	if (capture->running) return Qfalse;
-	
-	capture->running = 1;
-	capture->thread = rb_thread_current();
+// Count and time the garbage collection which happens during a sample. Each step of the garbage collector is timed from when it's entered until it exits, and attributed to marking or sweeping, depending on the phase it's in. Garbage collection triggered by any thread stalls the profiled thread, so this hook is process wide. It only runs during garbage collection, so it's installed for as long as the capture is running:
+static void Fiber_Profiler_Capture_gc_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(data);
+	struct Fiber_Profiler_Capture_GC *gc = &capture->gc;
+	uint64_t time = Fiber_Profiler_Capture_now(capture);
 	
-	Fiber_Profiler_Capture_reset(capture);
-	Fiber_Profiler_Time_current(&capture->start_time);
+	// Attribute the time since the previous event of this step to the phase it was in:
+	if (gc->step_time && capture->capture) {
+		double duration = Fiber_Profiler_Capture_delta(capture, gc->step_time, time);
+		
+		if (gc->marking) {
+			gc->mark_time += duration;
+		} else {
+			gc->sweep_time += duration;
+		}
+	}
 	
-	rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_fiber_switch_callback, RUBY_EVENT_FIBER_SWITCH, self);
+	switch (event_flag) {
+		case RUBY_INTERNAL_EVENT_GC_ENTER:
+			gc->step_time = time;
+			return;
+		case RUBY_INTERNAL_EVENT_GC_EXIT:
+			gc->step_time = 0;
+			capture->line_source = NULL;
+			return;
+		case RUBY_INTERNAL_EVENT_GC_START:
+			gc->marking = 1;
+			if (capture->capture) gc->count += 1;
+			break;
+		case RUBY_INTERNAL_EVENT_GC_END_MARK:
+			gc->marking = 0;
+			break;
+	}
 	
-	return self;
+	if (gc->step_time) gc->step_time = time;
 }
 
-VALUE Fiber_Profiler_Capture_stop(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+static void Fiber_Profiler_Capture_hook(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (capture->hooked) return;
+	capture->hooked = 1;
 	
-	if (!capture->running) return Qfalse;
+	rb_event_flag_t event_flags = 0;
 	
-	Fiber_Profiler_Capture_pause(self);
+	// Lines are measured by a separate hook (see `Fiber_Profiler_Capture_hook_lines`), as recording a call for every line would quickly fill the call log:
+	event_flags |= RUBY_EVENT_CALL | RUBY_EVENT_RETURN;
+	event_flags |= RUBY_EVENT_C_CALL | RUBY_EVENT_C_RETURN;
+	event_flags |= RUBY_EVENT_B_CALL | RUBY_EVENT_B_RETURN;
 	
-	rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_fiber_switch_callback, self);
+	// CRuby will raise an exception if you try to add "INTERNAL_EVENT" hooks at the same time as other hooks, so we do it in two calls:
+	rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_callback, event_flags, self);
+	rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_callback, RUBY_INTERNAL_EVENT_GC_START | RUBY_INTERNAL_EVENT_GC_END_SWEEP, self);
 	
-	capture->running = 0;
-	capture->thread = Qnil;
+	if (capture->track_allocations) {
+		rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_allocation_callback, RUBY_INTERNAL_EVENT_NEWOBJ, self);
+	}
+}
+
+static void Fiber_Profiler_Capture_unhook(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (!capture->hooked) return;
+	capture->hooked = 0;
 	
-	Fiber_Profiler_Capture_reset(capture);
+	rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_callback, self);
 	
-	return self;
+	if (capture->track_allocations) {
+		rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_allocation_callback, self);
+	}
 }
 
-void Fiber_Profiler_Capture_finish(struct Fiber_Profiler_Capture *capture, struct timespec switch_time) {
-	struct Fiber_Profiler_Capture_Call *current = capture->current;
-	while (current) {
-		struct Fiber_Profiler_Capture_Call *parent = current->parent;
+// Attribute the time since the current line started to it, as it has finished running.
+static inline void Fiber_Profiler_Capture_line_finish(struct Fiber_Profiler_Capture *capture, uint64_t time) {
+	if (capture->line) {
+		Fiber_Profiler_Line_Table_add(&capture->lines, capture->line, Fiber_Profiler_Capture_delta(capture, capture->line_time, time));
+		capture->line = 0;
+	}
+}
+
+// Measure the time spent on each line of the given files. A line runs until the next line event in one of the files, or until the method or block it belongs to returns, so its time includes the calls it makes into other files. No calls are recorded.
+static void Fiber_Profiler_Capture_line_record(struct Fiber_Profiler_Capture *capture, rb_event_flag_t event_flag) {
+	if (event_flag == RUBY_EVENT_LINE) {
+		const char *source = rb_sourcefile();
 		
-		current->duration = Fiber_Profiler_Time_delta(&current->enter_time, &switch_time);
+		if (source != capture->line_source) {
+			// Only look up the path, as every line path was interned when it was given, and interning other files would only grow the string table (and the strings written to binary outputs):
+			uint32_t path = Fiber_Profiler_Table_lookup(&capture->strings, source);
+			uint32_t value;
+			
+			capture->line_source = source;
+			capture->line_source_path = Fiber_Profiler_Map_lookup(&capture->line_paths, path, &value) ? path : Fiber_Profiler_Table_NULL;
+		}
 		
-		Fiber_Profiler_Capture_Call_finish(capture, current);
+		uint32_t path = capture->line_source_path;
+		if (path == Fiber_Profiler_Table_NULL) return;
 		
-		current = parent;
+		uint64_t time = Fiber_Profiler_Capture_now(capture);
+		
+		Fiber_Profiler_Capture_line_finish(capture, time);
+		
+		capture->line = Fiber_Profiler_Line_key(path, rb_sourceline());
+		capture->line_time = time;
+		capture->line_depth = capture->line_nesting;
+	}
+	
+	else if (event_flag_call_p(event_flag)) {
+		capture->line_nesting += 1;
+	}
+	
+	else {
+		capture->line_nesting -= 1;
+		
+		// The frame of the current line has returned:
+		if (capture->line_nesting < capture->line_depth) {
+			Fiber_Profiler_Capture_line_finish(capture, Fiber_Profiler_Capture_now(capture));
+		}
 	}
 }
 
-void Fiber_Profiler_Capture_print(struct Fiber_Profiler_Capture *capture, double duration);
-
-int Fiber_Profiler_Capture_sample(struct Fiber_Profiler_Capture *capture) {
-	VALUE fiber = Fiber_Profiler_Fiber_current();
+static void Fiber_Profiler_Capture_line_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(data);
 	
-	// We don't want to capture data from blocking fibers:
-	if (Fiber_Profiler_Fiber_blocking(fiber)) return 0;
+	if (!capture->capture) return;
 	
-	if (capture->sample_rate < 1) {
-		return rand() < (RAND_MAX * capture->sample_rate);
+	if (capture->overhead_budget > 0) {
+		uint64_t start_time = Fiber_Profiler_Capture_now(capture);
+		Fiber_Profiler_Capture_line_record(capture, event_flag);
+		capture->overhead_ticks += Fiber_Profiler_Capture_now(capture) - start_time;
 	} else {
-		return 1;
+		Fiber_Profiler_Capture_line_record(capture, event_flag);
 	}
 }
 
-void Fiber_Profiler_Capture_fiber_switch(VALUE self)
-{
+// Enabling line events instruments every method, so like the call tracking hooks, this hook is only removed between samples when not every switch is sampled.
+static void Fiber_Profiler_Capture_hook_lines(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (capture->lines_hooked) return;
+	capture->lines_hooked = 1;
+	
+	// Only Ruby frames can contain lines, so C calls don't need to be followed:
+	rb_event_flag_t event_flags = RUBY_EVENT_LINE | RUBY_EVENT_CALL | RUBY_EVENT_RETURN | RUBY_EVENT_B_CALL | RUBY_EVENT_B_RETURN;
+	
+	rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_line_callback, event_flags, self);
+}
+
+static void Fiber_Profiler_Capture_unhook_lines(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (!capture->lines_hooked) return;
+	capture->lines_hooked = 0;
+	
+	rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_line_callback, self);
+}
+
+// Start tracking calls part way through a sample. The calls already on the stack are reconstructed from the stack, so that the report still has context. When they started is not known, so they are recorded as starting now, and their durations are a lower bound.
+static void Fiber_Profiler_Capture_track(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (capture->hooked) return;
+	
+	uint64_t enter_time = Fiber_Profiler_Capture_now(capture);
+	
+	VALUE handles[Fiber_Profiler_Capture_STACK_DEPTH];
+	int lines[Fiber_Profiler_Capture_STACK_DEPTH];
+	
+	int count = rb_profile_frames(0, Fiber_Profiler_Capture_STACK_DEPTH, handles, lines);
+	uint32_t frame = Fiber_Profiler_Frame_UNKNOWN;
+	
+	for (int i = count - 1; i >= 0; i -= 1) {
+		frame = Fiber_Profiler_Capture_stack_frame(self, capture, handles[i], lines[i], frame);
+		
+		struct Fiber_Profiler_Capture_Call *call = NULL;
+		
+		if (!Fiber_Profiler_Capture_full_p(capture)) {
+			call = Fiber_Profiler_Capture_Call_push(capture);
+		}
+		
+		// The remaining frames will return without having been recorded:
+		if (call == NULL) {
+			Fiber_Profiler_Capture_truncate(capture);
+			capture->statistics->truncated += i;
+			capture->truncated_depth += i + 1;
+			capture->nesting += i + 1;
+			break;
+		}
+		
+		Fiber_Profiler_Capture_Call_set_event_flag(call, lines[i] ? RUBY_EVENT_CALL : RUBY_EVENT_C_CALL);
+		call->frame = frame;
+		call->enter_time = enter_time;
+		call->nesting = capture->nesting;
+		
+		capture->nesting += 1;
+	}
+	
+	Fiber_Profiler_Capture_hook(self, capture);
+}
+
+static void Fiber_Profiler_Capture_sample_job_callback(void *data) {
+	VALUE self = Fiber_Profiler_Capture_sampling;
+	
+	if (NIL_P(self)) return;
+	
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	// The sample may have finished after the signal was delivered:
+	if (!capture->capture || capture->thread != rb_thread_current()) return;
+	
+	uint64_t start_time = capture->overhead_budget > 0 ? Fiber_Profiler_Capture_now(capture) : 0;
+	
+	if (Fiber_Profiler_Capture_deferred_p(capture)) {
+		Fiber_Profiler_Capture_track(self, capture);
+	} else {
+		Fiber_Profiler_Capture_sample_stack(self, capture);
+	}
+	
+	if (capture->overhead_budget > 0) {
+		capture->overhead_ticks += Fiber_Profiler_Capture_now(capture) - start_time;
+	}
+}
+
+void Fiber_Profiler_Capture_pause(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (!capture->capture) return;
+	capture->capture = 0;
+	
+	if (Fiber_Profiler_Capture_sampling_p(capture) || Fiber_Profiler_Capture_deferred_p(capture)) {
+		Fiber_Profiler_Timer_disarm(&capture->timer);
+		Fiber_Profiler_Capture_sampling = Qnil;
+	}
+	
+	if (capture->track_calls) {
+		// If every switch is sampled, the hooks will be needed again immediately, and the callback ignores events while we are not capturing:
+		if (capture->effective_sample_rate < 1 || Fiber_Profiler_Capture_deferred_p(capture)) {
+			Fiber_Profiler_Capture_unhook(self, capture);
+		}
+	}
+	
+	if (Fiber_Profiler_Capture_lines_p(capture) && capture->effective_sample_rate < 1) {
+		Fiber_Profiler_Capture_unhook_lines(self, capture);
+	}
+}
+
+void Fiber_Profiler_Capture_resume(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (capture->capture) return;
+	capture->capture = 1;
+	capture->statistics->samples += 1;
+	
+	if (Fiber_Profiler_Capture_deferred_p(capture)) {
+		Fiber_Profiler_Capture_sampling = self;
+		Fiber_Profiler_Timer_arm_once(&capture->timer, capture->arm_threshold);
+	} else if (capture->track_calls) {
+		Fiber_Profiler_Capture_hook(self, capture);
+	} else if (Fiber_Profiler_Capture_sampling_p(capture)) {
+		Fiber_Profiler_Capture_sampling = self;
+		capture->stack_time = capture->switch_time;
+		Fiber_Profiler_Timer_arm(&capture->timer, capture->sample_interval);
+	}
+	
+	if (Fiber_Profiler_Capture_lines_p(capture)) {
+		Fiber_Profiler_Capture_hook_lines(self, capture);
+	}
+}
+
+void Fiber_Profiler_Capture_fiber_switch(VALUE self);
+
+static ID Fiber_Profiler_Capture_start_id, Fiber_Profiler_Capture_stop_id;
+
+// The attribute of each thread which holds its running capture, see `Fiber::Profiler::Capture#start`:
+static ID Fiber_Profiler_Capture_thread_capture_id;
+
+// The number of running captures which are tracking latency. Fibers only need to be marked as ready while there is at least one.
+static int Fiber_Profiler_Capture_latency_count = 0;
+
+// The number of binary streams started by this process, used to give each stream a unique identifier:
+static uint64_t Fiber_Profiler_Capture_stream_count = 0;
+
+void Fiber_Profiler_Capture_fiber_switch_callback(rb_event_flag_t event_flag, VALUE data, VALUE self, ID id, VALUE klass) {
+	Fiber_Profiler_Capture_fiber_switch(data);
+}
+
+// Reset the sample state, and truncate the call log.
+void Fiber_Profiler_Capture_reset(struct Fiber_Profiler_Capture *capture) {
+	capture->nesting = 0;
+	capture->nesting_minimum = 0;
+	capture->truncated_depth = 0;
+	capture->current = Fiber_Profiler_Capture_Call_NONE;
+	capture->fiber = Qnil;
+	capture->line = 0;
+	capture->line_depth = 0;
+	capture->line_nesting = 0;
+	Fiber_Profiler_Deque_truncate(&capture->calls);
+	
+	// Clearing the tree is proportional to its capacity, so avoid it unless something was sampled:
+	if (!Fiber_Profiler_Tree_empty_p(&capture->stacks)) {
+		Fiber_Profiler_Tree_clear(&capture->stacks);
+	}
+}
+
+// Drop the frames which are no longer referenced, so that the methods and classes they refer to can be collected, and frames seen later have room to be added. This may only be done once the call log and the aggregated call tree are empty. The frames of the histograms are still needed to summarize them, so they are moved to the start of the table:
+static void Fiber_Profiler_Capture_frames_evict(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Frame_Table *frames = &capture->frames;
+	struct Fiber_Profiler_Histogram_Table *histograms = &capture->histograms;
+	
+	uint32_t size = 1;
+	
+	if (histograms->size) {
+		// Frames are only ever moved towards the start of the table, so none are overwritten before they are moved:
+		for (uint32_t index = 1; index < frames->size; index += 1) {
+			uint32_t entry;
+			
+			if (Fiber_Profiler_Map_lookup(&histograms->indexes, index, &entry)) {
+				*Fiber_Profiler_Frame_Table_get(frames, size) = *Fiber_Profiler_Frame_Table_get(frames, index);
+				histograms->entries[entry].key = size;
+				size += 1;
+			}
+		}
+		
+		// The number of entries is unchanged, so this does not need to allocate:
+		Fiber_Profiler_Map_clear(&histograms->indexes);
+		for (size_t entry = 0; entry < histograms->size; entry += 1) {
+			Fiber_Profiler_Map_insert(&histograms->indexes, histograms->entries[entry].key, (uint32_t)entry);
+		}
+	}
+	
+	Fiber_Profiler_Frame_Table_truncate(frames, size);
+	
+	// The classes may now be collected, and their addresses reused:
+	Fiber_Profiler_Map_clear(&capture->class_names);
+}
+
+VALUE Fiber_Profiler_Capture_start(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (capture->running) return Qfalse;
+	
+	// Acquire everything which may fail before changing any state, so that a failed start leaves the capture stopped. Write output in the background if possible, which requires a file descriptor:
+	if (capture->buffer_capacity && RB_TYPE_P(capture->output, T_FILE)) {
+		// Anything already buffered by the IO must be written first, as the writer bypasses it:
+		rb_io_flush(capture->output);
+		
+		capture->writer = Fiber_Profiler_Writer_acquire(rb_io_descriptor(capture->output), capture->buffer_capacity);
+		
+		if (capture->writer == NULL) {
+			rb_sys_fail("Fiber_Profiler_Writer_acquire");
+		}
+	}
+	
+	// The timer interrupts the thread which starts the capture, which is the thread being profiled:
+	if (Fiber_Profiler_Capture_sampling_p(capture) || Fiber_Profiler_Capture_deferred_p(capture)) {
+		if (Fiber_Profiler_Capture_timer_create(&capture->timer, Fiber_Profiler_Capture_TIMER_SAMPLE)) {
+			int error = errno;
+			
+			if (capture->writer) {
+				Fiber_Profiler_Writer_release(capture->writer);
+				capture->writer = NULL;
+			}
+			
+			errno = error;
+			rb_sys_fail("Fiber_Profiler_Timer_create");
+		}
+	}
+	
+	capture->running = 1;
+	capture->thread = rb_thread_current();
+	
+	if (capture->track_latency) {
+		Fiber_Profiler_Latency_restart(&capture->latency, Fiber_Profiler_Time_ticks(Fiber_Profiler_Time_CLOCK_MONOTONIC));
+		Fiber_Profiler_Capture_latency_count += 1;
+	}
+	
+	Fiber_Profiler_Capture_reset(capture);
+	capture->start_time = Fiber_Profiler_Capture_now(capture);
+	
+	// The output may be a different file, so the binary header and strings need to be written again, as a new stream:
+	capture->strings_emitted = 0;
+	capture->stream_id = ++Fiber_Profiler_Capture_stream_count;
+	capture->strings_printed = 0;
+	capture->preamble_emitted = 0;
+	
+	Fiber_Profiler_Tree_clear(&capture->tree);
+	Fiber_Profiler_Reservoir_clear(&capture->reservoir);
+	Fiber_Profiler_Buffer_clear(&capture->preamble);
+	capture->flush_time = capture->start_time;
+	
+	capture->effective_sample_rate = capture->sample_rate;
+	capture->overhead = 0;
+	capture->overhead_ticks = 0;
+	capture->adjust_time = capture->start_time;
+	
+	// Seed the random number generator, which must not be zero:
+	capture->random = (capture->start_time ^ (uint64_t)(uintptr_t)capture) | 1;
+	
+	VALUE thread_id = rb_funcall(capture->thread, rb_intern("native_thread_id"), 0);
+	capture->thread_id = NIL_P(thread_id) ? 0 : NUM2ULL(thread_id);
+	
+	rb_thread_add_event_hook(capture->thread, Fiber_Profiler_Capture_fiber_switch_callback, RUBY_EVENT_FIBER_SWITCH, self);
+	
+	Fiber_Profiler_Capture_GC_initialize(&capture->gc);
+	// Garbage collection is not observed while stopped, so the cached path may have been freed:
+	capture->line_source = NULL;
+	rb_add_event_hook(Fiber_Profiler_Capture_gc_callback, RUBY_INTERNAL_EVENT_GC_START | RUBY_INTERNAL_EVENT_GC_END_MARK | RUBY_INTERNAL_EVENT_GC_END_SWEEP | RUBY_INTERNAL_EVENT_GC_ENTER | RUBY_INTERNAL_EVENT_GC_EXIT, self);
+	
+	return self;
+}
+
+void Fiber_Profiler_Capture_flush(struct Fiber_Profiler_Capture *capture);
+
+VALUE Fiber_Profiler_Capture_stop(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (!capture->running) return Qfalse;
+	
+	Fiber_Profiler_Capture_pause(self);
+	Fiber_Profiler_Capture_unhook(self, capture);
+	Fiber_Profiler_Capture_unhook_lines(self, capture);
+	Fiber_Profiler_Capture_timer_delete(&capture->timer);
+	Fiber_Profiler_Capture_timer_delete(&capture->burst_timer);
+	
+	rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_fiber_switch_callback, self);
+	rb_remove_event_hook_with_data(Fiber_Profiler_Capture_gc_callback, self);
+	
+	if (Fiber_Profiler_Capture_bursting == self) {
+		Fiber_Profiler_Capture_bursting = Qnil;
+	}
+	
+	capture->running = 0;
+	capture->burst_duration = 0;
+	capture->thread = Qnil;
+	
+	if (capture->track_latency) {
+		// Forget the fibers which were running, so they can be collected:
+		Fiber_Profiler_Latency_restart(&capture->latency, Fiber_Profiler_Time_ticks(Fiber_Profiler_Time_CLOCK_MONOTONIC));
+		Fiber_Profiler_Capture_latency_count -= 1;
+	}
+	
+	Fiber_Profiler_Capture_reset(capture);
+	
+	// Print whatever has been aggregated or retained since the last flush:
+	Fiber_Profiler_Capture_flush(capture);
+	Fiber_Profiler_Capture_frames_evict(capture);
+	
+	// Once the last capture using the writer has stopped, wait for any buffered output to be written:
+	if (capture->writer) {
+		capture->statistics->dropped += Fiber_Profiler_Writer_release(capture->writer);
+		capture->writer = NULL;
+	}
+	
+	return self;
+}
+
+// Interrupt the thread once the burst duration has elapsed, so that the burst stops even if no fiber switches. If a timer can't be created, the burst only stops at the next switch:
+static void Fiber_Profiler_Capture_burst_arm(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	if (Fiber_Profiler_Capture_timer_create(&capture->burst_timer, Fiber_Profiler_Capture_TIMER_BURST) == 0) {
+		Fiber_Profiler_Capture_bursting = self;
+		Fiber_Profiler_Timer_arm_once(&capture->burst_timer, capture->burst_duration);
+	}
+}
+
+// Restart the capture in a forked child process, which is done by `Process.fork` for the running capture of the forking thread if `restart_after_fork` is set. The native writer thread and timer do not survive a fork, so they are created again, and the counters, the aggregated call tree and any retained stalls belong to the parent, so they are reset (counters memory mapped by the `statistics_path:` option are no longer shared). The call log, the interned strings and the resolved frames are kept, so they don't need to be allocated or resolved again, and remain shared with the parent until they are written to.
+//
+// @parameter output [IO | Nil] The output to write to from now on, e.g. a file for this process, or nil to keep the current output.
+// @returns [Capture | Boolean] The capture, or false if it was not running.
+static VALUE Fiber_Profiler_Capture_after_fork(int argc, VALUE *argv, VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	VALUE output = Qnil;
+	rb_scan_args(argc, argv, "01", &output);
+	
+	if (!capture->running) return Qfalse;
+	
+	// This is like `stop`, except nothing the parent captured is printed, and the thread local capture is left in place:
+	Fiber_Profiler_Capture_pause(self);
+	Fiber_Profiler_Capture_unhook(self, capture);
+	Fiber_Profiler_Capture_unhook_lines(self, capture);
+	Fiber_Profiler_Capture_timer_delete(&capture->timer);
+	Fiber_Profiler_Capture_timer_delete(&capture->burst_timer);
+	
+	rb_thread_remove_event_hook_with_data(capture->thread, Fiber_Profiler_Capture_fiber_switch_callback, self);
+	rb_remove_event_hook_with_data(Fiber_Profiler_Capture_gc_callback, self);
+	
+	capture->running = 0;
+	
+	if (capture->track_latency) {
+		Fiber_Profiler_Capture_latency_count -= 1;
+	}
+	
+	// The writer thread belongs to the parent, so the writer is abandoned without waiting for it:
+	if (capture->writer) {
+		Fiber_Profiler_Writer_release(capture->writer);
+		capture->writer = NULL;
+	}
+	
+	if (capture->statistics != &capture->statistics_buffer) {
+		Fiber_Profiler_Statistics_unmap(capture->statistics);
+		capture->statistics = &capture->statistics_buffer;
+	}
+	
+	Fiber_Profiler_Statistics_initialize(capture->statistics);
+	
+	if (!NIL_P(output)) {
+		RB_OBJ_WRITE(self, &capture->output, output);
+	}
+	
+	VALUE result = Fiber_Profiler_Capture_start(self);
+	
+	// A burst runs for its full duration in the child:
+	if (RTEST(result) && capture->burst_duration > 0) {
+		Fiber_Profiler_Capture_burst_arm(self, capture);
+	}
+	
+	return result;
+}
+
+// Start the capture, and stop it again once the given duration has elapsed, e.g. to profile a live process on demand. The capture usually stops at the first fiber switch after the duration, once the last sample has been printed. If no fiber switches, a timer finishes the current sample and stops the capture instead.
+//
+// @parameter duration [Numeric] The duration of the burst in seconds.
+// @returns [Capture | Boolean] The result of `start`, which is false if the capture is already running.
+static VALUE Fiber_Profiler_Capture_burst(VALUE self, VALUE duration) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	double seconds = NUM2DBL(duration);
+	
+	if (!(seconds > 0)) {
+		rb_raise(rb_eArgError, "Burst duration must be positive!");
+	}
+	
+	if (capture->running) return Qfalse;
+	
+	VALUE result = rb_funcall(self, Fiber_Profiler_Capture_start_id, 0);
+	
+	if (RTEST(result)) {
+		capture->burst_duration = seconds;
+		Fiber_Profiler_Capture_burst_arm(self, capture);
+	}
+	
+	return result;
+}
+
+void Fiber_Profiler_Capture_finish(struct Fiber_Profiler_Capture *capture, uint64_t switch_time) {
+	struct Fiber_Profiler_Capture_Call *current = Fiber_Profiler_Capture_current(capture);
+	while (current) {
+		struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, current);
+		
+		current->duration = Fiber_Profiler_Capture_delta(capture, current->enter_time, switch_time);
+		
+		Fiber_Profiler_Capture_Call_finish(capture, current);
+		
+		current = parent;
+	}
+}
+
+void Fiber_Profiler_Capture_print(struct Fiber_Profiler_Capture *capture, double duration);
+
+// A xorshift64* generator, which is fast and, unlike `rand()`, keeps its state per capture.
+static inline uint64_t Fiber_Profiler_Capture_random(struct Fiber_Profiler_Capture *capture) {
+	uint64_t x = capture->random;
+	
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	
+	capture->random = x;
+	
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+int Fiber_Profiler_Capture_sample(struct Fiber_Profiler_Capture *capture) {
+	VALUE fiber = Fiber_Profiler_Fiber_current();
+	
+	// We don't want to capture data from blocking fibers:
+	if (Fiber_Profiler_Fiber_blocking(fiber)) return 0;
+	
+	if (capture->effective_sample_rate < 1) {
+		// The top 53 bits give a uniformly distributed double in [0, 1):
+		return (Fiber_Profiler_Capture_random(capture) >> 11) * 0x1.0p-53 < capture->effective_sample_rate;
+	} else {
+		return 1;
+	}
+}
+
+// How often to adjust the sample rate to meet the overhead budget, in seconds:
+static const double Fiber_Profiler_Capture_ADJUST_INTERVAL = 0.1;
+
+// The sample rate is never adjusted below this, so that some samples are still taken and the overhead can be measured:
+static const double Fiber_Profiler_Capture_MINIMUM_SAMPLE_RATE = 0.0001;
+
+// Adjust the sample rate in proportion to how far the measured overhead is from the budget. The change per interval is limited so that a single expensive sample does not cause the rate to collapse.
+static void Fiber_Profiler_Capture_adjust(struct Fiber_Profiler_Capture *capture, uint64_t time) {
+	double duration = Fiber_Profiler_Capture_delta(capture, capture->adjust_time, time);
+	
+	if (duration < Fiber_Profiler_Capture_ADJUST_INTERVAL) return;
+	
+	capture->overhead = Fiber_Profiler_Capture_delta(capture, 0, capture->overhead_ticks) / duration;
+	capture->overhead_ticks = 0;
+	capture->adjust_time = time;
+	
+	double factor = 2;
+	
+	if (capture->overhead > 0) {
+		factor = capture->overhead_budget / capture->overhead;
+		
+		if (factor > 2) factor = 2;
+		else if (factor < 0.5) factor = 0.5;
+	}
+	
+	double rate = capture->effective_sample_rate * factor;
+	
+	if (rate > capture->sample_rate) rate = capture->sample_rate;
+	if (rate < Fiber_Profiler_Capture_MINIMUM_SAMPLE_RATE) rate = Fiber_Profiler_Capture_MINIMUM_SAMPLE_RATE;
+	
+	capture->effective_sample_rate = rate;
+}
+
+// Merge the calls of the current sample into the aggregated call tree. Calls are ordered such that parents always precede their children, so the parent's node is always known.
+static void Fiber_Profiler_Capture_merge(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Tree *tree = &capture->tree;
+	
+	if (capture->calls.size == 0) return;
+	
+	// The node that each call was merged into, indexed by the call's index:
+	uint32_t *nodes = malloc(capture->calls.size * sizeof(uint32_t));
+	if (nodes == NULL) return;
+	
+	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
+		size_t index = page->offset + i;
+		uint32_t parent = call->parent == Fiber_Profiler_Capture_Call_NONE ? Fiber_Profiler_Tree_ROOT : nodes[call->parent];
+		
+		nodes[index] = Fiber_Profiler_Tree_child(tree, parent, call->frame);
+		
+		// If the tree is full, the call is merged into its parent, whose duration already includes it:
+		if (nodes[index] == parent) {
+			Fiber_Profiler_Tree_get(tree, parent)->allocations += call->allocations;
+			continue;
+		}
+		
+		struct Fiber_Profiler_Tree_Node *node = Fiber_Profiler_Tree_get(tree, nodes[index]);
+		node->count += 1;
+		node->duration += call->duration;
+		node->allocations += call->allocations;
+	}
+	
+	free(nodes);
+}
+
+// Finish the current sample, e.g. because the fiber switched, and print it if it was a stall:
+static void Fiber_Profiler_Capture_sample_end(VALUE self, struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Statistics *statistics = capture->statistics;
+	
+	if (!capture->capture) return;
+	
+	// The time of the switch (end):
+	uint64_t switch_time = Fiber_Profiler_Capture_now(capture);
+	
+	// The duration of the sample:
+	double duration = Fiber_Profiler_Capture_delta(capture, capture->switch_time, switch_time);
+	
+	// Finish the current sample:
+	Fiber_Profiler_Capture_pause(self);
+	Fiber_Profiler_Capture_finish(capture, switch_time);
+	Fiber_Profiler_Capture_line_finish(capture, switch_time);
+	Fiber_Profiler_Capture_stacks_calls(capture);
+	
+	size_t memory_size = Fiber_Profiler_Deque_memory_size(&capture->calls);
+	if (memory_size > statistics->memory_maximum) {
+		statistics->memory_maximum = memory_size;
+	}
+	
+	// If the duration of the sample is greater than the stall threshold, we consider it a stall:
+	if (duration > capture->stall_threshold) {
+		uint64_t nanoseconds = (uint64_t)(duration * 1e9);
+		
+		statistics->stalls += 1;
+		statistics->stall_duration += nanoseconds;
+		if (nanoseconds > statistics->stall_duration_maximum) {
+			statistics->stall_duration_maximum = nanoseconds;
+		}
+		
+		Fiber_Profiler_Capture_GC_end(&capture->gc, capture->track_allocations);
+		
+		// Print the sample, unless it is being aggregated:
+		if (!capture->aggregate) {
+			Fiber_Profiler_Capture_print(capture, duration);
+		}
+	}
+	
+	if (capture->aggregate) {
+		Fiber_Profiler_Capture_merge(capture);
+	}
+	
+	int flushed = 0;
+	
+	if (capture->flush_interval > 0 && Fiber_Profiler_Capture_delta(capture, capture->flush_time, switch_time) >= capture->flush_interval) {
+		Fiber_Profiler_Capture_flush(capture);
+		capture->flush_time = switch_time;
+		flushed = 1;
+	}
+	
+	// Reset the capture state:
+	Fiber_Profiler_Capture_reset(capture);
+	
+	// Nothing refers to the frames after a flush, nor between samples unless they are being aggregated:
+	if (flushed || (!capture->aggregate && Fiber_Profiler_Frame_Table_full_p(&capture->frames))) {
+		Fiber_Profiler_Capture_frames_evict(capture);
+	}
+	
+	// Everything since the end of the sample, including printing it, is profiler overhead:
+	if (capture->overhead_budget > 0) {
+		capture->overhead_ticks += Fiber_Profiler_Capture_now(capture) - switch_time;
+	}
+
+}
+
+void Fiber_Profiler_Capture_fiber_switch(VALUE self)
+{
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Statistics *statistics = capture->statistics;
+	statistics->switches += 1;
+	
+	if (capture->track_latency) {
+		Fiber_Profiler_Latency_switch(self, &capture->latency, Fiber_Profiler_Fiber_current(), Fiber_Profiler_Time_ticks(Fiber_Profiler_Time_CLOCK_MONOTONIC));
+	}
+	
+	Fiber_Profiler_Capture_sample_end(self, capture);
+	
+	if (capture->overhead_budget > 0) {
+		Fiber_Profiler_Capture_adjust(capture, Fiber_Profiler_Capture_now(capture));
+	}
+	
+	// A burst stops itself at the first switch after its duration has elapsed, once the last sample has been printed. It is stopped using `stop` so that the running capture of the thread is also cleared:
+	if (capture->burst_duration > 0 && Fiber_Profiler_Capture_delta(capture, capture->start_time, Fiber_Profiler_Capture_now(capture)) >= capture->burst_duration) {
+		rb_funcall(self, Fiber_Profiler_Capture_stop_id, 0);
+		return;
+	}
+	
+	if (Fiber_Profiler_Capture_sample(capture)) {
+		// Capture the time of the switch (start):
+		capture->switch_time = Fiber_Profiler_Capture_now(capture);
+		RB_OBJ_WRITE(self, &capture->fiber, Fiber_Profiler_Fiber_current());
+		Fiber_Profiler_Capture_GC_begin(&capture->gc, capture->track_allocations);
+		
+		// Start capturing data again:
+		Fiber_Profiler_Capture_resume(self);
+	}
+}
+
+// Handle a fiber switch of the profiled thread, as the capture's own hook does. A hook which is added by another hook for the same event is not called for that event, so this is used when a capture is started by a fiber switch, e.g. by `Fiber::Profiler.burst`, so that it samples the fiber which was switched to.
+//
+// @returns [Boolean] Whether the capture is running.
+static VALUE Fiber_Profiler_Capture_fiber_switch_m(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (!capture->running || capture->thread != rb_thread_current()) return Qfalse;
+	
+	Fiber_Profiler_Capture_fiber_switch(self);
+	
+	return capture->running ? Qtrue : Qfalse;
+}
+
+// Stop the burst of the current thread once its duration has elapsed, even if its fibers don't switch. The current sample is finished first, so that it's printed if it was a stall:
+static void Fiber_Profiler_Capture_burst_job_callback(void *data) {
+	VALUE self = Fiber_Profiler_Capture_bursting;
+	
+	if (NIL_P(self)) return;
+	
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	// The burst may have stopped after the signal was delivered:
+	if (!capture->running || capture->burst_duration == 0 || capture->thread != rb_thread_current()) return;
+	
+	Fiber_Profiler_Capture_sample_end(self, capture);
+	rb_funcall(self, Fiber_Profiler_Capture_stop_id, 0);
+}
+
+// When sampling a fiber, we may encounter returns without a preceeding call. This isn't an error, and we should correctly visualize the call stack. We track both the relative nesting (which can be negative) and the minimum nesting level encountered during the profiling session, and use that to determine the absolute nesting level of each call when printing the call stack.
+static size_t Fiber_Profiler_Capture_absolute_nesting(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call) {
+	return call->nesting - capture->nesting_minimum;
+}
+
+// If a call is within this threshold of the parent call, it will be skipped when printing the call stack - it's considered inconsequential to the performance of the parent call.
+static const double Fiber_Profiler_Capture_SKIP_THRESHOLD = 0.98;
+
+void Fiber_Profiler_Capture_print_tty(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration) {
+	double start_time = Fiber_Profiler_Capture_delta(capture, capture->start_time, capture->switch_time);
+	
+	Fiber_Profiler_Buffer_append_literal(buffer, "## Fiber stalled for ");
+	Fiber_Profiler_Buffer_append_fixed(buffer, duration, 3);
+	Fiber_Profiler_Buffer_append_literal(buffer, " seconds (thread=");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->thread_id);
+	Fiber_Profiler_Buffer_append_literal(buffer, ", fiber=");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->fiber_id);
+	Fiber_Profiler_Buffer_append_literal(buffer, ", switches=");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->switches);
+	Fiber_Profiler_Buffer_append_literal(buffer, ", samples=");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->samples);
+	Fiber_Profiler_Buffer_append_literal(buffer, ", stalls=");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->stalls);
+	Fiber_Profiler_Buffer_append_literal(buffer, ", T+");
+	Fiber_Profiler_Buffer_append_fixed(buffer, start_time, 3);
+	Fiber_Profiler_Buffer_append_literal(buffer, "s)\n");
+	
+	if (capture->gc.count) {
+		Fiber_Profiler_Buffer_append_literal(buffer, "## Garbage collected ");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, capture->gc.count);
+		Fiber_Profiler_Buffer_append_literal(buffer, " times (mark ");
+		Fiber_Profiler_Buffer_append_fixed(buffer, capture->gc.mark_time, 4);
+		Fiber_Profiler_Buffer_append_literal(buffer, "s, sweep ");
+		Fiber_Profiler_Buffer_append_fixed(buffer, capture->gc.sweep_time, 4);
+		Fiber_Profiler_Buffer_append_literal(buffer, "s");
+		
+		if (capture->track_allocations) {
+			Fiber_Profiler_Buffer_append_literal(buffer, ", allocations=");
+			Fiber_Profiler_Buffer_append_unsigned(buffer, capture->gc.allocations);
+		}
+		
+		Fiber_Profiler_Buffer_append_literal(buffer, ")\n");
+	}
+	
+	if (!NIL_P(capture->annotation)) {
+		Fiber_Profiler_Buffer_append_literal(buffer, "## Annotation: ");
+		Fiber_Profiler_Buffer_append(buffer, RSTRING_PTR(capture->annotation), RSTRING_LEN(capture->annotation));
+		Fiber_Profiler_Buffer_append_character(buffer, '\n');
+	}
+	
+	size_t skipped = 0;
+	
+	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
+		struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, call);
+		
+		if (call->children) {
+			if (parent && parent->children == 1) {
+				if (call->duration > parent->duration * Fiber_Profiler_Capture_SKIP_THRESHOLD) {
+					if (!DEBUG_SKIPPED) {
+						// We remove the nesting level as we're skipping this call - and we use this to track the nesting of child calls which MAY be printed:
+						call->nesting = parent->nesting;
+						skipped += 1;
+						continue;
+					} else {
+						Fiber_Profiler_Buffer_append_literal(buffer, "\e[34m");
+					}
+				}
+			}
+		}
+		
+		if (parent) {
+			call->nesting = parent->nesting + 1;
+		}
+		
+		if (skipped) {
+			Fiber_Profiler_Buffer_append_literal(buffer, "\e[2m");
+			Fiber_Profiler_Buffer_append_repeated(buffer, '\t', Fiber_Profiler_Capture_absolute_nesting(capture, call));
+			Fiber_Profiler_Buffer_append_literal(buffer, "... skipped ");
+			Fiber_Profiler_Buffer_append_unsigned(buffer, skipped);
+			Fiber_Profiler_Buffer_append_literal(buffer, " nested calls ...\e[0m\n");
+			
+			skipped = 0;
+			call->nesting += 1;
+		}
+		
+		size_t nesting = Fiber_Profiler_Capture_absolute_nesting(capture, call);
+		Fiber_Profiler_Buffer_append_repeated(buffer, '\t', nesting);
+		
+		if (Fiber_Profiler_Capture_Call_expensive_p(capture, call, duration)) {
+			Fiber_Profiler_Buffer_append_literal(buffer, "\e[31m");
+		}
+		
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Capture_frame_names(capture, call->frame);
+		
+		double offset = Fiber_Profiler_Capture_delta(capture, capture->switch_time, call->enter_time);
+		
+		Fiber_Profiler_Buffer_append_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->path));
+		Fiber_Profiler_Buffer_append_character(buffer, ':');
+		Fiber_Profiler_Buffer_append_signed(buffer, frame->line);
+		Fiber_Profiler_Buffer_append_literal(buffer, " in ");
+		Fiber_Profiler_Buffer_append_string(buffer, event_flag_name(Fiber_Profiler_Capture_Call_event_flag(call)));
+		Fiber_Profiler_Buffer_append_literal(buffer, " '");
+		Fiber_Profiler_Buffer_append_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->class_name));
+		Fiber_Profiler_Buffer_append_character(buffer, '#');
+		Fiber_Profiler_Buffer_append_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->method_name));
+		Fiber_Profiler_Buffer_append_literal(buffer, "' (");
+		Fiber_Profiler_Buffer_append_fixed(buffer, call->duration, 4);
+		Fiber_Profiler_Buffer_append_literal(buffer, "s, self ");
+		Fiber_Profiler_Buffer_append_fixed(buffer, Fiber_Profiler_Capture_Call_self_time(call), 4);
+		Fiber_Profiler_Buffer_append_literal(buffer, "s, T+");
+		Fiber_Profiler_Buffer_append_significant(buffer, offset, 3);
+		
+		if (capture->track_allocations) {
+			Fiber_Profiler_Buffer_append_literal(buffer, ", allocations ");
+			Fiber_Profiler_Buffer_append_unsigned(buffer, call->allocations);
+		}
+		
+		Fiber_Profiler_Buffer_append_literal(buffer, ")\n\e[0m");
+		
+		if (call->filtered) {
+			Fiber_Profiler_Buffer_append_literal(buffer, "\e[2m");
+			Fiber_Profiler_Buffer_append_repeated(buffer, '\t', nesting + 1);
+			Fiber_Profiler_Buffer_append_literal(buffer, "... filtered ");
+			Fiber_Profiler_Buffer_append_unsigned(buffer, call->filtered);
+			Fiber_Profiler_Buffer_append_literal(buffer, " direct calls ...\e[0m\n");
+		}
+	}
+	
+	if (skipped) {
+		Fiber_Profiler_Buffer_append_literal(buffer, "\e[2m... skipped ");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, skipped);
+		Fiber_Profiler_Buffer_append_literal(buffer, " calls ...\e[0m\n");
+	}
+}
+
+// Write an interned string as a JSON string.
+static void Fiber_Profiler_Capture_write_json_table_string(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, uint32_t index) {
+	if (index < capture->strings.size) {
+		struct Fiber_Profiler_Table_Entry *entry = &capture->strings.entries[index];
+		Fiber_Profiler_Buffer_append_json_string(buffer, entry->string, entry->length);
+	} else {
+		Fiber_Profiler_Buffer_append_json_string(buffer, NULL, 0);
+	}
+}
+
+void Fiber_Profiler_Capture_print_json(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration) {
+	double start_time = Fiber_Profiler_Capture_delta(capture, capture->start_time, capture->switch_time);
+	
+	Fiber_Profiler_Buffer_append_literal(buffer, "{\"start_time\":");
+	Fiber_Profiler_Buffer_append_fixed(buffer, start_time, 3);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"duration\":");
+	Fiber_Profiler_Buffer_append_fixed(buffer, duration, 6);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"thread_id\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->thread_id);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"fiber_id\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->fiber_id);
+	
+	if (!NIL_P(capture->annotation)) {
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"annotation\":");
+		Fiber_Profiler_Buffer_append_json_string(buffer, RSTRING_PTR(capture->annotation), RSTRING_LEN(capture->annotation));
+	}
+	
+	size_t skipped = 0;
+	
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"calls\":[");
+	int first = 1;
+	
+	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
+		struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, call);
+		
+		if (call->children) {
+			if (parent && parent->children == 1) {
+				if (call->duration > parent->duration * Fiber_Profiler_Capture_SKIP_THRESHOLD) {
+					// We remove the nesting level as we're skipping this call - and we use this to track the nesting of child calls which MAY be printed:
+					call->nesting = parent->nesting;
+					skipped += 1;
+					continue;
+				}
+			}
+		}
+		
+		if (parent) {
+			call->nesting = parent->nesting + 1;
+		}
+		
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Capture_frame_names(capture, call->frame);
+		
+		double offset = Fiber_Profiler_Capture_delta(capture, capture->switch_time, call->enter_time);
+		
+		if (!first) Fiber_Profiler_Buffer_append_character(buffer, ',');
+		
+		Fiber_Profiler_Buffer_append_literal(buffer, "{\"path\":");
+		Fiber_Profiler_Capture_write_json_table_string(capture, buffer, frame->path);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"line\":");
+		Fiber_Profiler_Buffer_append_signed(buffer, frame->line);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"class\":");
+		Fiber_Profiler_Capture_write_json_table_string(capture, buffer, frame->class_name);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"method\":");
+		Fiber_Profiler_Capture_write_json_table_string(capture, buffer, frame->method_name);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"duration\":");
+		Fiber_Profiler_Buffer_append_fixed(buffer, call->duration, 6);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"self_time\":");
+		Fiber_Profiler_Buffer_append_fixed(buffer, Fiber_Profiler_Capture_Call_self_time(call), 6);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"offset\":");
+		Fiber_Profiler_Buffer_append_significant(buffer, offset, 3);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"nesting\":");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, Fiber_Profiler_Capture_absolute_nesting(capture, call));
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"skipped\":");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, skipped);
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"filtered\":");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, call->filtered);
+		
+		if (capture->track_allocations) {
+			Fiber_Profiler_Buffer_append_literal(buffer, ",\"allocations\":");
+			Fiber_Profiler_Buffer_append_unsigned(buffer, call->allocations);
+		}
+		
+		Fiber_Profiler_Buffer_append_character(buffer, '}');
+		
+		skipped = 0;
+		first = 0;
+	}
+	
+	Fiber_Profiler_Buffer_append_character(buffer, ']');
+	
+	if (skipped > 0) {
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"skipped\":");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, skipped);
+	}
+	
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"gc_count\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->gc.count);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"gc_mark_time\":");
+	Fiber_Profiler_Buffer_append_fixed(buffer, capture->gc.mark_time, 6);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"gc_sweep_time\":");
+	Fiber_Profiler_Buffer_append_fixed(buffer, capture->gc.sweep_time, 6);
+	
+	// Allocations are only measured when they are tracked, and are otherwise left out rather than reported as 0:
+	if (capture->track_allocations) {
+		Fiber_Profiler_Buffer_append_literal(buffer, ",\"allocations\":");
+		Fiber_Profiler_Buffer_append_unsigned(buffer, capture->gc.allocations);
+	}
+	
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"switches\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->switches);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"samples\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->samples);
+	Fiber_Profiler_Buffer_append_literal(buffer, ",\"stalls\":");
+	Fiber_Profiler_Buffer_append_unsigned(buffer, capture->statistics->stalls);
+	Fiber_Profiler_Buffer_append_literal(buffer, "}\n");
+}
+
+// The binary format is a sequence of records, each consisting of a one byte type, a four byte little endian length, and the payload. Integers within the payload are encoded as BER compressed integers (the same as Ruby's `pack("w")`), and times are in nanoseconds.
+enum {
+	// The magic string "FPRF", the format version and the stream identifier. Written once when the capture is started, and starts a new string table for the stream.
+	Fiber_Profiler_Capture_BINARY_HEADER = 0,
+	
+	// The stream identifier, the index of the first string, the number of strings, and then each string as a length followed by its bytes. Strings are only written once, the first time they are needed.
+	Fiber_Profiler_Capture_BINARY_STRINGS = 1,
+	
+	// The stream identifier, the number of stall fields, the stall fields, the number of calls, the number of fields per call, and then the fields of each call. New fields may be appended in future versions, so readers should ignore any fields they don't understand.
+	Fiber_Profiler_Capture_BINARY_STALL = 2,
+	
+	// The annotation of the fiber, as raw bytes, which applies to the stall that immediately follows it. Annotations are usually unique (e.g. a request id), so they are not added to the string table.
+	Fiber_Profiler_Capture_BINARY_ANNOTATION = 3,
+};
+
+static const unsigned Fiber_Profiler_Capture_BINARY_VERSION = 2;
+
+// start_time, duration, switches, samples, stalls, skipped, thread_id, fiber_id, gc_count, gc_mark_time, gc_sweep_time, allocations. As in the JSON output, allocations are only written when they are tracked, so that they are not mistaken for 0, and are always the last field:
+static const unsigned Fiber_Profiler_Capture_BINARY_STALL_FIELDS = 12;
+
+// path, line, class, method, duration, offset, nesting, skipped, filtered, self_time, allocations (likewise only when tracked):
+static const unsigned Fiber_Profiler_Capture_BINARY_CALL_FIELDS = 11;
+
+// Whether the call will be skipped when printing, because it's the only child of its parent and takes nearly all of the parent's time:
+static int Fiber_Profiler_Capture_Call_skip_p(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call) {
+	if (call->children == 0) return 0;
+	
+	struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, call);
+	
+	return parent && parent->children == 1 && call->duration > parent->duration * Fiber_Profiler_Capture_SKIP_THRESHOLD;
+}
+
+static void Fiber_Profiler_Capture_write_integer(struct Fiber_Profiler_Buffer *buffer, uint64_t value) {
+	char bytes[10];
+	size_t offset = sizeof(bytes);
+	
+	bytes[--offset] = value & 0x7F;
+	
+	while (value >>= 7) {
+		bytes[--offset] = 0x80 | (value & 0x7F);
+	}
+	
+	Fiber_Profiler_Buffer_append(buffer, bytes + offset, sizeof(bytes) - offset);
+}
+
+// Times can be negative (e.g. offsets of calls that started before the sample), so we zigzag encode them:
+static void Fiber_Profiler_Capture_write_time(struct Fiber_Profiler_Buffer *buffer, double seconds) {
+	int64_t nanoseconds = (int64_t)(seconds * 1e9 + (seconds < 0 ? -0.5 : 0.5));
+	
+	Fiber_Profiler_Capture_write_integer(buffer, ((uint64_t)nanoseconds << 1) ^ (uint64_t)(nanoseconds >> 63));
+}
+
+static size_t Fiber_Profiler_Capture_record_begin(struct Fiber_Profiler_Buffer *buffer, unsigned char type) {
+	Fiber_Profiler_Buffer_append_character(buffer, type);
+	
+	size_t position = buffer->size;
+	
+	// The length will be filled in when the record is finished:
+	Fiber_Profiler_Buffer_append(buffer, "\0\0\0\0", 4);
+	
+	return position;
+}
+
+static void Fiber_Profiler_Capture_record_end(struct Fiber_Profiler_Buffer *buffer, size_t position) {
+	// If the buffer could not be grown, the length was never written:
+	if (buffer->failed) return;
+	
+	uint32_t length = (uint32_t)(buffer->size - position - 4);
+	
+	unsigned char *bytes = (unsigned char *)buffer->data + position;
+	bytes[0] = length & 0xFF;
+	bytes[1] = (length >> 8) & 0xFF;
+	bytes[2] = (length >> 16) & 0xFF;
+	bytes[3] = (length >> 24) & 0xFF;
+}
+
+void Fiber_Profiler_Capture_print_binary(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration) {
+	double start_time = Fiber_Profiler_Capture_delta(capture, capture->start_time, capture->switch_time);
+	
+	size_t emitted = capture->strings_emitted;
+	
+	if (emitted == 0) {
+		size_t position = Fiber_Profiler_Capture_record_begin(buffer, Fiber_Profiler_Capture_BINARY_HEADER);
+		Fiber_Profiler_Buffer_append(buffer, "FPRF", 4);
+		Fiber_Profiler_Capture_write_integer(buffer, Fiber_Profiler_Capture_BINARY_VERSION);
+		Fiber_Profiler_Capture_write_integer(buffer, capture->stream_id);
+		Fiber_Profiler_Capture_record_end(buffer, position);
+		
+		// The first string is always NULL, and is never written:
+		emitted = 1;
+	}
+	
+	// Resolve all the names first, so that any new strings can be written before the stall that refers to them, and count the calls which will be written:
+	size_t count = 0;
+	size_t skipped = 0;
+	
+	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
+		if (Fiber_Profiler_Capture_Call_skip_p(capture, call)) {
+			skipped += 1;
+		} else {
+			Fiber_Profiler_Capture_frame_names(capture, call->frame);
+			skipped = 0;
+			count += 1;
+		}
+	}
+	
+	if (emitted < capture->strings.size) {
+		size_t position = Fiber_Profiler_Capture_record_begin(buffer, Fiber_Profiler_Capture_BINARY_STRINGS);
+		
+		Fiber_Profiler_Capture_write_integer(buffer, capture->stream_id);
+		Fiber_Profiler_Capture_write_integer(buffer, emitted);
+		Fiber_Profiler_Capture_write_integer(buffer, capture->strings.size - emitted);
+		
+		for (size_t i = emitted; i < capture->strings.size; i += 1) {
+			struct Fiber_Profiler_Table_Entry *entry = &capture->strings.entries[i];
+			
+			Fiber_Profiler_Capture_write_integer(buffer, entry->length);
+			Fiber_Profiler_Buffer_append(buffer, entry->string, entry->length);
+		}
+		
+		Fiber_Profiler_Capture_record_end(buffer, position);
+		
+		emitted = capture->strings.size;
+	}
+	
+	// The strings are only counted as written once the report has been written:
+	capture->strings_printed = emitted;
+	
+	// The annotation belongs to the stall which follows it:
+	capture->report_offset = buffer->size;
+	
+	if (!NIL_P(capture->annotation)) {
+		size_t position = Fiber_Profiler_Capture_record_begin(buffer, Fiber_Profiler_Capture_BINARY_ANNOTATION);
+		Fiber_Profiler_Buffer_append(buffer, RSTRING_PTR(capture->annotation), RSTRING_LEN(capture->annotation));
+		Fiber_Profiler_Capture_record_end(buffer, position);
+	}
+	
+	size_t position = Fiber_Profiler_Capture_record_begin(buffer, Fiber_Profiler_Capture_BINARY_STALL);
+	
+	Fiber_Profiler_Capture_write_integer(buffer, capture->stream_id);
+	Fiber_Profiler_Capture_write_integer(buffer, Fiber_Profiler_Capture_BINARY_STALL_FIELDS - !capture->track_allocations);
+	Fiber_Profiler_Capture_write_time(buffer, start_time);
+	Fiber_Profiler_Capture_write_time(buffer, duration);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->statistics->switches);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->statistics->samples);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->statistics->stalls);
+	// The number of trailing skipped calls:
+	Fiber_Profiler_Capture_write_integer(buffer, skipped);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->thread_id);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->fiber_id);
+	Fiber_Profiler_Capture_write_integer(buffer, capture->gc.count);
+	Fiber_Profiler_Capture_write_time(buffer, capture->gc.mark_time);
+	Fiber_Profiler_Capture_write_time(buffer, capture->gc.sweep_time);
+	
+	if (capture->track_allocations) {
+		Fiber_Profiler_Capture_write_integer(buffer, capture->gc.allocations);
+	}
+	
+	Fiber_Profiler_Capture_write_integer(buffer, count);
+	Fiber_Profiler_Capture_write_integer(buffer, Fiber_Profiler_Capture_BINARY_CALL_FIELDS - !capture->track_allocations);
+	
+	skipped = 0;
+	
+	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
+		struct Fiber_Profiler_Capture_Call *parent = Fiber_Profiler_Capture_Call_parent(capture, call);
+		
+		if (Fiber_Profiler_Capture_Call_skip_p(capture, call)) {
+			// We remove the nesting level as we're skipping this call - and we use this to track the nesting of child calls which MAY be printed:
+			call->nesting = parent->nesting;
+			skipped += 1;
+			continue;
+		}
+		
+		if (parent) {
+			call->nesting = parent->nesting + 1;
+		}
+		
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Frame_Table_get(&capture->frames, call->frame);
+		
+		Fiber_Profiler_Capture_write_integer(buffer, frame->path);
+		Fiber_Profiler_Capture_write_integer(buffer, frame->line);
+		Fiber_Profiler_Capture_write_integer(buffer, frame->class_name);
+		Fiber_Profiler_Capture_write_integer(buffer, frame->method_name);
+		Fiber_Profiler_Capture_write_time(buffer, call->duration);
+		Fiber_Profiler_Capture_write_time(buffer, Fiber_Profiler_Capture_delta(capture, capture->switch_time, call->enter_time));
+		Fiber_Profiler_Capture_write_integer(buffer, Fiber_Profiler_Capture_absolute_nesting(capture, call));
+		Fiber_Profiler_Capture_write_integer(buffer, skipped);
+		Fiber_Profiler_Capture_write_integer(buffer, call->filtered);
+		Fiber_Profiler_Capture_write_time(buffer, Fiber_Profiler_Capture_Call_self_time(call));
+		
+		if (capture->track_allocations) {
+			Fiber_Profiler_Capture_write_integer(buffer, call->allocations);
+		}
+		
+		skipped = 0;
+	}
+	
+	Fiber_Profiler_Capture_record_end(buffer, position);
+}
+
+// Semicolons separate frames in the folded output, so they can't appear within a frame:
+static void Fiber_Profiler_Capture_write_folded_string(struct Fiber_Profiler_Buffer *buffer, const char *string) {
+	if (string == NULL) return;
+	
+	size_t length = strlen(string);
+	char *target = Fiber_Profiler_Buffer_reserve(buffer, length);
+	
+	if (target == NULL) return;
+	
+	for (size_t i = 0; i < length; i += 1) {
+		target[i] = string[i] == ';' ? ':' : string[i];
+	}
+	
+	buffer->size += length;
+}
+
+// Write a frame as it appears in the folded output. Frames without a method (e.g. top level blocks) are identified by their location instead:
+static void Fiber_Profiler_Capture_write_folded_frame(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, uint32_t index) {
+	struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Capture_frame_names(capture, index);
+	
+	if (frame->method_name == Fiber_Profiler_Table_NULL) {
+		Fiber_Profiler_Capture_write_folded_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->path));
+		Fiber_Profiler_Buffer_append_character(buffer, ':');
+		Fiber_Profiler_Buffer_append_signed(buffer, frame->line);
+	} else {
+		Fiber_Profiler_Capture_write_folded_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->class_name));
+		Fiber_Profiler_Buffer_append_character(buffer, '#');
+		Fiber_Profiler_Capture_write_folded_string(buffer, Fiber_Profiler_Table_get(&capture->strings, frame->method_name));
+	}
+}
+
+// Print the aggregated call tree in the collapsed stack format, as used by `flamegraph.pl` and compatible tools. Each line is a call path of frames separated by semicolons, followed by the self time of that call path in microseconds, or when tracking allocations, the number of objects it allocated.
+void Fiber_Profiler_Capture_print_folded(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration) {
+	struct Fiber_Profiler_Tree *tree = &capture->tree;
+	
+	// The self time of each node is its duration less the duration of its children:
+	double *self_time = malloc(tree->size * sizeof(double));
+	uint32_t *path = malloc(tree->size * sizeof(uint32_t));
+	
+	if (self_time == NULL || path == NULL) {
+		free(self_time);
+		free(path);
+		return;
+	}
+	
+	for (size_t i = 0; i < tree->size; i += 1) {
+		self_time[i] = tree->nodes[i].duration;
+	}
+	
+	for (size_t i = 1; i < tree->size; i += 1) {
+		struct Fiber_Profiler_Tree_Node *node = &tree->nodes[i];
+		
+		if (node->parent != Fiber_Profiler_Tree_ROOT) {
+			self_time[node->parent] -= node->duration;
+		}
+	}
+	
+	for (size_t i = 1; i < tree->size; i += 1) {
+		long weight;
+		
+		if (capture->track_allocations) {
+			weight = (long)tree->nodes[i].allocations;
+		} else {
+			weight = (long)(self_time[i] * 1e6 + 0.5);
+		}
+		
+		if (weight <= 0) continue;
+		
+		// Walk up the tree to find the call path of this node:
+		size_t depth = 0;
+		for (uint32_t index = (uint32_t)i; index != Fiber_Profiler_Tree_ROOT; index = tree->nodes[index].parent) {
+			path[depth++] = index;
+		}
+		
+		while (depth > 0) {
+			depth -= 1;
+			Fiber_Profiler_Capture_write_folded_frame(capture, buffer, tree->nodes[path[depth]].frame);
+			Fiber_Profiler_Buffer_append_character(buffer, depth ? ';' : ' ');
+		}
+		
+		Fiber_Profiler_Buffer_append_signed(buffer, weight);
+		Fiber_Profiler_Buffer_append_character(buffer, '\n');
+	}
+	
+	free(self_time);
+	free(path);
+}
+
+// The report to be written, which is either the printed buffer or its compressed form.
+struct Fiber_Profiler_Capture_Write {
+	struct Fiber_Profiler_Capture *capture;
+	struct Fiber_Profiler_Buffer *buffer;
+};
+
+VALUE output_write(RB_BLOCK_CALL_FUNC_ARGLIST(yielded_arg, data))
+{
+	struct Fiber_Profiler_Capture_Write *write = (struct Fiber_Profiler_Capture_Write*)data;
+	struct Fiber_Profiler_Capture *capture = write->capture;
+	
+	// Actually perform the write to IO here.
+	rb_io_write(
+		capture->output,
+		rb_str_new_static(write->buffer->data, write->buffer->size)
+	);
+	
+	capture->statistics->bytes_written += write->buffer->size;
+	
+	return Qnil;
+}
+
+static ID Fiber_Profiler_Capture_annotation_id;
+
+// Look up the object id and annotation of the sampled fiber, which are only needed when a sample is printed. Aggregated output does not include them. Returns the annotation, which the caller must keep alive while it is in use.
+static VALUE Fiber_Profiler_Capture_identify(struct Fiber_Profiler_Capture *capture) {
+	capture->fiber_id = 0;
+	capture->annotation = Qnil;
+	
+	if (capture->aggregate || NIL_P(capture->fiber)) return Qnil;
+	
+	capture->fiber_id = NUM2ULL(rb_obj_id(capture->fiber));
+	
+	VALUE annotation = rb_attr_get(capture->fiber, Fiber_Profiler_Capture_annotation_id);
+	
+	if (!NIL_P(annotation)) {
+		annotation = rb_obj_as_string(annotation);
+	}
+	
+	return capture->annotation = annotation;
+}
+
+// Write the buffer to the output, compressing it if required. Returns 0 on success, or -1 if the buffer was dropped.
+static int Fiber_Profiler_Capture_emit(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer) {
+	static VALUE Fiber = Qnil;
+	
+	if (Fiber == Qnil) {
+		Fiber = rb_const_get(rb_cObject, rb_intern("Fiber"));
+	}
+	
+	// Each report is compressed separately, so that the output can be decompressed up to the last complete report:
+	if (capture->compressor.compression != Fiber_Profiler_Compression_NONE) {
+		Fiber_Profiler_Buffer_clear(&capture->compressed);
+		
+		if (Fiber_Profiler_Compressor_compress(&capture->compressor, &capture->compressed, buffer->data, buffer->size) == -1) {
+			capture->statistics->dropped += 1;
+			return -1;
+		}
+		
+		buffer = &capture->compressed;
+	}
+	
+	if (capture->writer) {
+		// Reports which the writer thread has since failed to write are dropped too:
+		capture->statistics->dropped += Fiber_Profiler_Writer_failures(capture->writer);
+		
+		// The background writer takes a copy of the output, so there is no need to block:
+		if (Fiber_Profiler_Writer_push(capture->writer, buffer->data, buffer->size)) {
+			capture->statistics->bytes_written += buffer->size;
+			return 0;
+		} else {
+			capture->statistics->dropped += 1;
+			return -1;
+		}
+	}
+	
+	struct Fiber_Profiler_Capture_Write write = {.capture = capture, .buffer = buffer};
+	
+	// Do the actual write in Fiber.blocking.
+	rb_block_call(
+		Fiber,
+		rb_intern("blocking"),
+		0, NULL, // no args
+		output_write,
+		(VALUE)&write
+	);
+	
+	return 0;
+}
+
+// Retain the printed stall in the reservoir, evicting the shortest retained stall if it is full.
+static void Fiber_Profiler_Capture_retain(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Buffer *buffer, double duration) {
+	struct Fiber_Profiler_Reservoir *reservoir = &capture->reservoir;
+	
+	if (capture->preamble.size == 0) {
+		capture->preamble_emitted = capture->strings_emitted;
+	}
+	
+	// The preamble is written whether or not the stall is retained, so its strings are too:
+	Fiber_Profiler_Buffer_append(&capture->preamble, buffer->data, capture->report_offset);
+	capture->strings_emitted = capture->strings_printed;
+	
+	if (Fiber_Profiler_Reservoir_full_p(reservoir)) {
+		capture->statistics->discarded += 1;
+	}
+	
+	if (Fiber_Profiler_Reservoir_insert(reservoir, duration, buffer->data + capture->report_offset, buffer->size - capture->report_offset) == -1) {
+		capture->statistics->dropped += 1;
+	}
+}
+
+void Fiber_Profiler_Capture_print(struct Fiber_Profiler_Capture *capture, double duration) {
+	if (capture->output == Qnil) return;
+	
+	int retain = !capture->aggregate && capture->reservoir.capacity;
+	
+	// A stall which is no worse than any of the retained stalls would be evicted straight away, so it isn't printed at all:
+	if (retain && !Fiber_Profiler_Reservoir_accept_p(&capture->reservoir, duration)) {
+		capture->statistics->discarded += 1;
+		return;
+	}
+	
+	VALUE annotation = Fiber_Profiler_Capture_identify(capture);
+	
+	struct Fiber_Profiler_Buffer *buffer = &capture->buffer;
+	Fiber_Profiler_Buffer_clear(buffer);
+	capture->report_offset = 0;
+	capture->strings_printed = capture->strings_emitted;
+	capture->print(capture, buffer, duration);
+	
+	capture->annotation = Qnil;
+	RB_GC_GUARD(annotation);
+	
+	// The report is incomplete if the buffer could not be grown, so it is dropped rather than writing invalid output:
+	if (buffer->failed) {
+		capture->statistics->dropped += 1;
+		return;
+	}
+	
+	if (buffer->size == 0) return;
+	
+	if (retain) {
+		Fiber_Profiler_Capture_retain(capture, buffer, duration);
+	} else if (Fiber_Profiler_Capture_emit(capture, buffer) == 0) {
+		capture->strings_emitted = capture->strings_printed;
+	}
+}
+
+// Write the retained stalls in the order they happened, and start retaining again from scratch.
+static void Fiber_Profiler_Capture_flush_retained(struct Fiber_Profiler_Capture *capture) {
+	struct Fiber_Profiler_Reservoir *reservoir = &capture->reservoir;
+	
+	if (reservoir->size == 0 && capture->preamble.size == 0) return;
+	
+	struct Fiber_Profiler_Buffer *buffer = &capture->buffer;
+	Fiber_Profiler_Buffer_clear(buffer);
+	Fiber_Profiler_Buffer_append(buffer, capture->preamble.data, capture->preamble.size);
+	
+	Fiber_Profiler_Reservoir_sort(reservoir);
+	
+	for (size_t i = 0; i < reservoir->size; i += 1) {
+		struct Fiber_Profiler_Buffer *report = &reservoir->entries[i].report;
+		Fiber_Profiler_Buffer_append(buffer, report->data, report->size);
+	}
+	
+	size_t count = reservoir->size;
+	int failed = buffer->failed || capture->preamble.failed;
+	
+	Fiber_Profiler_Reservoir_clear(reservoir);
+	Fiber_Profiler_Buffer_clear(&capture->preamble);
+	
+	if (capture->output == Qnil) return;
+	
+	// The strings in the preamble were never written, so they must be included in the next report:
+	if (failed) {
+		capture->statistics->dropped += count;
+		capture->strings_emitted = capture->preamble_emitted;
+		return;
+	}
+	
+	if (Fiber_Profiler_Capture_emit(capture, buffer) == -1) {
+		capture->strings_emitted = capture->preamble_emitted;
+	}
+}
+
+// Print the aggregated call tree or the retained stalls, if there are any, and start again from scratch.
+void Fiber_Profiler_Capture_flush(struct Fiber_Profiler_Capture *capture) {
+	if (capture->aggregate) {
+		if (Fiber_Profiler_Tree_empty_p(&capture->tree)) return;
+		
+		Fiber_Profiler_Capture_print(capture, 0);
+		
+		Fiber_Profiler_Tree_clear(&capture->tree);
+	} else if (capture->reservoir.capacity) {
+		Fiber_Profiler_Capture_flush_retained(capture);
+	}
+}
+
+#pragma mark - Accessors
+
+static VALUE Fiber_Profiler_Capture_stall_threshold_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->stall_threshold);
+}
+
+static VALUE Fiber_Profiler_Capture_filter_threshold_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->filter_threshold);
+}
+
+static VALUE Fiber_Profiler_Capture_track_calls_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return capture->track_calls ? Qtrue : Qfalse;
+}
+
+static VALUE Fiber_Profiler_Capture_line_paths_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Map *map = &capture->line_paths;
+	
+	VALUE paths = rb_ary_new_capa(map->size);
+	
+	for (size_t i = 0; i < map->capacity; i += 1) {
+		if (map->entries[i].used) {
+			rb_ary_push(paths, rb_str_new_cstr(Fiber_Profiler_Table_get(&capture->strings, (uint32_t)map->entries[i].key)));
+		}
+	}
+	
+	return paths;
+}
+
+static VALUE Fiber_Profiler_Capture_output_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return capture->output;
+}
+
+static VALUE Fiber_Profiler_Capture_restart_after_fork_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return capture->restart_after_fork ? Qtrue : Qfalse;
+}
+
+static VALUE Fiber_Profiler_Capture_track_latency_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return capture->track_latency ? Qtrue : Qfalse;
+}
+
+static VALUE Fiber_Profiler_Capture_track_allocations_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return capture->track_allocations ? Qtrue : Qfalse;
+}
+
+static VALUE Fiber_Profiler_Capture_arm_threshold_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->arm_threshold);
+}
+
+static VALUE Fiber_Profiler_Capture_stalls_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return ULL2NUM(capture->statistics->stalls);
+}
+
+static VALUE Fiber_Profiler_Capture_sample_rate_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->sample_rate);
+}
+
+static VALUE Fiber_Profiler_Capture_overhead_budget_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->overhead_budget);
+}
+
+static VALUE Fiber_Profiler_Capture_effective_sample_rate_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->effective_sample_rate);
+}
+
+static VALUE Fiber_Profiler_Capture_overhead_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->overhead);
+}
+
+static VALUE Fiber_Profiler_Capture_buffer_capacity_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return SIZET2NUM(capture->buffer_capacity);
+}
+
+static VALUE Fiber_Profiler_Capture_sample_interval_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->sample_interval);
+}
+
+static VALUE Fiber_Profiler_Capture_max_calls_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return SIZET2NUM(capture->max_calls);
+}
+
+static VALUE Fiber_Profiler_Capture_truncated_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return ULL2NUM(capture->statistics->truncated);
+}
+
+static VALUE Fiber_Profiler_Capture_clock_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return ID2SYM(rb_intern(Fiber_Profiler_Time_clock_name(capture->clock)));
+}
+
+static VALUE Fiber_Profiler_Capture_output_compression_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return ID2SYM(rb_intern(Fiber_Profiler_Compression_name(capture->compressor.compression)));
+}
+
+static VALUE Fiber_Profiler_Capture_retain_stalls_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return SIZET2NUM(capture->reservoir.capacity);
+}
+
+static VALUE Fiber_Profiler_Capture_flush_interval_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	return DBL2NUM(capture->flush_interval);
+}
+
+static VALUE Fiber_Profiler_Capture_dropped_get(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	
+	if (capture->writer) {
+		capture->statistics->dropped += Fiber_Profiler_Writer_failures(capture->writer);
+	}
+	
+	return ULL2NUM(capture->statistics->dropped);
+}
+
+static VALUE Fiber_Profiler_Capture_histograms_get(VALUE self) {
 	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
-	capture->switches += 1;
 	
-	if (capture->capture) {
-		// The time of the switch (end):
-		struct timespec switch_time;
-		Fiber_Profiler_Time_current(&switch_time);
+	return SIZET2NUM(capture->histograms.maximum);
+}
+
+// The counters of the capture, which are updated as it runs.
+//
+// @returns [Hash] The number of `switches`, `samples`, `stalls`, the total and maximum `stall_duration` in seconds, the number of `calls` recorded and `filtered`, the number of calls `truncated`, the peak `memory_maximum` of the call log in bytes, the number of `bytes_written`, the number of reports `dropped`, and the number of stalls `discarded` because they were not among the worst stalls retained.
+static VALUE Fiber_Profiler_Capture_statistics(VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Statistics *statistics = capture->statistics;
 	
-		// The duration of the sample:
-		double duration = Fiber_Profiler_Time_delta(&capture->switch_time, &switch_time);
-		
-		// Finish the current sample:
-		Fiber_Profiler_Capture_pause(self);
-		Fiber_Profiler_Capture_finish(capture, switch_time);
-		
-		// If the duration of the sample is greater than the stall threshold, we consider it a stall:
-		if (duration > capture->stall_threshold) {
-			capture->stalls += 1;
-			
-			// Print the sample:
-			Fiber_Profiler_Capture_print(capture, duration);
-		}
-		
-		// Reset the capture state:
-		Fiber_Profiler_Capture_reset(capture);
+	if (capture->writer) {
+		statistics->dropped += Fiber_Profiler_Writer_failures(capture->writer);
 	}
 	
-	if (Fiber_Profiler_Capture_sample(capture)) {
-		// Capture the time of the switch (start):
-		Fiber_Profiler_Time_current(&capture->switch_time);
-		
-		// Start capturing data again:
-		Fiber_Profiler_Capture_resume(self);
-	}
+	VALUE result = rb_hash_new();
+	
+	rb_hash_aset(result, ID2SYM(rb_intern("switches")), ULL2NUM(statistics->switches));
+	rb_hash_aset(result, ID2SYM(rb_intern("samples")), ULL2NUM(statistics->samples));
+	rb_hash_aset(result, ID2SYM(rb_intern("stalls")), ULL2NUM(statistics->stalls));
+	rb_hash_aset(result, ID2SYM(rb_intern("stall_duration")), DBL2NUM(statistics->stall_duration / 1e9));
+	rb_hash_aset(result, ID2SYM(rb_intern("stall_duration_maximum")), DBL2NUM(statistics->stall_duration_maximum / 1e9));
+	rb_hash_aset(result, ID2SYM(rb_intern("calls")), ULL2NUM(statistics->calls));
+	rb_hash_aset(result, ID2SYM(rb_intern("filtered")), ULL2NUM(statistics->filtered));
+	rb_hash_aset(result, ID2SYM(rb_intern("truncated")), ULL2NUM(statistics->truncated));
+	rb_hash_aset(result, ID2SYM(rb_intern("memory_maximum")), ULL2NUM(statistics->memory_maximum));
+	rb_hash_aset(result, ID2SYM(rb_intern("bytes_written")), ULL2NUM(statistics->bytes_written));
+	rb_hash_aset(result, ID2SYM(rb_intern("dropped")), ULL2NUM(statistics->dropped));
+	rb_hash_aset(result, ID2SYM(rb_intern("discarded")), ULL2NUM(statistics->discarded));
+	
+	return result;
 }
 
-// When sampling a fiber, we may encounter returns without a preceeding call. This isn't an error, and we should correctly visualize the call stack. We track both the relative nesting (which can be negative) and the minimum nesting level encountered during the profiling session, and use that to determine the absolute nesting level of each call when printing the call stack.
-static size_t Fiber_Profiler_Capture_absolute_nesting(struct Fiber_Profiler_Capture *capture, struct Fiber_Profiler_Capture_Call *call) {
-	return call->nesting - capture->nesting_minimum;
+static int Fiber_Profiler_Capture_Histogram_Entry_compare(const void *a, const void *b) {
+	const struct Fiber_Profiler_Histogram_Entry *x = *(const struct Fiber_Profiler_Histogram_Entry **)a;
+	const struct Fiber_Profiler_Histogram_Entry *y = *(const struct Fiber_Profiler_Histogram_Entry **)b;
+	
+	return (x->duration < y->duration) - (x->duration > y->duration);
 }
 
-// If a call is within this threshold of the parent call, it will be skipped when printing the call stack - it's considered inconsequential to the performance of the parent call.
-static const double Fiber_Profiler_Capture_SKIP_THRESHOLD = 0.98;
-
-void Fiber_Profiler_Capture_print_tty(struct Fiber_Profiler_Capture *capture, FILE *restrict stream, double duration) {
-	double start_time = Fiber_Profiler_Time_delta(&capture->start_time, &capture->switch_time);
+// Summarize the durations of every call recorded so far, by location, in the same format as `Fiber::Profiler::Analyzer.analyze`.
+//
+// @parameter reset [Boolean] Whether to clear the histograms after reading them, so that the next call only includes calls since this one.
+// @returns [Array] Pairs of "path:line" and the summary of that location, ordered by duration.
+static VALUE Fiber_Profiler_Capture_histogram_summary(int argc, VALUE *argv, VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Histogram_Table *table = &capture->histograms;
 	
-	fprintf(stderr, "## Fiber stalled for %.3f seconds (switches=%zu, samples=%zu, stalls=%zu, T+%0.3fs)\n", duration, capture->switches, capture->samples, capture->stalls, start_time);
+	VALUE options = Qnil;
+	rb_scan_args(argc, argv, ":", &options);
 	
-	size_t skipped = 0;
+	ID keywords[1] = {rb_intern("reset")};
+	VALUE arguments[1] = {Qundef};
+	rb_get_kwargs(options, keywords, 0, 1, arguments);
 	
-	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
-		if (call->children) {
-			if (call->parent && call->parent->children == 1) {
-				if (call->duration > call->parent->duration * Fiber_Profiler_Capture_SKIP_THRESHOLD) {
-					if (!DEBUG_SKIPPED) {
-						// We remove the nesting level as we're skipping this call - and we use this to track the nesting of child calls which MAY be printed:
-						call->nesting = call->parent->nesting;
-						skipped += 1;
-						continue;
-					} else {
-						fprintf(stream, "\e[34m");
-					}
-				}
-			}
-		}
-		
-		if (call->parent) {
-			call->nesting = call->parent->nesting + 1;
-		}
-		
-		if (skipped) {
-			fprintf(stream, "\e[2m");
-			
-			size_t nesting = Fiber_Profiler_Capture_absolute_nesting(capture, call);
-			for (size_t i = 0; i < nesting; i += 1) {
-				fputc('\t', stream);
-			}
-			
-			fprintf(stream, "... skipped %zu nested calls ...\e[0m\n", skipped);
-			
-			skipped = 0;
-			call->nesting += 1;
-		}
-		
-		size_t nesting = Fiber_Profiler_Capture_absolute_nesting(capture, call);
-		for (size_t i = 0; i < nesting; i += 1) {
-			fputc('\t', stream);
-		}
-		
-		if (Fiber_Profiler_Capture_Call_expensive_p(capture, call, duration)) {
-			fprintf(stream, "\e[31m");
-		}
-		
-		VALUE class_inspect = rb_inspect(call->klass);
-		const char *name = rb_id2name(call->id);
+	VALUE result = rb_ary_new_capa(table->size);
+	
+	VALUE buffer = 0;
+	struct Fiber_Profiler_Histogram_Entry **entries = RB_ALLOCV_N(struct Fiber_Profiler_Histogram_Entry *, buffer, table->size);
+	
+	for (size_t i = 0; i < table->size; i += 1) {
+		entries[i] = &table->entries[i];
+	}
+	
+	qsort(entries, table->size, sizeof(*entries), Fiber_Profiler_Capture_Histogram_Entry_compare);
+	
+	for (size_t i = 0; i < table->size; i += 1) {
+		struct Fiber_Profiler_Histogram_Entry *entry = entries[i];
+		struct Fiber_Profiler_Frame *frame = Fiber_Profiler_Capture_frame_names(capture, entry->key);
 		
-		struct timespec offset;
-		Fiber_Profiler_Time_elapsed(&capture->switch_time, &call->enter_time, &offset);
+		const char *path = Fiber_Profiler_Table_get(&capture->strings, frame->path);
+		const char *class_name = Fiber_Profiler_Table_get(&capture->strings, frame->class_name);
+		const char *method_name = Fiber_Profiler_Table_get(&capture->strings, frame->method_name);
 		
-		fprintf(stream, "%s:%d in %s '%s#%s' (%0.4fs, T+" Fiber_Profiler_TIME_PRINTF_TIMESPEC ")\n", call->path, call->line, event_flag_name(call->event_flag), RSTRING_PTR(class_inspect), name, call->duration, Fiber_Profiler_TIME_PRINTF_TIMESPEC_ARGUMENTS(offset));
+		VALUE key = rb_sprintf("%s:%d", path ? path : "", frame->line);
 		
-		fprintf(stream, "\e[0m");
+		VALUE data = rb_hash_new();
+		rb_hash_aset(data, ID2SYM(rb_intern("duration")), DBL2NUM(entry->duration));
+		rb_hash_aset(data, ID2SYM(rb_intern("calls")), ULL2NUM(entry->histogram.count));
+		rb_hash_aset(data, ID2SYM(rb_intern("class")), class_name ? rb_str_new_cstr(class_name) : Qnil);
+		rb_hash_aset(data, ID2SYM(rb_intern("method")), method_name ? rb_str_new_cstr(method_name) : Qnil);
+		rb_hash_aset(data, ID2SYM(rb_intern("p50")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&entry->histogram, 0.5)));
+		rb_hash_aset(data, ID2SYM(rb_intern("p90")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&entry->histogram, 0.9)));
+		rb_hash_aset(data, ID2SYM(rb_intern("p99")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&entry->histogram, 0.99)));
+		rb_hash_aset(data, ID2SYM(rb_intern("maximum")), DBL2NUM(entry->maximum));
 		
-		if (call->filtered) {
-			fprintf(stream, "\e[2m");
-			
-			for (size_t i = 0; i < nesting + 1; i += 1) {
-				fputc('\t', stream);
-			}
-			
-			fprintf(stream, "... filtered %zu direct calls ...\e[0m\n", call->filtered);
-		}
+		rb_ary_push(result, rb_assoc_new(key, data));
 	}
 	
-	if (skipped) {
-		fprintf(stream, "\e[2m... skipped %zu calls ...\e[0m\n", skipped);
+	RB_ALLOCV_END(buffer);
+	
+	// Nothing else can record calls until we return, so no calls are lost between reading and clearing the histograms:
+	if (arguments[0] != Qundef && RB_TEST(arguments[0])) {
+		Fiber_Profiler_Histogram_Table_clear(table);
 	}
+	
+	return result;
 }
 
-void Fiber_Profiler_Capture_print_json(struct Fiber_Profiler_Capture *capture, FILE *restrict stream, double duration) {
-	double start_time = Fiber_Profiler_Time_delta(&capture->start_time, &capture->switch_time);
+static int Fiber_Profiler_Capture_Line_Entry_compare(const void *a, const void *b) {
+	const struct Fiber_Profiler_Line_Entry *x = *(const struct Fiber_Profiler_Line_Entry **)a;
+	const struct Fiber_Profiler_Line_Entry *y = *(const struct Fiber_Profiler_Line_Entry **)b;
 	
-	fputc('{', stream);
+	// Longest first:
+	return (x->duration < y->duration) - (x->duration > y->duration);
+}
+
+// Summarize the time spent on each line of the files given by the `line_paths:` option, in every sample, whether or not it was a stall.
+//
+// @parameter reset [Boolean] Whether to clear the lines after reading them, so that the next call only includes lines since this one.
+// @returns [Array] Pairs of "path:line" and the summary of that line, with its total `duration` and the number of times it ran (`count`), ordered by duration.
+static VALUE Fiber_Profiler_Capture_line_summary(int argc, VALUE *argv, VALUE self) {
+	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Line_Table *table = &capture->lines;
 	
-	fprintf(stream, "\"start_time\":%0.3f,\"duration\":%0.6f", start_time, duration);
+	VALUE options = Qnil;
+	rb_scan_args(argc, argv, ":", &options);
 	
-	size_t skipped = 0;
+	ID keywords[1] = {rb_intern("reset")};
+	VALUE arguments[1] = {Qundef};
+	rb_get_kwargs(options, keywords, 0, 1, arguments);
 	
-	fprintf(stream, ",\"calls\":[");
-	int first = 1;
+	VALUE result = rb_ary_new_capa(table->size);
 	
-	Fiber_Profiler_Deque_each(&capture->calls, struct Fiber_Profiler_Capture_Call, call) {
-		if (call->children) {
-			if (call->parent && call->parent->children == 1) {
-				if (call->duration > call->parent->duration * Fiber_Profiler_Capture_SKIP_THRESHOLD) {
-					// We remove the nesting level as we're skipping this call - and we use this to track the nesting of child calls which MAY be printed:
-					call->nesting = call->parent->nesting;
-					skipped += 1;
-					continue;
-				}
-			}
-		}
-		
-		if (call->parent) {
-			call->nesting = call->parent->nesting + 1;
-		}
-		
-		VALUE class_inspect = rb_inspect(call->klass);
-		const char *name = rb_id2name(call->id);
-		
-		size_t nesting = Fiber_Profiler_Capture_absolute_nesting(capture, call);
+	VALUE buffer = 0;
+	struct Fiber_Profiler_Line_Entry **entries = RB_ALLOCV_N(struct Fiber_Profiler_Line_Entry *, buffer, table->size);
+	
+	for (size_t i = 0; i < table->size; i += 1) {
+		entries[i] = &table->entries[i];
+	}
+	
+	qsort(entries, table->size, sizeof(*entries), Fiber_Profiler_Capture_Line_Entry_compare);
+	
+	for (size_t i = 0; i < table->size; i += 1) {
+		struct Fiber_Profiler_Line_Entry *entry = entries[i];
+		const char *path = Fiber_Profiler_Table_get(&capture->strings, Fiber_Profiler_Line_key_path(entry->key));
 		
-		struct timespec offset;
-		Fiber_Profiler_Time_elapsed(&capture->switch_time, &call->enter_time, &offset);
+		VALUE key = rb_sprintf("%s:%d", path ? path : "", Fiber_Profiler_Line_key_line(entry->key));
 		
-		fprintf(stream, "%s{\"path\":\"%s\",\"line\":%d,\"class\":\"%s\",\"method\":\"%s\",\"duration\":%0.6f,\"offset\":" Fiber_Profiler_TIME_PRINTF_TIMESPEC ",\"nesting\":%zu,\"skipped\":%zu,\"filtered\":%zu}", first ? "" : ",", call->path, call->line, RSTRING_PTR(class_inspect), name, call->duration, Fiber_Profiler_TIME_PRINTF_TIMESPEC_ARGUMENTS(offset), nesting, skipped, call->filtered);
+		VALUE data = rb_hash_new();
+		rb_hash_aset(data, ID2SYM(rb_intern("duration")), DBL2NUM(entry->duration));
+		rb_hash_aset(data, ID2SYM(rb_intern("count")), ULL2NUM(entry->count));
 		
-		skipped = 0;
-		first = 0;
+		rb_ary_push(result, rb_assoc_new(key, data));
 	}
 	
-	fprintf(stream, "]");
+	RB_ALLOCV_END(buffer);
 	
-	if (skipped > 0) {
-		fprintf(stream, ",\"skipped\":%zu", skipped);
+	if (arguments[0] != Qundef && RB_TEST(arguments[0])) {
+		Fiber_Profiler_Line_Table_clear(table);
 	}
 	
-	fprintf(stream, ",\"switches\":%zu,\"samples\":%zu,\"stalls\":%zu}\n", capture->switches, capture->samples, capture->stalls);
+	return result;
 }
 
-VALUE output_write(RB_BLOCK_CALL_FUNC_ARGLIST(yielded_arg, data))
-{
-	struct Fiber_Profiler_Capture *capture = (struct Fiber_Profiler_Capture*)data;
+// The time since which the capture of the current thread has been measuring latency, or the maximum time if it isn't, in which case any earlier mark can't be measured either.
+static uint64_t Fiber_Profiler_Capture_latency_since(void) {
+	VALUE value = rb_attr_get(rb_thread_current(), Fiber_Profiler_Capture_thread_capture_id);
 	
-	// Actually perform the write to IO here.
-	rb_io_write(
-		capture->output,
-		rb_str_new_static(capture->stream.buffer, capture->stream.size)
-	);
+	if (rb_typeddata_is_kind_of(value, &Fiber_Profiler_Capture_Type)) {
+		struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(value);
+		
+		if (capture->running && capture->track_latency) return capture->latency.since;
+	}
 	
-	return Qnil;
+	return UINT64_MAX;
 }
 
-void Fiber_Profiler_Capture_print(struct Fiber_Profiler_Capture *capture, double duration) {
-	static VALUE Fiber = Qnil;
+// Mark the fiber as ready to run, either now or once the given delay has elapsed, so that captures tracking latency can measure how long it waits before it actually runs. This is usually called by the fiber scheduler, see `Fiber::Profiler::Scheduler`.
+//
+// @parameter fiber [Fiber] The fiber which is ready.
+// @parameter delay [Numeric | Nil] The delay in seconds after which the fiber will be ready, e.g. the duration of a sleep.
+// @returns [Boolean] Whether the fiber was marked, which is only done while a capture is tracking latency.
+static VALUE Fiber_Profiler_Capture_ready(int argc, VALUE *argv, VALUE klass) {
+	VALUE fiber, delay = Qnil;
+	rb_scan_args(argc, argv, "11", &fiber, &delay);
 	
-	if (Fiber == Qnil) {
-		Fiber = rb_const_get(rb_cObject, rb_intern("Fiber"));
-	}
+	if (Fiber_Profiler_Capture_latency_count == 0) return Qfalse;
 	
-	if (capture->output == Qnil) return;
+	uint64_t time = Fiber_Profiler_Time_ticks(Fiber_Profiler_Time_CLOCK_MONOTONIC);
 	
-	FILE *stream = capture->stream.file;
-	capture->print(capture, stream, duration);
-	fflush(stream);
+	if (!NIL_P(delay)) {
+		double seconds = NUM2DBL(delay);
+		if (seconds > 0) time += (uint64_t)(seconds * 1e9);
+	}
 	
-	// Do the actual write in Fiber.blocking.
-	rb_block_call(
-		Fiber,
-		rb_intern("blocking"),
-		0, NULL, // no args
-		output_write,
-		(VALUE)capture
-	);
+	// If the fiber was already ready, e.g. it was unblocked after its timeout elapsed, it has been waiting since the earlier time. Marks which were never consumed, e.g. because the capture stopped before the fiber ran, are replaced:
+	VALUE ready = rb_attr_get(fiber, Fiber_Profiler_Latency_ready_id);
+	if (!NIL_P(ready)) {
+		uint64_t ready_time = NUM2ULL(ready);
+		
+		if (ready_time < time && ready_time >= Fiber_Profiler_Capture_latency_since()) return Qtrue;
+	}
 	
-	fseek(stream, 0, SEEK_SET);
-}
-
-#pragma mark - Accessors
-
-static VALUE Fiber_Profiler_Capture_stall_threshold_get(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	rb_ivar_set(fiber, Fiber_Profiler_Latency_ready_id, ULL2NUM(time));
 	
-	return DBL2NUM(capture->stall_threshold);
+	return Qtrue;
 }
 
-static VALUE Fiber_Profiler_Capture_filter_threshold_get(VALUE self) {
+// Summarize how long fibers waited to run once they were ready, since the capture was created or last reset.
+//
+// @parameter reset [Boolean] Whether to clear the measurements after reading them.
+// @returns [Hash] The number of waits (`count`), their `total` and `maximum` latency in seconds, the `p50`, `p90` and `p99` latency, and the `worst` waits, longest first. Each wait includes its `latency`, the `fiber_id` and `annotation` of the fiber which waited, and the `blocker_id`, `blocker_annotation` and `blocker_duration` of the fiber which ran the longest while it was waiting, if any.
+static VALUE Fiber_Profiler_Capture_latency_summary(int argc, VALUE *argv, VALUE self) {
 	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	struct Fiber_Profiler_Latency *latency = &capture->latency;
 	
-	return DBL2NUM(capture->filter_threshold);
-}
-
-static VALUE Fiber_Profiler_Capture_track_calls_get(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	VALUE options = Qnil;
+	rb_scan_args(argc, argv, ":", &options);
 	
-	return capture->track_calls ? Qtrue : Qfalse;
-}
-
-static VALUE Fiber_Profiler_Capture_stalls_get(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	ID keywords[1] = {rb_intern("reset")};
+	VALUE arguments[1] = {Qundef};
+	rb_get_kwargs(options, keywords, 0, 1, arguments);
 	
-	return SIZET2NUM(capture->stalls);
-}
-
-static VALUE Fiber_Profiler_Capture_sample_rate_get(VALUE self) {
-	struct Fiber_Profiler_Capture *capture = Fiber_Profiler_Capture_get(self);
+	VALUE result = rb_hash_new();
 	
-	return DBL2NUM(capture->sample_rate);
+	rb_hash_aset(result, ID2SYM(rb_intern("count")), ULL2NUM(latency->histogram.count));
+	rb_hash_aset(result, ID2SYM(rb_intern("total")), DBL2NUM(latency->total));
+	rb_hash_aset(result, ID2SYM(rb_intern("maximum")), DBL2NUM(latency->maximum));
+	rb_hash_aset(result, ID2SYM(rb_intern("p50")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&latency->histogram, 0.5)));
+	rb_hash_aset(result, ID2SYM(rb_intern("p90")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&latency->histogram, 0.9)));
+	rb_hash_aset(result, ID2SYM(rb_intern("p99")), DBL2NUM(Fiber_Profiler_Histogram_percentile(&latency->histogram, 0.99)));
+	
+	VALUE worst = rb_ary_new_capa(latency->worst_size);
+	
+	for (size_t i = 0; i < latency->worst_size; i += 1) {
+		struct Fiber_Profiler_Latency_Wait *wait = &latency->worst[i];
+		
+		VALUE data = rb_hash_new();
+		rb_hash_aset(data, ID2SYM(rb_intern("latency")), DBL2NUM(wait->latency));
+		rb_hash_aset(data, ID2SYM(rb_intern("fiber_id")), rb_obj_id(wait->fiber));
+		rb_hash_aset(data, ID2SYM(rb_intern("annotation")), NIL_P(wait->annotation) ? Qnil : rb_obj_as_string(wait->annotation));
+		rb_hash_aset(data, ID2SYM(rb_intern("blocker_id")), NIL_P(wait->blocker) ? Qnil : rb_obj_id(wait->blocker));
+		rb_hash_aset(data, ID2SYM(rb_intern("blocker_annotation")), NIL_P(wait->blocker_annotation) ? Qnil : rb_obj_as_string(wait->blocker_annotation));
+		rb_hash_aset(data, ID2SYM(rb_intern("blocker_duration")), DBL2NUM(wait->blocker_duration));
+		
+		rb_ary_push(worst, data);
+	}
+	
+	rb_hash_aset(result, ID2SYM(rb_intern("worst")), worst);
+	
+	if (arguments[0] != Qundef && RB_TEST(arguments[0])) {
+		Fiber_Profiler_Latency_clear(latency);
+	}
+	
+	return result;
 }
 
 #pragma mark - Environment Variables
@@ -854,6 +3384,40 @@ static int FIBER_PROFILER_CAPTURE_TRACK_CALLS(void) {
 	}
 }
 
+static int FIBER_PROFILER_CAPTURE_TRACK_ALLOCATIONS(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_TRACK_ALLOCATIONS");
+	
+	if (value && strcmp(value, "true") == 0) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+static int FIBER_PROFILER_CAPTURE_RESTART_AFTER_FORK(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_RESTART_AFTER_FORK");
+	
+	if (value && strcmp(value, "true") == 0) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+static const char *FIBER_PROFILER_CAPTURE_LINE_PATHS(void) {
+	return getenv("FIBER_PROFILER_CAPTURE_LINE_PATHS");
+}
+
+static int FIBER_PROFILER_CAPTURE_TRACK_LATENCY(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_TRACK_LATENCY");
+	
+	if (value && strcmp(value, "true") == 0) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
 static double FIBER_PROFILER_CAPTURE_SAMPLE_RATE(void) {
 	const char *value = getenv("FIBER_PROFILER_CAPTURE_SAMPLE_RATE");
 	
@@ -864,6 +3428,113 @@ static double FIBER_PROFILER_CAPTURE_SAMPLE_RATE(void) {
 	}
 }
 
+static size_t FIBER_PROFILER_CAPTURE_BUFFER_CAPACITY(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_BUFFER_CAPACITY");
+	
+	if (value) {
+		return strtoull(value, NULL, 10);
+	} else {
+		return 0;
+	}
+}
+
+static const char *FIBER_PROFILER_CAPTURE_FORMAT(void) {
+	return getenv("FIBER_PROFILER_CAPTURE_FORMAT");
+}
+
+static size_t FIBER_PROFILER_CAPTURE_MAX_CALLS(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_MAX_CALLS");
+	
+	if (value) {
+		return strtoull(value, NULL, 10);
+	} else {
+		return 0;
+	}
+}
+
+static size_t FIBER_PROFILER_CAPTURE_HISTOGRAMS(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_HISTOGRAMS");
+	
+	if (value) {
+		return strtoull(value, NULL, 10);
+	} else {
+		return 0;
+	}
+}
+
+static size_t FIBER_PROFILER_CAPTURE_RETAIN_STALLS(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_RETAIN_STALLS");
+	
+	if (value) {
+		return strtoull(value, NULL, 10);
+	} else {
+		return 0;
+	}
+}
+
+static enum Fiber_Profiler_Time_Clock FIBER_PROFILER_CAPTURE_CLOCK(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_CLOCK");
+	int clock = value ? Fiber_Profiler_Time_clock_parse(value) : -1;
+	
+	if (clock < 0) {
+		return Fiber_Profiler_Time_CLOCK_MONOTONIC;
+	}
+	
+	// Calibrate the clock now, rather than when the first capture is started:
+	return Fiber_Profiler_Time_clock_initialize(clock);
+}
+
+static enum Fiber_Profiler_Compression FIBER_PROFILER_CAPTURE_OUTPUT_COMPRESSION(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_OUTPUT_COMPRESSION");
+	int compression = value ? Fiber_Profiler_Compression_parse(value) : -1;
+	
+	if (compression < 0) {
+		return Fiber_Profiler_Compression_NONE;
+	}
+	
+	return compression;
+}
+
+static double FIBER_PROFILER_CAPTURE_FLUSH_INTERVAL(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_FLUSH_INTERVAL");
+	
+	if (value) {
+		return atof(value);
+	} else {
+		return 0;
+	}
+}
+
+static double FIBER_PROFILER_CAPTURE_SAMPLE_INTERVAL(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_SAMPLE_INTERVAL");
+	
+	if (value) {
+		return atof(value);
+	} else {
+		return 0;
+	}
+}
+
+static double FIBER_PROFILER_CAPTURE_OVERHEAD_BUDGET(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_OVERHEAD_BUDGET");
+	
+	if (value) {
+		return atof(value);
+	} else {
+		return 0;
+	}
+}
+
+static double FIBER_PROFILER_CAPTURE_ARM_THRESHOLD(void) {
+	const char *value = getenv("FIBER_PROFILER_CAPTURE_ARM_THRESHOLD");
+	
+	if (value) {
+		return atof(value);
+	} else {
+		return 0;
+	}
+}
+
 static double FIBER_PROFILER_CAPTURE_FILTER_THRESHOLD(void) {
 	const char *value = getenv("FIBER_PROFILER_CAPTURE_FILTER_THRESHOLD");
 	
@@ -882,13 +3553,59 @@ void Init_Fiber_Profiler_Capture(VALUE Fiber_Profiler) {
 	Fiber_Profiler_Capture_stall_threshold = FIBER_PROFILER_CAPTURE_STALL_THRESHOLD();
 	Fiber_Profiler_Capture_filter_threshold = FIBER_PROFILER_CAPTURE_FILTER_THRESHOLD();
 	Fiber_Profiler_Capture_track_calls = FIBER_PROFILER_CAPTURE_TRACK_CALLS();
+	Fiber_Profiler_Capture_track_allocations = FIBER_PROFILER_CAPTURE_TRACK_ALLOCATIONS();
+	Fiber_Profiler_Capture_track_latency = FIBER_PROFILER_CAPTURE_TRACK_LATENCY();
 	Fiber_Profiler_Capture_sample_rate = FIBER_PROFILER_CAPTURE_SAMPLE_RATE();
+	Fiber_Profiler_Capture_buffer_capacity = FIBER_PROFILER_CAPTURE_BUFFER_CAPACITY();
+	Fiber_Profiler_Capture_format = FIBER_PROFILER_CAPTURE_FORMAT();
+	Fiber_Profiler_Capture_line_paths = FIBER_PROFILER_CAPTURE_LINE_PATHS();
+	Fiber_Profiler_Capture_restart_after_fork = FIBER_PROFILER_CAPTURE_RESTART_AFTER_FORK();
+	Fiber_Profiler_Capture_flush_interval = FIBER_PROFILER_CAPTURE_FLUSH_INTERVAL();
+	Fiber_Profiler_Capture_max_calls = FIBER_PROFILER_CAPTURE_MAX_CALLS();
+	Fiber_Profiler_Capture_histograms = FIBER_PROFILER_CAPTURE_HISTOGRAMS();
+	Fiber_Profiler_Capture_retain_stalls = FIBER_PROFILER_CAPTURE_RETAIN_STALLS();
+	Fiber_Profiler_Capture_clock = FIBER_PROFILER_CAPTURE_CLOCK();
+	Fiber_Profiler_Capture_output_compression = FIBER_PROFILER_CAPTURE_OUTPUT_COMPRESSION();
+	Fiber_Profiler_Capture_sample_interval = FIBER_PROFILER_CAPTURE_SAMPLE_INTERVAL();
+	Fiber_Profiler_Capture_overhead_budget = FIBER_PROFILER_CAPTURE_OVERHEAD_BUDGET();
+	Fiber_Profiler_Capture_arm_threshold = FIBER_PROFILER_CAPTURE_ARM_THRESHOLD();
+	
+	rb_gc_register_address(&Fiber_Profiler_Capture_default_output);
+	
+	Fiber_Profiler_Capture_annotation_id = rb_intern("@annotation");
+	Fiber_Profiler_Capture_start_id = rb_intern("start");
+	Fiber_Profiler_Capture_stop_id = rb_intern("stop");
+	
+	// Not prefixed with `@`, so it is hidden from Ruby:
+	Fiber_Profiler_Latency_ready_id = rb_intern("__fiber_profiler_ready__");
+	Fiber_Profiler_Capture_thread_capture_id = rb_intern("@fiber_profiler_capture");
+	
+	Fiber_Profiler_Capture_GC_total_allocated_objects = ID2SYM(rb_intern("total_allocated_objects"));
+	
+	Fiber_Profiler_Capture_sample_job = rb_postponed_job_preregister(0, Fiber_Profiler_Capture_sample_job_callback, NULL);
+	Fiber_Profiler_Capture_burst_job = rb_postponed_job_preregister(0, Fiber_Profiler_Capture_burst_job_callback, NULL);
 	
 	Fiber_Profiler_Capture_initialize_options[0] = rb_intern("stall_threshold");
 	Fiber_Profiler_Capture_initialize_options[1] = rb_intern("filter_threshold");
 	Fiber_Profiler_Capture_initialize_options[2] = rb_intern("track_calls");
 	Fiber_Profiler_Capture_initialize_options[3] = rb_intern("sample_rate");
 	Fiber_Profiler_Capture_initialize_options[4] = rb_intern("output");
+	Fiber_Profiler_Capture_initialize_options[5] = rb_intern("buffer_capacity");
+	Fiber_Profiler_Capture_initialize_options[6] = rb_intern("format");
+	Fiber_Profiler_Capture_initialize_options[7] = rb_intern("flush_interval");
+	Fiber_Profiler_Capture_initialize_options[8] = rb_intern("max_calls");
+	Fiber_Profiler_Capture_initialize_options[9] = rb_intern("clock");
+	Fiber_Profiler_Capture_initialize_options[10] = rb_intern("sample_interval");
+	Fiber_Profiler_Capture_initialize_options[11] = rb_intern("overhead_budget");
+	Fiber_Profiler_Capture_initialize_options[12] = rb_intern("arm_threshold");
+	Fiber_Profiler_Capture_initialize_options[13] = rb_intern("track_allocations");
+	Fiber_Profiler_Capture_initialize_options[14] = rb_intern("histograms");
+	Fiber_Profiler_Capture_initialize_options[15] = rb_intern("statistics_path");
+	Fiber_Profiler_Capture_initialize_options[16] = rb_intern("output_compression");
+	Fiber_Profiler_Capture_initialize_options[17] = rb_intern("retain_stalls");
+	Fiber_Profiler_Capture_initialize_options[18] = rb_intern("track_latency");
+	Fiber_Profiler_Capture_initialize_options[19] = rb_intern("line_paths");
+	Fiber_Profiler_Capture_initialize_options[20] = rb_intern("restart_after_fork");
 	
 	Fiber_Profiler_Capture = rb_define_class_under(Fiber_Profiler, "Capture", rb_cObject);
 	rb_define_alloc_func(Fiber_Profiler_Capture, Fiber_Profiler_Capture_allocate);
@@ -899,13 +3616,42 @@ void Init_Fiber_Profiler_Capture(VALUE Fiber_Profiler) {
 	
 	rb_define_method(Fiber_Profiler_Capture, "start", Fiber_Profiler_Capture_start, 0);
 	rb_define_method(Fiber_Profiler_Capture, "stop", Fiber_Profiler_Capture_stop, 0);
+	rb_define_method(Fiber_Profiler_Capture, "burst", Fiber_Profiler_Capture_burst, 1);
+	rb_define_method(Fiber_Profiler_Capture, "after_fork", Fiber_Profiler_Capture_after_fork, -1);
+	rb_define_method(Fiber_Profiler_Capture, "fiber_switch", Fiber_Profiler_Capture_fiber_switch_m, 0);
 	
 	rb_define_method(Fiber_Profiler_Capture, "stall_threshold", Fiber_Profiler_Capture_stall_threshold_get, 0);
 	rb_define_method(Fiber_Profiler_Capture, "filter_threshold", Fiber_Profiler_Capture_filter_threshold_get, 0);
 	rb_define_method(Fiber_Profiler_Capture, "track_calls", Fiber_Profiler_Capture_track_calls_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "arm_threshold", Fiber_Profiler_Capture_arm_threshold_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "track_allocations", Fiber_Profiler_Capture_track_allocations_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "track_latency", Fiber_Profiler_Capture_track_latency_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "line_paths", Fiber_Profiler_Capture_line_paths_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "output", Fiber_Profiler_Capture_output_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "restart_after_fork", Fiber_Profiler_Capture_restart_after_fork_get, 0);
 	rb_define_method(Fiber_Profiler_Capture, "sample_rate", Fiber_Profiler_Capture_sample_rate_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "overhead_budget", Fiber_Profiler_Capture_overhead_budget_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "effective_sample_rate", Fiber_Profiler_Capture_effective_sample_rate_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "overhead", Fiber_Profiler_Capture_overhead_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "buffer_capacity", Fiber_Profiler_Capture_buffer_capacity_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "flush_interval", Fiber_Profiler_Capture_flush_interval_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "retain_stalls", Fiber_Profiler_Capture_retain_stalls_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "max_calls", Fiber_Profiler_Capture_max_calls_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "clock", Fiber_Profiler_Capture_clock_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "output_compression", Fiber_Profiler_Capture_output_compression_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "sample_interval", Fiber_Profiler_Capture_sample_interval_get, 0);
 	
 	rb_define_method(Fiber_Profiler_Capture, "stalls", Fiber_Profiler_Capture_stalls_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "dropped", Fiber_Profiler_Capture_dropped_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "truncated", Fiber_Profiler_Capture_truncated_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "statistics", Fiber_Profiler_Capture_statistics, 0);
+	
+	rb_define_method(Fiber_Profiler_Capture, "histograms", Fiber_Profiler_Capture_histograms_get, 0);
+	rb_define_method(Fiber_Profiler_Capture, "histogram_summary", Fiber_Profiler_Capture_histogram_summary, -1);
+	
+	rb_define_singleton_method(Fiber_Profiler_Capture, "ready", Fiber_Profiler_Capture_ready, -1);
+	rb_define_method(Fiber_Profiler_Capture, "latency_summary", Fiber_Profiler_Capture_latency_summary, -1);
+	rb_define_method(Fiber_Profiler_Capture, "line_summary", Fiber_Profiler_Capture_line_summary, -1);
 	
 	rb_define_singleton_method(Fiber_Profiler_Capture, "default", Fiber_Profiler_Capture_default, 0);
 }
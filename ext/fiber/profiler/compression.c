@@ -0,0 +1,179 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "compression.h"
+
+#include <string.h>
+
+// The window size, with 16 added to select the gzip format rather than raw zlib:
+static const int Fiber_Profiler_Compression_WINDOW_BITS = 15 + 16;
+
+// The most output produced by each call to inflate:
+static const size_t Fiber_Profiler_Compression_INFLATE_CHUNK = 64 * 1024;
+
+// The most input given to the stream at once, which must fit in a `uInt`:
+static const size_t Fiber_Profiler_Compression_INFLATE_INPUT = 1024 * 1024 * 1024;
+
+int Fiber_Profiler_Compression_parse(const char *name)
+{
+	if (strcmp(name, "none") == 0) return Fiber_Profiler_Compression_NONE;
+
+#ifdef HAVE_ZLIB_H
+	if (strcmp(name, "gzip") == 0) return Fiber_Profiler_Compression_GZIP;
+#endif
+
+	return -1;
+}
+
+const char *Fiber_Profiler_Compression_name(enum Fiber_Profiler_Compression compression)
+{
+	switch (compression) {
+		case Fiber_Profiler_Compression_GZIP: return "gzip";
+		default: return "none";
+	}
+}
+
+void Fiber_Profiler_Compressor_initialize(struct Fiber_Profiler_Compressor *compressor, enum Fiber_Profiler_Compression compression)
+{
+	compressor->compression = compression;
+
+#ifdef HAVE_ZLIB_H
+	memset(&compressor->stream, 0, sizeof(compressor->stream));
+	compressor->initialized = 0;
+#endif
+}
+
+void Fiber_Profiler_Compressor_free(struct Fiber_Profiler_Compressor *compressor)
+{
+#ifdef HAVE_ZLIB_H
+	if (compressor->initialized) {
+		deflateEnd(&compressor->stream);
+		compressor->initialized = 0;
+	}
+#endif
+}
+
+int Fiber_Profiler_Compressor_compress(struct Fiber_Profiler_Compressor *compressor, struct Fiber_Profiler_Buffer *output, const char *data, size_t size)
+{
+#ifdef HAVE_ZLIB_H
+	z_stream *stream = &compressor->stream;
+	
+	// The deflate state is allocated the first time it is needed:
+	if (!compressor->initialized) {
+		if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, Fiber_Profiler_Compression_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			return -1;
+		}
+		
+		compressor->initialized = 1;
+	} else if (deflateReset(stream) != Z_OK) {
+		return -1;
+	}
+	
+	stream->next_in = (Bytef *)data;
+	stream->avail_in = (uInt)size;
+	
+	uLong bound = deflateBound(stream, size);
+	int result;
+	
+	do {
+		char *target = Fiber_Profiler_Buffer_reserve(output, bound);
+		if (target == NULL) return -1;
+		
+		stream->next_out = (Bytef *)target;
+		stream->avail_out = (uInt)(output->capacity - output->size);
+		
+		result = deflate(stream, Z_FINISH);
+		
+		output->size = (char *)stream->next_out - output->data;
+	} while (result == Z_OK || result == Z_BUF_ERROR);
+	
+	return result == Z_STREAM_END ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int Fiber_Profiler_Inflater_initialize(struct Fiber_Profiler_Inflater *inflater, const char *data, size_t size)
+{
+	memset(inflater, 0, sizeof(*inflater));
+	
+	inflater->data = data;
+	inflater->size = size;
+	
+#ifdef HAVE_ZLIB_H
+	if (inflateInit2(&inflater->stream, Fiber_Profiler_Compression_WINDOW_BITS) != Z_OK) {
+		return -1;
+	}
+	
+	inflater->initialized = 1;
+	
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void Fiber_Profiler_Inflater_free(struct Fiber_Profiler_Inflater *inflater)
+{
+#ifdef HAVE_ZLIB_H
+	if (inflater->initialized) {
+		inflateEnd(&inflater->stream);
+		inflater->initialized = 0;
+	}
+#endif
+}
+
+int Fiber_Profiler_Inflater_read(struct Fiber_Profiler_Inflater *inflater, struct Fiber_Profiler_Buffer *output, size_t limit)
+{
+#ifdef HAVE_ZLIB_H
+	z_stream *stream = &inflater->stream;
+	size_t remaining = limit;
+	
+	while (!inflater->finished && remaining > 0) {
+		// The stream counts its input in `uInt`, so large inputs are given to it in slices:
+		if (stream->avail_in == 0) {
+			size_t available = inflater->size - inflater->offset;
+			
+			if (available == 0) {
+				inflater->finished = 1;
+				break;
+			}
+			
+			if (available > Fiber_Profiler_Compression_INFLATE_INPUT) available = Fiber_Profiler_Compression_INFLATE_INPUT;
+			
+			stream->next_in = (Bytef *)(inflater->data + inflater->offset);
+			stream->avail_in = (uInt)available;
+			inflater->offset += available;
+		}
+		
+		size_t size = remaining < Fiber_Profiler_Compression_INFLATE_CHUNK ? remaining : Fiber_Profiler_Compression_INFLATE_CHUNK;
+		char *target = Fiber_Profiler_Buffer_reserve(output, size);
+		
+		if (target == NULL) return -1;
+		
+		stream->next_out = (Bytef *)target;
+		stream->avail_out = (uInt)size;
+		
+		int result = inflate(stream, Z_NO_FLUSH);
+		
+		size_t produced = size - stream->avail_out;
+		output->size += produced;
+		remaining -= produced;
+		
+		if (result == Z_STREAM_END) {
+			// Each report is a separate member, so continue with the next one:
+			if (inflateReset(stream) != Z_OK) inflater->finished = 1;
+		} else if (result == Z_BUF_ERROR) {
+			// No progress is possible without more input; if there is none, the last member is truncated:
+			if (stream->avail_in == 0 && inflater->offset == inflater->size) inflater->finished = 1;
+		} else if (result != Z_OK) {
+			// The last member is corrupt; keep what was decompressed so far:
+			inflater->finished = 1;
+		}
+	}
+	
+	return 0;
+#else
+	return -1;
+#endif
+}
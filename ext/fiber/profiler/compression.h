@@ -0,0 +1,70 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+
+#include "buffer.h"
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+// Provides compression of the output. Each report is compressed into a complete gzip member, so a file remains readable (e.g. by `zcat` or `tail -f | zcat`) up to the last report written, even if the process exits without closing it.
+
+enum Fiber_Profiler_Compression {
+	Fiber_Profiler_Compression_NONE = 0,
+	Fiber_Profiler_Compression_GZIP = 1,
+};
+
+// Parse the name of a compression, returning -1 if it is unknown or not available on this system.
+int Fiber_Profiler_Compression_parse(const char *name);
+
+const char *Fiber_Profiler_Compression_name(enum Fiber_Profiler_Compression compression);
+
+struct Fiber_Profiler_Compressor {
+	enum Fiber_Profiler_Compression compression;
+
+#ifdef HAVE_ZLIB_H
+	// The deflate state, which is reset rather than reallocated for each member:
+	z_stream stream;
+	int initialized;
+#endif
+};
+
+void Fiber_Profiler_Compressor_initialize(struct Fiber_Profiler_Compressor *compressor, enum Fiber_Profiler_Compression compression);
+void Fiber_Profiler_Compressor_free(struct Fiber_Profiler_Compressor *compressor);
+
+// Compress the given data into a complete gzip member, appended to the output. Returns 0 on success, or -1 on failure.
+int Fiber_Profiler_Compressor_compress(struct Fiber_Profiler_Compressor *compressor, struct Fiber_Profiler_Buffer *output, const char *data, size_t size);
+
+// Whether the data starts with the gzip magic number.
+static inline int Fiber_Profiler_Compression_gzip_p(const char *data, size_t size)
+{
+	return size >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+
+// Decompresses a sequence of gzip members incrementally, so that a large log can be processed a piece at a time rather than inflated into memory all at once.
+struct Fiber_Profiler_Inflater {
+	const char *data;
+	size_t size;
+	
+	// The offset of the input which has not yet been given to the stream:
+	size_t offset;
+	
+	// Set once all the input has been decompressed. A truncated or corrupt member at the end (e.g. a file which is still being written) ends the output early, but is not an error:
+	int finished;
+
+#ifdef HAVE_ZLIB_H
+	z_stream stream;
+	int initialized;
+#endif
+};
+
+// Prepare to decompress the given data, which must remain valid until the inflater is freed. Returns 0 on success, or -1 if decompression is not available.
+int Fiber_Profiler_Inflater_initialize(struct Fiber_Profiler_Inflater *inflater, const char *data, size_t size);
+void Fiber_Profiler_Inflater_free(struct Fiber_Profiler_Inflater *inflater);
+
+// Decompress until `limit` bytes have been appended to the output, or the input is finished. Returns 0 on success, or -1 if memory could not be allocated.
+int Fiber_Profiler_Inflater_read(struct Fiber_Profiler_Inflater *inflater, struct Fiber_Profiler_Buffer *output, size_t limit);
@@ -19,6 +19,9 @@ enum {
 struct Fiber_Profiler_Deque_Page {
 	struct Fiber_Profiler_Deque_Page *head, *tail;
 	
+	// The index of the first element of this page within the deque. Pages are filled in order and never reordered, so this is fixed once the page is linked:
+	size_t offset;
+	
 	size_t size;
 	size_t capacity;
 	
@@ -32,6 +35,7 @@ struct Fiber_Profiler_Deque_Page *Fiber_Profiler_Deque_Page_allocate(size_t elem
 	if (page) {
 		page->head = page->tail = NULL;
 		
+		page->offset = 0;
 		page->size = 0;
 		page->capacity = capacity;
 		
@@ -88,9 +92,15 @@ struct Fiber_Profiler_Deque {
 	// The deque of elements:
 	struct Fiber_Profiler_Deque_Page *head, *tail;
 	
+	// The page of the most recent lookup by index, as lookups tend to be close together:
+	struct Fiber_Profiler_Deque_Page *cursor;
+	
 	// The current capacity:
 	size_t capacity;
 	
+	// The number of elements:
+	size_t size;
+	
 	// The size of each element that is allocated:
 	size_t element_size;
 	
@@ -100,9 +110,10 @@ struct Fiber_Profiler_Deque {
 
 inline static int Fiber_Profiler_Deque_initialize(struct Fiber_Profiler_Deque *deque, size_t element_size)
 {
-	deque->head = deque->tail = NULL;
+	deque->head = deque->tail = deque->cursor = NULL;
 	
 	deque->capacity = 0;
+	deque->size = 0;
 	
 	deque->element_size = element_size;
 	
@@ -127,7 +138,7 @@ inline static void Fiber_Profiler_Deque_free(struct Fiber_Profiler_Deque *deque)
 {
 	struct Fiber_Profiler_Deque_Page *page = deque->head;
 	
-	deque->head = deque->tail = NULL;
+	deque->head = deque->tail = deque->cursor = NULL;
 	
 	while (page) {
 		page = Fiber_Profiler_Deque_Page_free(page, deque->element_size, deque->element_free);
@@ -161,6 +172,7 @@ void Fiber_Profiler_Deque_truncate(struct Fiber_Profiler_Deque *deque)
 	}
 	
 	deque->tail = deque->head;
+	deque->size = 0;
 	
 	if (Fiber_Profiler_Deque_DEBUG) Fiber_Profiler_Deque_debug(deque, __FUNCTION__);
 }
@@ -207,10 +219,13 @@ static inline void Fiber_Profiler_Deque_reserve(struct Fiber_Profiler_Deque *deq
 	if (page) {
 		page->tail = reserved_page;
 		reserved_page->head = page;
+		reserved_page->offset = page->offset + page->capacity;
 	} else {
 		deque->head = deque->tail = reserved_page;
 	}
 	
+	deque->capacity += reserved_page->capacity;
+	
 	if (Fiber_Profiler_Deque_DEBUG) Fiber_Profiler_Deque_debug(deque, __FUNCTION__);
 }
 
@@ -244,6 +259,7 @@ void *Fiber_Profiler_Deque_push(struct Fiber_Profiler_Deque *deque)
 			}
 			
 			page->head = deque->tail;
+			page->offset = deque->tail->offset + deque->tail->capacity;
 			deque->tail->tail = page;
 			deque->tail = page;
 			deque->capacity += page->capacity;
@@ -252,6 +268,7 @@ void *Fiber_Profiler_Deque_push(struct Fiber_Profiler_Deque *deque)
 	
 	// Push a new element:
 	page->size += 1;
+	deque->size += 1;
 	void *element = Fiber_Profiler_Deque_Page_get(page, page->size - 1, deque->element_size);
 	
 	if (deque->element_initialize) {
@@ -284,6 +301,7 @@ inline static void *Fiber_Profiler_Deque_pop(struct Fiber_Profiler_Deque *deque)
 	// Pop the last element:
 	void *element = Fiber_Profiler_Deque_Page_get(page, page->size - 1, deque->element_size);
 	page->size -= 1;
+	deque->size -= 1;
 	
 	if (deque->element_free) {
 		deque->element_free(element);
@@ -313,6 +331,27 @@ inline static void *Fiber_Profiler_Deque_last(struct Fiber_Profiler_Deque *deque
 	return Fiber_Profiler_Deque_Page_get(page, page->size - 1, deque->element_size);
 }
 
+// Get the element at the given index, or NULL if there is no such element. The page is found by walking from the page of the previous lookup, so this is fast when lookups are close together, e.g. following a call to its parent.
+inline static void *Fiber_Profiler_Deque_get(struct Fiber_Profiler_Deque *deque, size_t index)
+{
+	if (index >= deque->size) return NULL;
+	
+	struct Fiber_Profiler_Deque_Page *page = deque->cursor ? deque->cursor : deque->head;
+	
+	// Every page before the tail is full, so the element is within the first `size` elements of its page:
+	while (index < page->offset) {
+		page = page->head;
+	}
+	
+	while (index >= page->offset + page->size) {
+		page = page->tail;
+	}
+	
+	deque->cursor = page;
+	
+	return Fiber_Profiler_Deque_Page_get(page, index - page->offset, deque->element_size);
+}
+
 #define Fiber_Profiler_Deque_each(deque, type, element) \
 	for (struct Fiber_Profiler_Deque_Page *page = (deque)->head; page != NULL && page->size; page = page->tail) \
 		for (size_t i = 0; i < page->size; i++) \
@@ -0,0 +1,207 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "frame.h"
+#include "table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t Fiber_Profiler_Frame_Table_DEFAULT_CAPACITY = 256;
+
+static uint32_t Fiber_Profiler_Frame_Key_hash(const struct Fiber_Profiler_Frame_Key *key)
+{
+	uint64_t hash = (uint64_t)key->handle >> 3;
+	
+	hash = (hash ^ ((uint64_t)key->caller >> 3)) * 0x9E3779B97F4A7C15ull;
+	hash = (hash ^ (uint64_t)(uint32_t)key->line) * 0xC2B2AE3D27D4EB4Full;
+	hash = (hash ^ (uint64_t)key->id) * 0x9E3779B97F4A7C15ull;
+	hash = (hash ^ ((uint64_t)key->klass >> 3)) * 0xC2B2AE3D27D4EB4Full;
+	hash ^= hash >> 32;
+	
+	return (uint32_t)hash;
+}
+
+static int Fiber_Profiler_Frame_Key_equal(const struct Fiber_Profiler_Frame_Key *a, const struct Fiber_Profiler_Frame_Key *b)
+{
+	return a->handle == b->handle && a->caller == b->caller && a->line == b->line && a->id == b->id && a->klass == b->klass;
+}
+
+static void Fiber_Profiler_Frame_reset(struct Fiber_Profiler_Frame *frame)
+{
+	frame->key.handle = Qnil;
+	frame->key.caller = Qnil;
+	frame->key.line = 0;
+	frame->key.id = 0;
+	frame->key.klass = Qnil;
+	
+	frame->id = 0;
+	frame->klass = Qnil;
+	
+	frame->path = Fiber_Profiler_Table_NULL;
+	frame->line = 0;
+	
+	frame->class_name = Fiber_Profiler_Frame_UNRESOLVED;
+	frame->method_name = Fiber_Profiler_Frame_UNRESOLVED;
+}
+
+void Fiber_Profiler_Frame_Table_initialize(struct Fiber_Profiler_Frame_Table *table)
+{
+	table->size = 0;
+	table->capacity = 0;
+	table->slots_capacity = 0;
+	
+	table->frames = malloc(Fiber_Profiler_Frame_Table_DEFAULT_CAPACITY * sizeof(struct Fiber_Profiler_Frame));
+	table->slots = calloc(Fiber_Profiler_Frame_Table_DEFAULT_CAPACITY * 2, sizeof(uint32_t));
+	
+	if (table->frames == NULL || table->slots == NULL) {
+		rb_raise(rb_eNoMemError, "Failed to allocate frame table!");
+	}
+	
+	table->capacity = Fiber_Profiler_Frame_Table_DEFAULT_CAPACITY;
+	table->slots_capacity = Fiber_Profiler_Frame_Table_DEFAULT_CAPACITY * 2;
+	
+	// Reserve the unknown frame, which is used when a frame can't be interned:
+	Fiber_Profiler_Frame_reset(&table->frames[Fiber_Profiler_Frame_UNKNOWN]);
+	table->size = 1;
+}
+
+void Fiber_Profiler_Frame_Table_free(struct Fiber_Profiler_Frame_Table *table)
+{
+	if (table->frames) {
+		free(table->frames);
+		table->frames = NULL;
+	}
+	
+	if (table->slots) {
+		free(table->slots);
+		table->slots = NULL;
+	}
+	
+	table->size = table->capacity = table->slots_capacity = 0;
+}
+
+size_t Fiber_Profiler_Frame_Table_memory_size(const struct Fiber_Profiler_Frame_Table *table)
+{
+	return table->capacity * sizeof(struct Fiber_Profiler_Frame) + table->slots_capacity * sizeof(uint32_t);
+}
+
+void Fiber_Profiler_Frame_Table_mark(struct Fiber_Profiler_Frame_Table *table)
+{
+	for (size_t i = 0; i < table->size; i += 1) {
+		struct Fiber_Profiler_Frame *frame = &table->frames[i];
+		
+		rb_gc_mark_movable(frame->key.handle);
+		rb_gc_mark_movable(frame->key.caller);
+		rb_gc_mark_movable(frame->key.klass);
+		rb_gc_mark_movable(frame->klass);
+	}
+}
+
+static void Fiber_Profiler_Frame_Table_insert_slot(uint32_t *slots, size_t slots_capacity, uint32_t hash, uint32_t index)
+{
+	size_t mask = slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	while (slots[slot]) {
+		slot = (slot + 1) & mask;
+	}
+	
+	slots[slot] = index + 1;
+}
+
+static void Fiber_Profiler_Frame_Table_rehash(struct Fiber_Profiler_Frame_Table *table, uint32_t *slots, size_t slots_capacity)
+{
+	for (size_t i = 1; i < table->size; i += 1) {
+		struct Fiber_Profiler_Frame *frame = &table->frames[i];
+		
+		Fiber_Profiler_Frame_Table_insert_slot(slots, slots_capacity, Fiber_Profiler_Frame_Key_hash(&frame->key), (uint32_t)i);
+	}
+}
+
+void Fiber_Profiler_Frame_Table_compact(struct Fiber_Profiler_Frame_Table *table)
+{
+	for (size_t i = 0; i < table->size; i += 1) {
+		struct Fiber_Profiler_Frame *frame = &table->frames[i];
+		
+		frame->key.handle = rb_gc_location(frame->key.handle);
+		frame->key.caller = rb_gc_location(frame->key.caller);
+		frame->key.klass = rb_gc_location(frame->key.klass);
+		frame->klass = rb_gc_location(frame->klass);
+	}
+	
+	memset(table->slots, 0, table->slots_capacity * sizeof(uint32_t));
+	Fiber_Profiler_Frame_Table_rehash(table, table->slots, table->slots_capacity);
+}
+
+void Fiber_Profiler_Frame_Table_truncate(struct Fiber_Profiler_Frame_Table *table, size_t size)
+{
+	if (size < 1) size = 1;
+	if (size >= table->size) return;
+	
+	table->size = size;
+	
+	memset(table->slots, 0, table->slots_capacity * sizeof(uint32_t));
+	Fiber_Profiler_Frame_Table_rehash(table, table->slots, table->slots_capacity);
+}
+
+uint32_t Fiber_Profiler_Frame_Table_intern(struct Fiber_Profiler_Frame_Table *table, const struct Fiber_Profiler_Frame_Key *key, int *created)
+{
+	uint32_t hash = Fiber_Profiler_Frame_Key_hash(key);
+	
+	size_t mask = table->slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	*created = 0;
+	
+	while (table->slots[slot]) {
+		uint32_t index = table->slots[slot] - 1;
+		struct Fiber_Profiler_Frame *frame = &table->frames[index];
+		
+		if (Fiber_Profiler_Frame_Key_equal(&frame->key, key)) {
+			return index;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	if (Fiber_Profiler_Frame_Table_full_p(table)) return Fiber_Profiler_Frame_UNKNOWN;
+	
+	// The frame was not found, so we need to add it, keeping the load factor at or below 50%:
+	if ((table->size + 1) * 2 > table->slots_capacity) {
+		size_t slots_capacity = table->slots_capacity * 2;
+		uint32_t *slots = calloc(slots_capacity, sizeof(uint32_t));
+		
+		if (slots == NULL) return Fiber_Profiler_Frame_UNKNOWN;
+		
+		Fiber_Profiler_Frame_Table_rehash(table, slots, slots_capacity);
+		
+		free(table->slots);
+		table->slots = slots;
+		table->slots_capacity = slots_capacity;
+	}
+	
+	if (table->size == table->capacity) {
+		size_t capacity = table->capacity * 2;
+		struct Fiber_Profiler_Frame *frames = realloc(table->frames, capacity * sizeof(struct Fiber_Profiler_Frame));
+		
+		if (frames == NULL) return Fiber_Profiler_Frame_UNKNOWN;
+		
+		table->frames = frames;
+		table->capacity = capacity;
+	}
+	
+	uint32_t index = (uint32_t)table->size;
+	struct Fiber_Profiler_Frame *frame = &table->frames[index];
+	
+	Fiber_Profiler_Frame_reset(frame);
+	frame->key = *key;
+	
+	table->size += 1;
+	
+	Fiber_Profiler_Frame_Table_insert_slot(table->slots, table->slots_capacity, hash, index);
+	
+	*created = 1;
+	
+	return index;
+}
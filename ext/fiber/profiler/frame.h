@@ -0,0 +1,86 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stdint.h>
+
+// Provides a table of resolved frames, keyed by the identity of the frame as reported by `rb_profile_frames`, so that calls to the same location can share a single record.
+
+// The index of the unknown frame, which is always present in the table.
+enum {
+	Fiber_Profiler_Frame_UNKNOWN = 0,
+	
+	// The maximum number of frames, which bounds the memory used by the table and the number of methods and classes it keeps alive until it is next truncated:
+	Fiber_Profiler_Frame_MAXIMUM = 1 << 16,
+};
+
+// Indicates that a name has not been resolved yet.
+static const uint32_t Fiber_Profiler_Frame_UNRESOLVED = UINT32_MAX;
+
+// The identity of a frame, as seen by an event hook:
+struct Fiber_Profiler_Frame_Key {
+	// The frame handle (an iseq or callable method entry), and when that frame has no line number (i.e. a C function), the handle of the nearest Ruby frame:
+	VALUE handle;
+	VALUE caller;
+	int line;
+	
+	// The method and class given to the event hook, which distinguish different C functions invoked from the same call site:
+	ID id;
+	VALUE klass;
+};
+
+struct Fiber_Profiler_Frame {
+	struct Fiber_Profiler_Frame_Key key;
+	
+	// The resolved method and class:
+	ID id;
+	VALUE klass;
+	
+	// The resolved location, where `path` is an index into the string table, and is resolved lazily from the handle when the frame is first printed (`Fiber_Profiler_Frame_UNRESOLVED` until then):
+	uint32_t path;
+	int line;
+	
+	// The class and method names, which are indexes into the string table, and are resolved lazily when the frame is first printed:
+	uint32_t class_name;
+	uint32_t method_name;
+};
+
+struct Fiber_Profiler_Frame_Table {
+	// The frames, indexed by their identifier:
+	struct Fiber_Profiler_Frame *frames;
+	size_t size;
+	size_t capacity;
+	
+	// An open addressing hash table of (index + 1), where 0 indicates an empty slot:
+	uint32_t *slots;
+	size_t slots_capacity;
+};
+
+void Fiber_Profiler_Frame_Table_initialize(struct Fiber_Profiler_Frame_Table *table);
+void Fiber_Profiler_Frame_Table_free(struct Fiber_Profiler_Frame_Table *table);
+
+size_t Fiber_Profiler_Frame_Table_memory_size(const struct Fiber_Profiler_Frame_Table *table);
+
+// Mark the handles and classes of all frames.
+void Fiber_Profiler_Frame_Table_mark(struct Fiber_Profiler_Frame_Table *table);
+
+// Update the handles and classes of all frames after compaction, and rebuild the hash table as the keys may have moved.
+void Fiber_Profiler_Frame_Table_compact(struct Fiber_Profiler_Frame_Table *table);
+
+// Remove all frames from the given index onwards, retaining the allocated capacity. The unknown frame is always kept.
+void Fiber_Profiler_Frame_Table_truncate(struct Fiber_Profiler_Frame_Table *table, size_t size);
+
+// Find the frame with the given key or add a new one. If a new frame is added, `created` is set and the caller is responsible for resolving it. Returns `Fiber_Profiler_Frame_UNKNOWN` if the frame could not be added, including when the table is full.
+uint32_t Fiber_Profiler_Frame_Table_intern(struct Fiber_Profiler_Frame_Table *table, const struct Fiber_Profiler_Frame_Key *key, int *created);
+
+static inline int Fiber_Profiler_Frame_Table_full_p(const struct Fiber_Profiler_Frame_Table *table)
+{
+	return table->size >= Fiber_Profiler_Frame_MAXIMUM;
+}
+
+static inline struct Fiber_Profiler_Frame *Fiber_Profiler_Frame_Table_get(const struct Fiber_Profiler_Frame_Table *table, uint32_t index)
+{
+	return &table->frames[index];
+}
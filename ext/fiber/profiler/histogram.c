@@ -0,0 +1,131 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "histogram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void Fiber_Profiler_Histogram_clear(struct Fiber_Profiler_Histogram *histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+void Fiber_Profiler_Histogram_merge(struct Fiber_Profiler_Histogram *histogram, const struct Fiber_Profiler_Histogram *other)
+{
+	for (size_t i = 0; i < Fiber_Profiler_Histogram_BUCKETS; i += 1) {
+		histogram->buckets[i] += other->buckets[i];
+	}
+	
+	histogram->count += other->count;
+}
+
+// The midpoint of the given bucket, in microseconds:
+static double Fiber_Profiler_Histogram_value(size_t index)
+{
+	if (index < Fiber_Profiler_Histogram_SUB_COUNT) return index + 0.5;
+	
+	unsigned shift = (unsigned)(index >> Fiber_Profiler_Histogram_SUB_BITS) - 1;
+	uint64_t lower = (uint64_t)(Fiber_Profiler_Histogram_SUB_COUNT + (index & (Fiber_Profiler_Histogram_SUB_COUNT - 1))) << shift;
+	uint64_t width = (uint64_t)1 << shift;
+	
+	return lower + width / 2.0;
+}
+
+double Fiber_Profiler_Histogram_percentile(const struct Fiber_Profiler_Histogram *histogram, double fraction)
+{
+	if (histogram->count == 0) return 0;
+	
+	// The rank of the requested duration, counting from 1:
+	uint64_t rank = (uint64_t)(fraction * histogram->count + 0.5);
+	if (rank < 1) rank = 1;
+	if (rank > histogram->count) rank = histogram->count;
+	
+	uint64_t total = 0;
+	
+	for (size_t i = 0; i < Fiber_Profiler_Histogram_BUCKETS; i += 1) {
+		total += histogram->buckets[i];
+		
+		if (total >= rank) {
+			return Fiber_Profiler_Histogram_value(i) / 1e6;
+		}
+	}
+	
+	return Fiber_Profiler_Histogram_value(Fiber_Profiler_Histogram_BUCKETS - 1) / 1e6;
+}
+
+void Fiber_Profiler_Histogram_Table_initialize(struct Fiber_Profiler_Histogram_Table *table, size_t maximum)
+{
+	table->entries = NULL;
+	table->size = 0;
+	table->capacity = 0;
+	table->maximum = maximum;
+	
+	Fiber_Profiler_Map_initialize(&table->indexes);
+}
+
+void Fiber_Profiler_Histogram_Table_free(struct Fiber_Profiler_Histogram_Table *table)
+{
+	if (table->entries) {
+		free(table->entries);
+		table->entries = NULL;
+	}
+	
+	table->size = table->capacity = 0;
+	
+	Fiber_Profiler_Map_free(&table->indexes);
+}
+
+size_t Fiber_Profiler_Histogram_Table_memory_size(const struct Fiber_Profiler_Histogram_Table *table)
+{
+	return table->capacity * sizeof(struct Fiber_Profiler_Histogram_Entry) + Fiber_Profiler_Map_memory_size(&table->indexes);
+}
+
+void Fiber_Profiler_Histogram_Table_clear(struct Fiber_Profiler_Histogram_Table *table)
+{
+	Fiber_Profiler_Map_clear(&table->indexes);
+	
+	table->size = 0;
+}
+
+struct Fiber_Profiler_Histogram_Entry *Fiber_Profiler_Histogram_Table_entry(struct Fiber_Profiler_Histogram_Table *table, uint32_t key)
+{
+	uint32_t index;
+	
+	if (Fiber_Profiler_Map_lookup(&table->indexes, key, &index)) {
+		return &table->entries[index];
+	}
+	
+	if (table->size >= table->maximum) {
+		return NULL;
+	}
+	
+	if (table->size == table->capacity) {
+		size_t capacity = table->capacity ? table->capacity * 2 : 16;
+		if (capacity > table->maximum) capacity = table->maximum;
+		
+		struct Fiber_Profiler_Histogram_Entry *entries = realloc(table->entries, capacity * sizeof(struct Fiber_Profiler_Histogram_Entry));
+		
+		if (entries == NULL) return NULL;
+		
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+	
+	index = (uint32_t)table->size;
+	
+	if (Fiber_Profiler_Map_insert(&table->indexes, key, index)) {
+		return NULL;
+	}
+	
+	struct Fiber_Profiler_Histogram_Entry *entry = &table->entries[index];
+	
+	entry->key = key;
+	entry->duration = 0;
+	entry->maximum = 0;
+	Fiber_Profiler_Histogram_clear(&entry->histogram);
+	
+	table->size += 1;
+	
+	return entry;
+}
@@ -0,0 +1,102 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a fixed size log-linear histogram of durations, which can be merged and queried for percentiles in constant memory. Each power of two (in microseconds) is split into a number of linear sub-buckets, so the relative error of any percentile is bounded by the width of a sub-bucket.
+
+enum {
+	// Each power of two is split into 2^3 = 8 sub-buckets, giving a relative error of at most 12.5%:
+	Fiber_Profiler_Histogram_SUB_BITS = 3,
+	Fiber_Profiler_Histogram_SUB_COUNT = 1 << Fiber_Profiler_Histogram_SUB_BITS,
+	
+	// Which covers durations up to 2^34 microseconds (~4.7 hours); longer durations are counted in the last bucket:
+	Fiber_Profiler_Histogram_BUCKETS = 256,
+};
+
+struct Fiber_Profiler_Histogram {
+	uint64_t count;
+	uint32_t buckets[Fiber_Profiler_Histogram_BUCKETS];
+};
+
+void Fiber_Profiler_Histogram_clear(struct Fiber_Profiler_Histogram *histogram);
+
+// Add the counts of `other` into `histogram`.
+void Fiber_Profiler_Histogram_merge(struct Fiber_Profiler_Histogram *histogram, const struct Fiber_Profiler_Histogram *other);
+
+// The duration in seconds below which the given fraction (between 0 and 1) of durations fall, or 0 if the histogram is empty.
+double Fiber_Profiler_Histogram_percentile(const struct Fiber_Profiler_Histogram *histogram, double fraction);
+
+static inline size_t Fiber_Profiler_Histogram_index(uint64_t microseconds)
+{
+	if (microseconds < Fiber_Profiler_Histogram_SUB_COUNT) return (size_t)microseconds;
+	
+	unsigned shift = (63 - __builtin_clzll(microseconds)) - Fiber_Profiler_Histogram_SUB_BITS;
+	size_t index = ((size_t)(shift + 1) << Fiber_Profiler_Histogram_SUB_BITS) + ((microseconds >> shift) & (Fiber_Profiler_Histogram_SUB_COUNT - 1));
+	
+	if (index >= Fiber_Profiler_Histogram_BUCKETS) {
+		return Fiber_Profiler_Histogram_BUCKETS - 1;
+	}
+	
+	return index;
+}
+
+// Add a duration in seconds to the histogram.
+static inline void Fiber_Profiler_Histogram_add(struct Fiber_Profiler_Histogram *histogram, double duration)
+{
+	uint64_t microseconds = duration > 0 ? (uint64_t)(duration * 1e6) : 0;
+	
+	histogram->buckets[Fiber_Profiler_Histogram_index(microseconds)] += 1;
+	histogram->count += 1;
+}
+
+// A histogram of the durations of one location, along with their total and maximum.
+struct Fiber_Profiler_Histogram_Entry {
+	uint32_t key;
+	
+	double duration;
+	double maximum;
+	
+	struct Fiber_Profiler_Histogram histogram;
+};
+
+// Provides a table of histograms, keyed by a 32-bit identifier (e.g. a frame), holding at most `maximum` entries so that memory usage is bounded.
+struct Fiber_Profiler_Histogram_Table {
+	struct Fiber_Profiler_Histogram_Entry *entries;
+	size_t size;
+	size_t capacity;
+	
+	size_t maximum;
+	
+	// Maps the key to the index of the entry:
+	struct Fiber_Profiler_Map indexes;
+};
+
+void Fiber_Profiler_Histogram_Table_initialize(struct Fiber_Profiler_Histogram_Table *table, size_t maximum);
+void Fiber_Profiler_Histogram_Table_free(struct Fiber_Profiler_Histogram_Table *table);
+
+size_t Fiber_Profiler_Histogram_Table_memory_size(const struct Fiber_Profiler_Histogram_Table *table);
+
+// Remove all entries, retaining the allocated capacity.
+void Fiber_Profiler_Histogram_Table_clear(struct Fiber_Profiler_Histogram_Table *table);
+
+// Find or add the entry for the given key. Returns NULL if the table is full.
+struct Fiber_Profiler_Histogram_Entry *Fiber_Profiler_Histogram_Table_entry(struct Fiber_Profiler_Histogram_Table *table, uint32_t key);
+
+// Add a duration in seconds to the histogram for the given key. If the table is full, durations for new keys are ignored.
+static inline void Fiber_Profiler_Histogram_Table_add(struct Fiber_Profiler_Histogram_Table *table, uint32_t key, double duration)
+{
+	struct Fiber_Profiler_Histogram_Entry *entry = Fiber_Profiler_Histogram_Table_entry(table, key);
+	
+	if (entry == NULL) return;
+	
+	entry->duration += duration;
+	if (duration > entry->maximum) entry->maximum = duration;
+	
+	Fiber_Profiler_Histogram_add(&entry->histogram, duration);
+}
@@ -0,0 +1,196 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "latency.h"
+
+ID Fiber_Profiler_Latency_ready_id;
+
+static void Fiber_Profiler_Latency_Wait_initialize(struct Fiber_Profiler_Latency_Wait *wait)
+{
+	wait->latency = 0;
+	wait->fiber = Qnil;
+	wait->annotation = Qnil;
+	wait->blocker = Qnil;
+	wait->blocker_annotation = Qnil;
+	wait->blocker_duration = 0;
+}
+
+void Fiber_Profiler_Latency_initialize(struct Fiber_Profiler_Latency *latency)
+{
+	latency->fiber = Qnil;
+	latency->start_time = 0;
+	latency->since = 0;
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_RUNS; i += 1) {
+		latency->runs[i].fiber = Qnil;
+		latency->runs[i].start_time = latency->runs[i].end_time = 0;
+	}
+	
+	latency->runs_index = 0;
+	
+	Fiber_Profiler_Latency_clear(latency);
+}
+
+void Fiber_Profiler_Latency_restart(struct Fiber_Profiler_Latency *latency, uint64_t since)
+{
+	latency->fiber = Qnil;
+	latency->since = since;
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_RUNS; i += 1) {
+		latency->runs[i].fiber = Qnil;
+		latency->runs[i].start_time = latency->runs[i].end_time = 0;
+	}
+}
+
+void Fiber_Profiler_Latency_clear(struct Fiber_Profiler_Latency *latency)
+{
+	Fiber_Profiler_Histogram_clear(&latency->histogram);
+	latency->total = 0;
+	latency->maximum = 0;
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_WORST; i += 1) {
+		Fiber_Profiler_Latency_Wait_initialize(&latency->worst[i]);
+	}
+	
+	latency->worst_size = 0;
+}
+
+void Fiber_Profiler_Latency_mark(struct Fiber_Profiler_Latency *latency)
+{
+	rb_gc_mark_movable(latency->fiber);
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_RUNS; i += 1) {
+		rb_gc_mark_movable(latency->runs[i].fiber);
+	}
+	
+	for (size_t i = 0; i < latency->worst_size; i += 1) {
+		struct Fiber_Profiler_Latency_Wait *wait = &latency->worst[i];
+		
+		rb_gc_mark_movable(wait->fiber);
+		rb_gc_mark_movable(wait->annotation);
+		rb_gc_mark_movable(wait->blocker);
+		rb_gc_mark_movable(wait->blocker_annotation);
+	}
+}
+
+void Fiber_Profiler_Latency_compact(struct Fiber_Profiler_Latency *latency)
+{
+	latency->fiber = rb_gc_location(latency->fiber);
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_RUNS; i += 1) {
+		latency->runs[i].fiber = rb_gc_location(latency->runs[i].fiber);
+	}
+	
+	for (size_t i = 0; i < latency->worst_size; i += 1) {
+		struct Fiber_Profiler_Latency_Wait *wait = &latency->worst[i];
+		
+		wait->fiber = rb_gc_location(wait->fiber);
+		wait->annotation = rb_gc_location(wait->annotation);
+		wait->blocker = rb_gc_location(wait->blocker);
+		wait->blocker_annotation = rb_gc_location(wait->blocker_annotation);
+	}
+}
+
+static ID Fiber_Profiler_Latency_annotation_id;
+
+static VALUE Fiber_Profiler_Latency_annotation(VALUE fiber)
+{
+	if (!Fiber_Profiler_Latency_annotation_id) {
+		Fiber_Profiler_Latency_annotation_id = rb_intern("@annotation");
+	}
+	
+	return NIL_P(fiber) ? Qnil : rb_attr_get(fiber, Fiber_Profiler_Latency_annotation_id);
+}
+
+// Find the run which overlapped the most with the wait, excluding runs of the waiting fiber itself.
+static struct Fiber_Profiler_Latency_Run *Fiber_Profiler_Latency_blocker(struct Fiber_Profiler_Latency *latency, VALUE fiber, uint64_t ready_time)
+{
+	struct Fiber_Profiler_Latency_Run *blocker = NULL;
+	uint64_t maximum = 0;
+	
+	for (size_t i = 0; i < Fiber_Profiler_Latency_RUNS; i += 1) {
+		struct Fiber_Profiler_Latency_Run *run = &latency->runs[i];
+		
+		if (NIL_P(run->fiber) || run->fiber == fiber || run->end_time <= ready_time) continue;
+		
+		uint64_t start_time = run->start_time > ready_time ? run->start_time : ready_time;
+		uint64_t overlap = run->end_time - start_time;
+		
+		if (overlap > maximum) {
+			maximum = overlap;
+			blocker = run;
+		}
+	}
+	
+	return blocker;
+}
+
+static void Fiber_Profiler_Latency_record(VALUE owner, struct Fiber_Profiler_Latency *latency, VALUE fiber, uint64_t ready_time, uint64_t time)
+{
+	double duration = (time - ready_time) / 1e9;
+	
+	Fiber_Profiler_Histogram_add(&latency->histogram, duration);
+	latency->total += duration;
+	if (duration > latency->maximum) latency->maximum = duration;
+	
+	// Only the worst waits are kept, so most waits don't need to look for the fiber which delayed them:
+	if (latency->worst_size == Fiber_Profiler_Latency_WORST && duration <= latency->worst[Fiber_Profiler_Latency_WORST - 1].latency) {
+		return;
+	}
+	
+	size_t index = latency->worst_size < Fiber_Profiler_Latency_WORST ? latency->worst_size++ : Fiber_Profiler_Latency_WORST - 1;
+	
+	// Insertion sort, moving shorter waits down:
+	while (index > 0 && latency->worst[index - 1].latency < duration) {
+		latency->worst[index] = latency->worst[index - 1];
+		index -= 1;
+	}
+	
+	struct Fiber_Profiler_Latency_Wait *wait = &latency->worst[index];
+	struct Fiber_Profiler_Latency_Run *blocker = Fiber_Profiler_Latency_blocker(latency, fiber, ready_time);
+	
+	wait->latency = duration;
+	RB_OBJ_WRITE(owner, &wait->fiber, fiber);
+	RB_OBJ_WRITE(owner, &wait->annotation, Fiber_Profiler_Latency_annotation(fiber));
+	
+	if (blocker) {
+		RB_OBJ_WRITE(owner, &wait->blocker, blocker->fiber);
+		RB_OBJ_WRITE(owner, &wait->blocker_annotation, Fiber_Profiler_Latency_annotation(blocker->fiber));
+		wait->blocker_duration = (blocker->end_time - blocker->start_time) / 1e9;
+	} else {
+		wait->blocker = Qnil;
+		wait->blocker_annotation = Qnil;
+		wait->blocker_duration = 0;
+	}
+}
+
+void Fiber_Profiler_Latency_switch(VALUE owner, struct Fiber_Profiler_Latency *latency, VALUE fiber, uint64_t time)
+{
+	// The previous fiber has finished running:
+	if (!NIL_P(latency->fiber)) {
+		struct Fiber_Profiler_Latency_Run *run = &latency->runs[latency->runs_index];
+		latency->runs_index = (latency->runs_index + 1) % Fiber_Profiler_Latency_RUNS;
+		
+		RB_OBJ_WRITE(owner, &run->fiber, latency->fiber);
+		run->start_time = latency->start_time;
+		run->end_time = time;
+	}
+	
+	RB_OBJ_WRITE(owner, &latency->fiber, fiber);
+	latency->start_time = time;
+	
+	VALUE ready = rb_attr_get(fiber, Fiber_Profiler_Latency_ready_id);
+	if (NIL_P(ready)) return;
+	
+	rb_ivar_set(fiber, Fiber_Profiler_Latency_ready_id, Qnil);
+	
+	uint64_t ready_time = NUM2ULL(ready);
+	
+	// The mark was left over from before latency was restarted, in which case the fiber could have been waiting for any length of time without being measured:
+	if (ready_time < latency->since) return;
+	
+	// The fiber may have been resumed before it was expected to be ready, e.g. if its sleep was interrupted, in which case it didn't wait at all:
+	if (ready_time < time) {
+		Fiber_Profiler_Latency_record(owner, latency, fiber, ready_time, time);
+	}
+}
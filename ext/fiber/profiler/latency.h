@@ -0,0 +1,77 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+
+#include "histogram.h"
+
+// Measures run queue latency: how long each fiber waits to run once it is ready, e.g. once its sleep has elapsed or it has been unblocked. A fiber is marked as ready (usually by the fiber scheduler) with the time it became ready, and the latency is measured when it is next switched to. Each wait is attributed to the fiber which ran the longest while it was waiting, which is usually the stalled fiber that delayed it.
+
+enum {
+	// The number of recent runs which are kept in order to find the fiber which delayed each wait:
+	Fiber_Profiler_Latency_RUNS = 32,
+	
+	// The number of worst waits which are kept:
+	Fiber_Profiler_Latency_WORST = 10,
+};
+
+// A fiber running between two switches, in nanoseconds of the monotonic clock.
+struct Fiber_Profiler_Latency_Run {
+	VALUE fiber;
+	uint64_t start_time;
+	uint64_t end_time;
+};
+
+struct Fiber_Profiler_Latency_Wait {
+	// The duration in seconds between the fiber becoming ready and it running:
+	double latency;
+	
+	// The fiber which waited, and its annotation at the time:
+	VALUE fiber;
+	VALUE annotation;
+	
+	// The fiber which ran the longest while it was waiting, if any, its annotation at the time, and the duration in seconds of that run:
+	VALUE blocker;
+	VALUE blocker_annotation;
+	double blocker_duration;
+};
+
+struct Fiber_Profiler_Latency {
+	struct Fiber_Profiler_Histogram histogram;
+	double total;
+	double maximum;
+	
+	// The fiber which is currently running, and when it started:
+	VALUE fiber;
+	uint64_t start_time;
+	
+	// When latency was last restarted. Fibers marked as ready before then were never switched to while latency was being measured (e.g. the capture stopped first), so the marks are ignored:
+	uint64_t since;
+	
+	// A ring of the most recent runs:
+	struct Fiber_Profiler_Latency_Run runs[Fiber_Profiler_Latency_RUNS];
+	size_t runs_index;
+	
+	// The worst waits, ordered by latency, longest first:
+	struct Fiber_Profiler_Latency_Wait worst[Fiber_Profiler_Latency_WORST];
+	size_t worst_size;
+};
+
+// The instance variable in which the time a fiber became ready is stored, in nanoseconds of the monotonic clock.
+extern ID Fiber_Profiler_Latency_ready_id;
+
+void Fiber_Profiler_Latency_initialize(struct Fiber_Profiler_Latency *latency);
+
+// Forget the current and recent runs, e.g. when a capture is restarted, keeping the measured latencies. Marks made before the given time are ignored from now on.
+void Fiber_Profiler_Latency_restart(struct Fiber_Profiler_Latency *latency, uint64_t since);
+
+// Discard the measured latencies.
+void Fiber_Profiler_Latency_clear(struct Fiber_Profiler_Latency *latency);
+
+void Fiber_Profiler_Latency_mark(struct Fiber_Profiler_Latency *latency);
+void Fiber_Profiler_Latency_compact(struct Fiber_Profiler_Latency *latency);
+
+// Record a switch to the given fiber. The owner is the object which holds the latency state, which is used for write barriers. If the fiber was marked as ready since latency was restarted, its latency is recorded.
+void Fiber_Profiler_Latency_switch(VALUE owner, struct Fiber_Profiler_Latency *latency, VALUE fiber, uint64_t time);
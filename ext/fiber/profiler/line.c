@@ -0,0 +1,77 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "line.h"
+
+#include <stdlib.h>
+
+void Fiber_Profiler_Line_Table_initialize(struct Fiber_Profiler_Line_Table *table, size_t maximum)
+{
+	table->entries = NULL;
+	table->size = 0;
+	table->capacity = 0;
+	table->maximum = maximum;
+	
+	Fiber_Profiler_Map_initialize(&table->indexes);
+}
+
+void Fiber_Profiler_Line_Table_free(struct Fiber_Profiler_Line_Table *table)
+{
+	if (table->entries) {
+		free(table->entries);
+		table->entries = NULL;
+	}
+	
+	table->size = table->capacity = 0;
+	
+	Fiber_Profiler_Map_free(&table->indexes);
+}
+
+size_t Fiber_Profiler_Line_Table_memory_size(const struct Fiber_Profiler_Line_Table *table)
+{
+	return table->capacity * sizeof(struct Fiber_Profiler_Line_Entry) + Fiber_Profiler_Map_memory_size(&table->indexes);
+}
+
+void Fiber_Profiler_Line_Table_clear(struct Fiber_Profiler_Line_Table *table)
+{
+	Fiber_Profiler_Map_clear(&table->indexes);
+	
+	table->size = 0;
+}
+
+void Fiber_Profiler_Line_Table_add(struct Fiber_Profiler_Line_Table *table, uint64_t key, double duration)
+{
+	uint32_t index;
+	
+	if (!Fiber_Profiler_Map_lookup(&table->indexes, key, &index)) {
+		if (table->size >= table->maximum) return;
+		
+		if (table->size == table->capacity) {
+			size_t capacity = table->capacity ? table->capacity * 2 : 64;
+			if (capacity > table->maximum) capacity = table->maximum;
+			
+			struct Fiber_Profiler_Line_Entry *entries = realloc(table->entries, capacity * sizeof(struct Fiber_Profiler_Line_Entry));
+			
+			if (entries == NULL) return;
+			
+			table->entries = entries;
+			table->capacity = capacity;
+		}
+		
+		index = (uint32_t)table->size;
+		
+		if (Fiber_Profiler_Map_insert(&table->indexes, key, index)) return;
+		
+		struct Fiber_Profiler_Line_Entry *entry = &table->entries[index];
+		entry->key = key;
+		entry->duration = 0;
+		entry->count = 0;
+		
+		table->size += 1;
+	}
+	
+	struct Fiber_Profiler_Line_Entry *entry = &table->entries[index];
+	
+	entry->duration += duration;
+	entry->count += 1;
+}
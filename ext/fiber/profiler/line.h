@@ -0,0 +1,56 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a table of the time spent on each line, keyed by the interned path and the line number, holding at most `maximum` lines so that memory usage is bounded. Unlike calls, each line only needs a counter, so lines can be measured without recording anything per execution.
+
+struct Fiber_Profiler_Line_Entry {
+	uint64_t key;
+	
+	// The total time spent on the line in seconds, and the number of times it was executed:
+	double duration;
+	uint64_t count;
+};
+
+struct Fiber_Profiler_Line_Table {
+	struct Fiber_Profiler_Line_Entry *entries;
+	size_t size;
+	size_t capacity;
+	
+	size_t maximum;
+	
+	// Maps the key to the index of the entry:
+	struct Fiber_Profiler_Map indexes;
+};
+
+static inline uint64_t Fiber_Profiler_Line_key(uint32_t path, int line)
+{
+	return ((uint64_t)path << 32) | (uint32_t)line;
+}
+
+static inline uint32_t Fiber_Profiler_Line_key_path(uint64_t key)
+{
+	return (uint32_t)(key >> 32);
+}
+
+static inline int Fiber_Profiler_Line_key_line(uint64_t key)
+{
+	return (int)(uint32_t)key;
+}
+
+void Fiber_Profiler_Line_Table_initialize(struct Fiber_Profiler_Line_Table *table, size_t maximum);
+void Fiber_Profiler_Line_Table_free(struct Fiber_Profiler_Line_Table *table);
+
+size_t Fiber_Profiler_Line_Table_memory_size(const struct Fiber_Profiler_Line_Table *table);
+
+// Remove all entries, retaining the allocated capacity.
+void Fiber_Profiler_Line_Table_clear(struct Fiber_Profiler_Line_Table *table);
+
+// Add a duration in seconds to the given line. If the table is full, durations for new lines are ignored.
+void Fiber_Profiler_Line_Table_add(struct Fiber_Profiler_Line_Table *table, uint64_t key, double duration);
@@ -0,0 +1,111 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t Fiber_Profiler_Map_DEFAULT_CAPACITY = 64;
+
+void Fiber_Profiler_Map_initialize(struct Fiber_Profiler_Map *map)
+{
+	map->size = 0;
+	map->capacity = 0;
+	
+	map->entries = calloc(Fiber_Profiler_Map_DEFAULT_CAPACITY, sizeof(struct Fiber_Profiler_Map_Entry));
+	
+	if (map->entries) {
+		map->capacity = Fiber_Profiler_Map_DEFAULT_CAPACITY;
+	}
+}
+
+void Fiber_Profiler_Map_free(struct Fiber_Profiler_Map *map)
+{
+	if (map->entries) {
+		free(map->entries);
+		map->entries = NULL;
+	}
+	
+	map->size = map->capacity = 0;
+}
+
+size_t Fiber_Profiler_Map_memory_size(const struct Fiber_Profiler_Map *map)
+{
+	return map->capacity * sizeof(struct Fiber_Profiler_Map_Entry);
+}
+
+void Fiber_Profiler_Map_clear(struct Fiber_Profiler_Map *map)
+{
+	if (map->entries) {
+		memset(map->entries, 0, map->capacity * sizeof(struct Fiber_Profiler_Map_Entry));
+	}
+	
+	map->size = 0;
+}
+
+static struct Fiber_Profiler_Map_Entry *Fiber_Profiler_Map_find(struct Fiber_Profiler_Map_Entry *entries, size_t capacity, uint64_t key)
+{
+	size_t mask = capacity - 1;
+	size_t index = Fiber_Profiler_Map_hash(key) & mask;
+	
+	while (entries[index].used && entries[index].key != key) {
+		index = (index + 1) & mask;
+	}
+	
+	return &entries[index];
+}
+
+int Fiber_Profiler_Map_lookup(const struct Fiber_Profiler_Map *map, uint64_t key, uint32_t *value)
+{
+	if (map->capacity == 0) return 0;
+	
+	struct Fiber_Profiler_Map_Entry *entry = Fiber_Profiler_Map_find(map->entries, map->capacity, key);
+	
+	if (entry->used) {
+		*value = entry->value;
+		return 1;
+	}
+	
+	return 0;
+}
+
+// Double the capacity of the map, keeping the load factor at or below 50%:
+static int Fiber_Profiler_Map_grow(struct Fiber_Profiler_Map *map)
+{
+	size_t capacity = map->capacity ? map->capacity * 2 : Fiber_Profiler_Map_DEFAULT_CAPACITY;
+	struct Fiber_Profiler_Map_Entry *entries = calloc(capacity, sizeof(struct Fiber_Profiler_Map_Entry));
+	
+	if (entries == NULL) return -1;
+	
+	for (size_t i = 0; i < map->capacity; i += 1) {
+		if (map->entries[i].used) {
+			*Fiber_Profiler_Map_find(entries, capacity, map->entries[i].key) = map->entries[i];
+		}
+	}
+	
+	free(map->entries);
+	map->entries = entries;
+	map->capacity = capacity;
+	
+	return 0;
+}
+
+int Fiber_Profiler_Map_insert(struct Fiber_Profiler_Map *map, uint64_t key, uint32_t value)
+{
+	if ((map->size + 1) * 2 > map->capacity) {
+		if (Fiber_Profiler_Map_grow(map)) return -1;
+	}
+	
+	struct Fiber_Profiler_Map_Entry *entry = Fiber_Profiler_Map_find(map->entries, map->capacity, key);
+	
+	if (!entry->used) {
+		entry->used = 1;
+		entry->key = key;
+		map->size += 1;
+	}
+	
+	entry->value = value;
+	
+	return 0;
+}
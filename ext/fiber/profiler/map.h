@@ -0,0 +1,48 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a simple open addressing hash map from 64-bit keys to 32-bit values.
+
+struct Fiber_Profiler_Map_Entry {
+	uint64_t key;
+	uint32_t value;
+	uint32_t used;
+};
+
+struct Fiber_Profiler_Map {
+	struct Fiber_Profiler_Map_Entry *entries;
+	
+	// The number of used entries:
+	size_t size;
+	
+	// The number of entries, which is always a power of two:
+	size_t capacity;
+};
+
+void Fiber_Profiler_Map_initialize(struct Fiber_Profiler_Map *map);
+void Fiber_Profiler_Map_free(struct Fiber_Profiler_Map *map);
+
+size_t Fiber_Profiler_Map_memory_size(const struct Fiber_Profiler_Map *map);
+
+// Remove all entries, retaining the allocated capacity.
+void Fiber_Profiler_Map_clear(struct Fiber_Profiler_Map *map);
+
+// Lookup the value for the given key. Returns 1 and sets `value` if found, otherwise returns 0.
+int Fiber_Profiler_Map_lookup(const struct Fiber_Profiler_Map *map, uint64_t key, uint32_t *value);
+
+// Insert or update the value for the given key. Returns 0 on success, or -1 if memory could not be allocated.
+int Fiber_Profiler_Map_insert(struct Fiber_Profiler_Map *map, uint64_t key, uint32_t value);
+
+static inline uint32_t Fiber_Profiler_Map_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	
+	return (uint32_t)key;
+}
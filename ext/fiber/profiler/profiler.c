@@ -5,6 +5,7 @@
 
 #include "fiber.h"
 #include "capture.h"
+#include "analyzer.h"
 
 void Init_Fiber_Profiler(void)
 {
@@ -17,4 +18,5 @@ void Init_Fiber_Profiler(void)
 	
 	Init_Fiber_Profiler_Fiber(Fiber_Profiler);
 	Init_Fiber_Profiler_Capture(Fiber_Profiler);
+	Init_Fiber_Profiler_Analyzer(Fiber_Profiler);
 }
@@ -0,0 +1,147 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "reservoir.h"
+
+#include <stdlib.h>
+
+void Fiber_Profiler_Reservoir_initialize(struct Fiber_Profiler_Reservoir *reservoir, size_t capacity)
+{
+	reservoir->capacity = capacity;
+	reservoir->size = 0;
+	reservoir->sequence = 0;
+	reservoir->entries = NULL;
+}
+
+void Fiber_Profiler_Reservoir_free(struct Fiber_Profiler_Reservoir *reservoir)
+{
+	if (reservoir->entries) {
+		for (size_t i = 0; i < reservoir->capacity; i += 1) {
+			Fiber_Profiler_Buffer_free(&reservoir->entries[i].report);
+		}
+		
+		free(reservoir->entries);
+		reservoir->entries = NULL;
+	}
+	
+	reservoir->size = 0;
+}
+
+static inline void Fiber_Profiler_Reservoir_swap(struct Fiber_Profiler_Reservoir_Entry *a, struct Fiber_Profiler_Reservoir_Entry *b)
+{
+	struct Fiber_Profiler_Reservoir_Entry entry = *a;
+	*a = *b;
+	*b = entry;
+}
+
+static void Fiber_Profiler_Reservoir_sift_up(struct Fiber_Profiler_Reservoir *reservoir, size_t index)
+{
+	struct Fiber_Profiler_Reservoir_Entry *entries = reservoir->entries;
+	
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+		
+		if (entries[parent].duration <= entries[index].duration) break;
+		
+		Fiber_Profiler_Reservoir_swap(&entries[parent], &entries[index]);
+		index = parent;
+	}
+}
+
+static void Fiber_Profiler_Reservoir_sift_down(struct Fiber_Profiler_Reservoir *reservoir, size_t index)
+{
+	struct Fiber_Profiler_Reservoir_Entry *entries = reservoir->entries;
+	size_t size = reservoir->size;
+	
+	while (1) {
+		size_t smallest = index, left = index * 2 + 1, right = left + 1;
+		
+		if (left < size && entries[left].duration < entries[smallest].duration) smallest = left;
+		if (right < size && entries[right].duration < entries[smallest].duration) smallest = right;
+		
+		if (smallest == index) break;
+		
+		Fiber_Profiler_Reservoir_swap(&entries[smallest], &entries[index]);
+		index = smallest;
+	}
+}
+
+int Fiber_Profiler_Reservoir_insert(struct Fiber_Profiler_Reservoir *reservoir, double duration, const char *data, size_t size)
+{
+	if (reservoir->entries == NULL) {
+		reservoir->entries = calloc(reservoir->capacity, sizeof(struct Fiber_Profiler_Reservoir_Entry));
+		if (reservoir->entries == NULL) return -1;
+	}
+	
+	size_t index;
+	
+	if (reservoir->size < reservoir->capacity) {
+		index = reservoir->size;
+	} else {
+		// Evict the shortest report, reusing its buffer:
+		index = 0;
+	}
+	
+	struct Fiber_Profiler_Reservoir_Entry *entry = &reservoir->entries[index];
+	
+	Fiber_Profiler_Buffer_clear(&entry->report);
+	Fiber_Profiler_Buffer_append(&entry->report, data, size);
+	
+	if (entry->report.failed) {
+		// The evicted report has been overwritten, so the entry must be removed:
+		if (index < reservoir->size) {
+			reservoir->size -= 1;
+			Fiber_Profiler_Reservoir_swap(entry, &reservoir->entries[reservoir->size]);
+			Fiber_Profiler_Reservoir_sift_down(reservoir, index);
+		}
+		
+		return -1;
+	}
+	
+	entry->duration = duration;
+	entry->sequence = reservoir->sequence++;
+	
+	if (index == reservoir->size) {
+		reservoir->size += 1;
+		Fiber_Profiler_Reservoir_sift_up(reservoir, index);
+	} else {
+		Fiber_Profiler_Reservoir_sift_down(reservoir, index);
+	}
+	
+	return 0;
+}
+
+static int Fiber_Profiler_Reservoir_compare(const void *a, const void *b)
+{
+	const struct Fiber_Profiler_Reservoir_Entry *x = a, *y = b;
+	
+	if (x->sequence < y->sequence) return -1;
+	if (x->sequence > y->sequence) return 1;
+	
+	return 0;
+}
+
+void Fiber_Profiler_Reservoir_sort(struct Fiber_Profiler_Reservoir *reservoir)
+{
+	if (reservoir->size > 1) {
+		qsort(reservoir->entries, reservoir->size, sizeof(struct Fiber_Profiler_Reservoir_Entry), Fiber_Profiler_Reservoir_compare);
+	}
+}
+
+void Fiber_Profiler_Reservoir_clear(struct Fiber_Profiler_Reservoir *reservoir)
+{
+	reservoir->size = 0;
+}
+
+size_t Fiber_Profiler_Reservoir_memory_size(const struct Fiber_Profiler_Reservoir *reservoir)
+{
+	if (reservoir->entries == NULL) return 0;
+	
+	size_t size = reservoir->capacity * sizeof(struct Fiber_Profiler_Reservoir_Entry);
+	
+	for (size_t i = 0; i < reservoir->capacity; i += 1) {
+		size += reservoir->entries[i].report.capacity;
+	}
+	
+	return size;
+}
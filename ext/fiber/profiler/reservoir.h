@@ -0,0 +1,58 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "buffer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a bounded reservoir of the worst (longest) reports seen since it was last cleared. The reports are kept in a min-heap on duration, so a report only needs to be printed if it is longer than the shortest report already retained. The buffer of each entry is reused when it is evicted, so once the reservoir is full, retaining a report does not allocate.
+
+struct Fiber_Profiler_Reservoir_Entry {
+	double duration;
+	
+	// The order in which the reports were retained, so that they can be written in the order they happened:
+	uint64_t sequence;
+	
+	struct Fiber_Profiler_Buffer report;
+};
+
+struct Fiber_Profiler_Reservoir {
+	// The maximum number of reports to retain, or 0 if every report is written immediately.
+	size_t capacity;
+	
+	// The number of reports currently retained.
+	size_t size;
+	
+	uint64_t sequence;
+	
+	// Allocated on first use:
+	struct Fiber_Profiler_Reservoir_Entry *entries;
+};
+
+void Fiber_Profiler_Reservoir_initialize(struct Fiber_Profiler_Reservoir *reservoir, size_t capacity);
+void Fiber_Profiler_Reservoir_free(struct Fiber_Profiler_Reservoir *reservoir);
+
+// Whether a report with the given duration would be retained.
+static inline int Fiber_Profiler_Reservoir_accept_p(const struct Fiber_Profiler_Reservoir *reservoir, double duration)
+{
+	return reservoir->size < reservoir->capacity || duration > reservoir->entries[0].duration;
+}
+
+static inline int Fiber_Profiler_Reservoir_full_p(const struct Fiber_Profiler_Reservoir *reservoir)
+{
+	return reservoir->size == reservoir->capacity;
+}
+
+// Retain a copy of the report, evicting the shortest report if the reservoir is full (which the caller should check using `Fiber_Profiler_Reservoir_full_p`, if it needs to count evictions). Returns 0 on success, or -1 if memory could not be allocated, in which case the report is not retained.
+int Fiber_Profiler_Reservoir_insert(struct Fiber_Profiler_Reservoir *reservoir, double duration, const char *data, size_t size);
+
+// Sort the retained reports into the order in which they were retained, after which `entries[0..size]` can be iterated. The reservoir must be cleared afterwards, as it is no longer a heap.
+void Fiber_Profiler_Reservoir_sort(struct Fiber_Profiler_Reservoir *reservoir);
+
+// Discard all retained reports, keeping their buffers for reuse.
+void Fiber_Profiler_Reservoir_clear(struct Fiber_Profiler_Reservoir *reservoir);
+
+size_t Fiber_Profiler_Reservoir_memory_size(const struct Fiber_Profiler_Reservoir *reservoir);
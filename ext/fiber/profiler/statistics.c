@@ -0,0 +1,55 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "statistics.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+void Fiber_Profiler_Statistics_initialize(struct Fiber_Profiler_Statistics *statistics)
+{
+	memset(statistics, 0, sizeof(*statistics));
+	
+	memcpy(statistics->magic, "FPST", 4);
+	statistics->version = Fiber_Profiler_Statistics_VERSION;
+	statistics->fields = Fiber_Profiler_Statistics_FIELDS;
+	statistics->pid = (uint32_t)getpid();
+}
+
+struct Fiber_Profiler_Statistics *Fiber_Profiler_Statistics_map(const char *path)
+{
+	int descriptor = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (descriptor < 0) return NULL;
+	
+	if (ftruncate(descriptor, sizeof(struct Fiber_Profiler_Statistics))) {
+		int error = errno;
+		close(descriptor);
+		errno = error;
+		
+		return NULL;
+	}
+	
+	void *address = mmap(NULL, sizeof(struct Fiber_Profiler_Statistics), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	
+	// The mapping remains valid after the descriptor is closed:
+	int error = errno;
+	close(descriptor);
+	
+	if (address == MAP_FAILED) {
+		errno = error;
+		return NULL;
+	}
+	
+	struct Fiber_Profiler_Statistics *statistics = address;
+	Fiber_Profiler_Statistics_initialize(statistics);
+	
+	return statistics;
+}
+
+void Fiber_Profiler_Statistics_unmap(struct Fiber_Profiler_Statistics *statistics)
+{
+	munmap(statistics, sizeof(*statistics));
+}
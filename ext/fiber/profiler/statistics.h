@@ -0,0 +1,61 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stdint.h>
+
+// Provides the counters of a capture, which can be memory mapped from a file so that an external agent can read them without entering Ruby. The layout is fixed: a header, followed by `fields` unsigned 64-bit counters in native byte order. New counters are only ever appended. Each counter is updated with a single aligned store, so readers never see a torn value, although counters may be read part way through an update of several of them.
+
+enum {
+	Fiber_Profiler_Statistics_VERSION = 1,
+	Fiber_Profiler_Statistics_FIELDS = 12,
+};
+
+struct Fiber_Profiler_Statistics {
+	// The magic string "FPST", the version of the layout, the number of counters which follow the header, and the process which is updating them:
+	char magic[4];
+	uint32_t version;
+	uint32_t fields;
+	uint32_t pid;
+	
+	// How many fiber context switches have been encountered. Not all of them will be sampled, based on the sample rate.
+	uint64_t switches;
+	
+	// How many samples have been taken, not all of them will be stalls, based on the stall threshold.
+	uint64_t samples;
+	
+	// The number of stalls encountered.
+	uint64_t stalls;
+	
+	// The total and maximum duration of all stalls, in nanoseconds.
+	uint64_t stall_duration;
+	uint64_t stall_duration_maximum;
+	
+	// The number of calls recorded, and of those, the number which were filtered because they were too short.
+	uint64_t calls;
+	uint64_t filtered;
+	
+	// The number of calls which were not recorded because the call log was full.
+	uint64_t truncated;
+	
+	// The peak memory usage of the call log, in bytes.
+	uint64_t memory_maximum;
+	
+	// The number of bytes of output written (or buffered for the background writer), and the number of reports which were dropped because the background writer's buffer was full.
+	uint64_t bytes_written;
+	uint64_t dropped;
+	
+	// The number of stalls which were not written because they were shorter than the stalls retained by the `retain_stalls:` option.
+	uint64_t discarded;
+};
+
+// Initialize the header and reset all the counters.
+void Fiber_Profiler_Statistics_initialize(struct Fiber_Profiler_Statistics *statistics);
+
+// Create (or truncate) the file at the given path, and map a new set of statistics from it. Returns NULL on failure with errno set.
+struct Fiber_Profiler_Statistics *Fiber_Profiler_Statistics_map(const char *path);
+
+// Unmap statistics returned by `Fiber_Profiler_Statistics_map`. The file is left in place, with the final values of the counters.
+void Fiber_Profiler_Statistics_unmap(struct Fiber_Profiler_Statistics *statistics);
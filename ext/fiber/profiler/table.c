@@ -0,0 +1,181 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t Fiber_Profiler_Table_DEFAULT_CAPACITY = 64;
+
+// FNV-1a, which is simple and good enough for file paths and names:
+static uint32_t Fiber_Profiler_Table_hash(const char *string, size_t *length)
+{
+	uint32_t hash = 2166136261u;
+	const char *current = string;
+	
+	while (*current) {
+		hash ^= (unsigned char)*current;
+		hash *= 16777619u;
+		current += 1;
+	}
+	
+	*length = current - string;
+	
+	return hash;
+}
+
+void Fiber_Profiler_Table_initialize(struct Fiber_Profiler_Table *table)
+{
+	table->entries = NULL;
+	table->size = 0;
+	table->capacity = 0;
+	
+	table->slots = NULL;
+	table->slots_capacity = 0;
+	
+	// Reserve the NULL entry, so that a zero index can be used to represent a missing string:
+	table->entries = calloc(Fiber_Profiler_Table_DEFAULT_CAPACITY, sizeof(struct Fiber_Profiler_Table_Entry));
+	if (table->entries) {
+		table->capacity = Fiber_Profiler_Table_DEFAULT_CAPACITY;
+		table->size = 1;
+	}
+	
+	table->slots = calloc(Fiber_Profiler_Table_DEFAULT_CAPACITY * 2, sizeof(uint32_t));
+	if (table->slots) {
+		table->slots_capacity = Fiber_Profiler_Table_DEFAULT_CAPACITY * 2;
+	}
+}
+
+void Fiber_Profiler_Table_free(struct Fiber_Profiler_Table *table)
+{
+	if (table->entries) {
+		for (size_t i = 0; i < table->size; i += 1) {
+			free((void*)table->entries[i].string);
+		}
+		
+		free(table->entries);
+		table->entries = NULL;
+	}
+	
+	if (table->slots) {
+		free(table->slots);
+		table->slots = NULL;
+	}
+	
+	table->size = table->capacity = table->slots_capacity = 0;
+}
+
+size_t Fiber_Profiler_Table_memory_size(const struct Fiber_Profiler_Table *table)
+{
+	size_t size = table->capacity * sizeof(struct Fiber_Profiler_Table_Entry) + table->slots_capacity * sizeof(uint32_t);
+	
+	for (size_t i = 0; i < table->size; i += 1) {
+		if (table->entries[i].string) {
+			size += table->entries[i].length + 1;
+		}
+	}
+	
+	return size;
+}
+
+static void Fiber_Profiler_Table_insert_slot(uint32_t *slots, size_t slots_capacity, uint32_t hash, uint32_t index)
+{
+	size_t mask = slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	while (slots[slot]) {
+		slot = (slot + 1) & mask;
+	}
+	
+	slots[slot] = index + 1;
+}
+
+// Double the size of the hash slots, keeping the load factor at or below 50%:
+static int Fiber_Profiler_Table_rehash(struct Fiber_Profiler_Table *table)
+{
+	size_t slots_capacity = table->slots_capacity * 2;
+	uint32_t *slots = calloc(slots_capacity, sizeof(uint32_t));
+	
+	if (slots == NULL) return -1;
+	
+	for (size_t i = 1; i < table->size; i += 1) {
+		Fiber_Profiler_Table_insert_slot(slots, slots_capacity, table->entries[i].hash, (uint32_t)i);
+	}
+	
+	free(table->slots);
+	table->slots = slots;
+	table->slots_capacity = slots_capacity;
+	
+	return 0;
+}
+
+// Find the index of the given string, or return `Fiber_Profiler_Table_NULL` if it has not been interned.
+static uint32_t Fiber_Profiler_Table_find(const struct Fiber_Profiler_Table *table, const char *string, size_t length, uint32_t hash)
+{
+	size_t mask = table->slots_capacity - 1;
+	size_t slot = hash & mask;
+	
+	while (table->slots[slot]) {
+		struct Fiber_Profiler_Table_Entry *entry = &table->entries[table->slots[slot] - 1];
+		
+		if (entry->hash == hash && entry->length == length && memcmp(entry->string, string, length) == 0) {
+			return table->slots[slot] - 1;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	return Fiber_Profiler_Table_NULL;
+}
+
+uint32_t Fiber_Profiler_Table_lookup(const struct Fiber_Profiler_Table *table, const char *string)
+{
+	if (string == NULL || table->slots == NULL) return Fiber_Profiler_Table_NULL;
+	
+	size_t length;
+	uint32_t hash = Fiber_Profiler_Table_hash(string, &length);
+	
+	return Fiber_Profiler_Table_find(table, string, length, hash);
+}
+
+uint32_t Fiber_Profiler_Table_intern(struct Fiber_Profiler_Table *table, const char *string)
+{
+	if (string == NULL || table->slots == NULL) return Fiber_Profiler_Table_NULL;
+	
+	size_t length;
+	uint32_t hash = Fiber_Profiler_Table_hash(string, &length);
+	
+	uint32_t index = Fiber_Profiler_Table_find(table, string, length, hash);
+	if (index != Fiber_Profiler_Table_NULL) return index;
+	
+	// The string was not found, so we need to add it:
+	if ((table->size + 1) * 2 > table->slots_capacity) {
+		if (Fiber_Profiler_Table_rehash(table)) return Fiber_Profiler_Table_NULL;
+	}
+	
+	if (table->size == table->capacity) {
+		size_t capacity = table->capacity * 2;
+		struct Fiber_Profiler_Table_Entry *entries = realloc(table->entries, capacity * sizeof(struct Fiber_Profiler_Table_Entry));
+		
+		if (entries == NULL) return Fiber_Profiler_Table_NULL;
+		
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+	
+	char *copy = malloc(length + 1);
+	if (copy == NULL) return Fiber_Profiler_Table_NULL;
+	memcpy(copy, string, length + 1);
+	
+	index = (uint32_t)table->size;
+	struct Fiber_Profiler_Table_Entry *entry = &table->entries[index];
+	entry->string = copy;
+	entry->length = length;
+	entry->hash = hash;
+	table->size += 1;
+	
+	Fiber_Profiler_Table_insert_slot(table->slots, table->slots_capacity, hash, index);
+	
+	return index;
+}
@@ -0,0 +1,52 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a table of interned strings, each identified by a small, stable index. Strings are copied once when they are first interned and are only released when the table itself is freed.
+
+// The index of the NULL string, which is always present in the table.
+enum {
+	Fiber_Profiler_Table_NULL = 0,
+};
+
+struct Fiber_Profiler_Table_Entry {
+	const char *string;
+	size_t length;
+	uint32_t hash;
+};
+
+struct Fiber_Profiler_Table {
+	// The interned strings, indexed by their identifier:
+	struct Fiber_Profiler_Table_Entry *entries;
+	size_t size;
+	size_t capacity;
+	
+	// An open addressing hash table of (index + 1), where 0 indicates an empty slot:
+	uint32_t *slots;
+	size_t slots_capacity;
+};
+
+void Fiber_Profiler_Table_initialize(struct Fiber_Profiler_Table *table);
+void Fiber_Profiler_Table_free(struct Fiber_Profiler_Table *table);
+
+size_t Fiber_Profiler_Table_memory_size(const struct Fiber_Profiler_Table *table);
+
+// Intern the given string, returning its index. Returns `Fiber_Profiler_Table_NULL` if the string is NULL or could not be interned.
+uint32_t Fiber_Profiler_Table_intern(struct Fiber_Profiler_Table *table, const char *string);
+
+// Find the index of the given string without interning it. Returns `Fiber_Profiler_Table_NULL` if the string is NULL or has not been interned.
+uint32_t Fiber_Profiler_Table_lookup(const struct Fiber_Profiler_Table *table, const char *string);
+
+// Get the string for the given index, which may be NULL.
+static inline const char *Fiber_Profiler_Table_get(const struct Fiber_Profiler_Table *table, uint32_t index)
+{
+	if (index < table->size) {
+		return table->entries[index].string;
+	}
+	
+	return NULL;
+}
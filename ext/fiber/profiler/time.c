@@ -3,6 +3,8 @@
 
 #include "time.h"
 
+#include <string.h>
+
 void Fiber_Profiler_Time_elapsed(const struct timespec* start, const struct timespec* stop, struct timespec *duration)
 {
 	if ((stop->tv_nsec - start->tv_nsec) < 0) {
@@ -13,3 +15,82 @@ void Fiber_Profiler_Time_elapsed(const struct timespec* start, const struct time
 		duration->tv_nsec = stop->tv_nsec - start->tv_nsec;
 	}
 }
+
+double Fiber_Profiler_Time_tsc_period = 0;
+
+static const char *Fiber_Profiler_Time_clock_names[] = {
+	[Fiber_Profiler_Time_CLOCK_MONOTONIC] = "monotonic",
+	[Fiber_Profiler_Time_CLOCK_COARSE] = "coarse",
+	[Fiber_Profiler_Time_CLOCK_TSC] = "tsc",
+};
+
+int Fiber_Profiler_Time_clock_parse(const char *name)
+{
+	for (int clock = 0; clock < (int)(sizeof(Fiber_Profiler_Time_clock_names) / sizeof(*Fiber_Profiler_Time_clock_names)); clock += 1) {
+		if (strcmp(name, Fiber_Profiler_Time_clock_names[clock]) == 0) {
+			return clock;
+		}
+	}
+	
+	return -1;
+}
+
+const char *Fiber_Profiler_Time_clock_name(enum Fiber_Profiler_Time_Clock clock)
+{
+	return Fiber_Profiler_Time_clock_names[clock];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+// Whether the time stamp counter runs at a constant rate regardless of power state, and is therefore usable as a clock:
+static int Fiber_Profiler_Time_tsc_invariant_p(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return 0;
+	
+	return (edx & (1 << 8)) != 0;
+}
+
+// Measure the time stamp counter against `CLOCK_MONOTONIC` over a short interval:
+static double Fiber_Profiler_Time_tsc_calibrate(void)
+{
+	struct timespec start, stop, interval = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t start_ticks = __rdtsc();
+	
+	nanosleep(&interval, NULL);
+	
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	uint64_t stop_ticks = __rdtsc();
+	
+	if (stop_ticks <= start_ticks) return 0;
+	
+	return Fiber_Profiler_Time_delta(&start, &stop) / (stop_ticks - start_ticks);
+}
+#endif
+
+enum Fiber_Profiler_Time_Clock Fiber_Profiler_Time_clock_initialize(enum Fiber_Profiler_Time_Clock clock)
+{
+	switch (clock) {
+		case Fiber_Profiler_Time_CLOCK_TSC:
+#if defined(__x86_64__) || defined(__i386__)
+			if (Fiber_Profiler_Time_tsc_period == 0 && Fiber_Profiler_Time_tsc_invariant_p()) {
+				Fiber_Profiler_Time_tsc_period = Fiber_Profiler_Time_tsc_calibrate();
+			}
+			
+			if (Fiber_Profiler_Time_tsc_period > 0) return clock;
+#endif
+			return Fiber_Profiler_Time_CLOCK_MONOTONIC;
+		case Fiber_Profiler_Time_CLOCK_COARSE:
+#ifdef CLOCK_MONOTONIC_COARSE
+			return clock;
+#else
+			return Fiber_Profiler_Time_CLOCK_MONOTONIC;
+#endif
+		default:
+			return Fiber_Profiler_Time_CLOCK_MONOTONIC;
+	}
+}
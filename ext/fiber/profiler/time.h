@@ -5,6 +5,11 @@
 
 #include <ruby.h>
 #include <time.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 void Fiber_Profiler_Time_elapsed(const struct timespec* start, const struct timespec* stop, struct timespec *duration);
 
@@ -38,3 +43,61 @@ static inline double Fiber_Profiler_Time_delta_current(const struct timespec *st
 
 #define Fiber_Profiler_TIME_PRINTF_TIMESPEC "%.3g"
 #define Fiber_Profiler_TIME_PRINTF_TIMESPEC_ARGUMENTS(ts) ((double)(ts).tv_sec + (ts).tv_nsec / 1e9)
+
+#pragma mark - Clocks
+
+// The clocks which can be used for timestamps. Timestamps are stored as 64-bit ticks of the clock, and only converted to seconds when computing durations.
+enum Fiber_Profiler_Time_Clock {
+	// `CLOCK_MONOTONIC`, in nanoseconds.
+	Fiber_Profiler_Time_CLOCK_MONOTONIC = 0,
+	
+	// `CLOCK_MONOTONIC_COARSE`, in nanoseconds, which is cheaper to read but only updated every few milliseconds. It's good enough for detecting stalls, but not for timing individual calls.
+	Fiber_Profiler_Time_CLOCK_COARSE = 1,
+	
+	// The invariant time stamp counter, which is read without a system call, and calibrated against `CLOCK_MONOTONIC`.
+	Fiber_Profiler_Time_CLOCK_TSC = 2,
+};
+
+// The duration of a single time stamp counter tick in seconds, or 0 if it has not been calibrated.
+extern double Fiber_Profiler_Time_tsc_period;
+
+// Parse the name of a clock, returning -1 if it is unknown.
+int Fiber_Profiler_Time_clock_parse(const char *name);
+
+const char *Fiber_Profiler_Time_clock_name(enum Fiber_Profiler_Time_Clock clock);
+
+// Prepare the given clock for use, calibrating it if required. Returns the clock that will actually be used, which is `CLOCK_MONOTONIC` if the given clock is not supported on this system.
+enum Fiber_Profiler_Time_Clock Fiber_Profiler_Time_clock_initialize(enum Fiber_Profiler_Time_Clock clock);
+
+static inline uint64_t Fiber_Profiler_Time_ticks(enum Fiber_Profiler_Time_Clock clock)
+{
+	struct timespec time;
+	
+	switch (clock) {
+#if defined(__x86_64__) || defined(__i386__)
+		case Fiber_Profiler_Time_CLOCK_TSC:
+			return __rdtsc();
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+		case Fiber_Profiler_Time_CLOCK_COARSE:
+			clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+			break;
+#endif
+		default:
+			clock_gettime(CLOCK_MONOTONIC, &time);
+	}
+	
+	return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// The duration in seconds between two timestamps, which is negative if `stop` is before `start`.
+static inline double Fiber_Profiler_Time_ticks_delta(enum Fiber_Profiler_Time_Clock clock, uint64_t start, uint64_t stop)
+{
+	int64_t ticks = (int64_t)(stop - start);
+	
+	if (clock == Fiber_Profiler_Time_CLOCK_TSC) {
+		return ticks * Fiber_Profiler_Time_tsc_period;
+	}
+	
+	return ticks / 1e9;
+}
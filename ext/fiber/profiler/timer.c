@@ -0,0 +1,121 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "timer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+void Fiber_Profiler_Timer_initialize(struct Fiber_Profiler_Timer *timer)
+{
+	timer->pid = 0;
+	timer->created = 0;
+}
+
+#if defined(HAVE_TIMER_CREATE) && defined(SIGEV_THREAD_ID)
+
+// Older versions of glibc don't expose the thread identifier field by name:
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+int Fiber_Profiler_Timer_create(struct Fiber_Profiler_Timer *timer, int signal, int value)
+{
+	Fiber_Profiler_Timer_delete(timer);
+	
+	struct sigevent event;
+	memset(&event, 0, sizeof(event));
+	
+	// Deliver the signal to this thread specifically, rather than to whichever thread the kernel chooses:
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = signal;
+	event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+	event.sigev_value.sival_int = value;
+	
+	if (timer_create(CLOCK_MONOTONIC, &event, &timer->timer) == -1) {
+		return -1;
+	}
+	
+	timer->pid = getpid();
+	timer->created = 1;
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Timer_timespec(struct timespec *timespec, double seconds)
+{
+	timespec->tv_sec = (time_t)seconds;
+	timespec->tv_nsec = (long)((seconds - timespec->tv_sec) * 1e9);
+}
+
+static void Fiber_Profiler_Timer_set(struct Fiber_Profiler_Timer *timer, double delay, double interval)
+{
+	if (!timer->created || timer->pid != getpid()) return;
+	
+	struct itimerspec value;
+	Fiber_Profiler_Timer_timespec(&value.it_value, delay);
+	Fiber_Profiler_Timer_timespec(&value.it_interval, interval);
+	
+	timer_settime(timer->timer, 0, &value, NULL);
+}
+
+void Fiber_Profiler_Timer_arm(struct Fiber_Profiler_Timer *timer, double interval)
+{
+	// A zero value would disarm the timer instead:
+	if (interval < 1e-9) interval = 1e-9;
+	
+	Fiber_Profiler_Timer_set(timer, interval, interval);
+}
+
+void Fiber_Profiler_Timer_arm_once(struct Fiber_Profiler_Timer *timer, double delay)
+{
+	if (delay < 1e-9) delay = 1e-9;
+	
+	Fiber_Profiler_Timer_set(timer, delay, 0);
+}
+
+void Fiber_Profiler_Timer_disarm(struct Fiber_Profiler_Timer *timer)
+{
+	Fiber_Profiler_Timer_set(timer, 0, 0);
+}
+
+void Fiber_Profiler_Timer_delete(struct Fiber_Profiler_Timer *timer)
+{
+	if (!timer->created) return;
+	
+	// A timer created by the parent process does not exist in the child:
+	if (timer->pid == getpid()) {
+		timer_delete(timer->timer);
+	}
+	
+	timer->created = 0;
+}
+
+#else
+
+int Fiber_Profiler_Timer_create(struct Fiber_Profiler_Timer *timer, int signal, int value)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void Fiber_Profiler_Timer_arm(struct Fiber_Profiler_Timer *timer, double interval)
+{
+}
+
+void Fiber_Profiler_Timer_arm_once(struct Fiber_Profiler_Timer *timer, double delay)
+{
+}
+
+void Fiber_Profiler_Timer_disarm(struct Fiber_Profiler_Timer *timer)
+{
+}
+
+void Fiber_Profiler_Timer_delete(struct Fiber_Profiler_Timer *timer)
+{
+	timer->created = 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+
+// Provides an interval timer which delivers a signal to the thread that created it, so that the thread can be interrupted periodically while it runs, e.g. to sample its call stack.
+
+struct Fiber_Profiler_Timer {
+#if defined(HAVE_TIMER_CREATE) && defined(SIGEV_THREAD_ID)
+	timer_t timer;
+#endif
+
+	// The process which created the timer, as timers do not survive a fork:
+	pid_t pid;
+	
+	// Whether the timer has been created:
+	int created;
+};
+
+void Fiber_Profiler_Timer_initialize(struct Fiber_Profiler_Timer *timer);
+
+// Create a timer which will deliver the given signal to the current thread, with the given value in `si_value.sival_int` so that the handler can tell which timer it came from. Returns 0 on success, or -1 on failure with errno set.
+int Fiber_Profiler_Timer_create(struct Fiber_Profiler_Timer *timer, int signal, int value);
+
+// Deliver the signal every interval seconds, until the timer is disarmed.
+void Fiber_Profiler_Timer_arm(struct Fiber_Profiler_Timer *timer, double interval);
+
+// Deliver the signal once after delay seconds, unless the timer is disarmed first.
+void Fiber_Profiler_Timer_arm_once(struct Fiber_Profiler_Timer *timer, double delay);
+
+void Fiber_Profiler_Timer_disarm(struct Fiber_Profiler_Timer *timer);
+
+void Fiber_Profiler_Timer_delete(struct Fiber_Profiler_Timer *timer);
@@ -0,0 +1,108 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "tree.h"
+
+#include <stdlib.h>
+
+static const size_t Fiber_Profiler_Tree_DEFAULT_CAPACITY = 1024;
+
+static void Fiber_Profiler_Tree_Node_initialize(struct Fiber_Profiler_Tree_Node *node, uint32_t parent, uint32_t frame)
+{
+	node->parent = parent;
+	node->frame = frame;
+	
+	node->first_child = Fiber_Profiler_Tree_NONE;
+	node->next_sibling = Fiber_Profiler_Tree_NONE;
+	
+	node->count = 0;
+	node->duration = 0;
+	node->allocations = 0;
+}
+
+void Fiber_Profiler_Tree_initialize(struct Fiber_Profiler_Tree *tree, size_t maximum)
+{
+	tree->size = 0;
+	tree->capacity = 0;
+	tree->maximum = maximum;
+	
+	tree->nodes = malloc(Fiber_Profiler_Tree_DEFAULT_CAPACITY * sizeof(struct Fiber_Profiler_Tree_Node));
+	
+	if (tree->nodes) {
+		tree->capacity = Fiber_Profiler_Tree_DEFAULT_CAPACITY;
+	}
+	
+	Fiber_Profiler_Map_initialize(&tree->children);
+	
+	Fiber_Profiler_Tree_clear(tree);
+}
+
+void Fiber_Profiler_Tree_free(struct Fiber_Profiler_Tree *tree)
+{
+	if (tree->nodes) {
+		free(tree->nodes);
+		tree->nodes = NULL;
+	}
+	
+	tree->size = tree->capacity = 0;
+	
+	Fiber_Profiler_Map_free(&tree->children);
+}
+
+size_t Fiber_Profiler_Tree_memory_size(const struct Fiber_Profiler_Tree *tree)
+{
+	return tree->capacity * sizeof(struct Fiber_Profiler_Tree_Node) + Fiber_Profiler_Map_memory_size(&tree->children);
+}
+
+void Fiber_Profiler_Tree_clear(struct Fiber_Profiler_Tree *tree)
+{
+	Fiber_Profiler_Map_clear(&tree->children);
+	
+	if (tree->capacity) {
+		Fiber_Profiler_Tree_Node_initialize(&tree->nodes[Fiber_Profiler_Tree_ROOT], Fiber_Profiler_Tree_NONE, 0);
+		tree->size = 1;
+	} else {
+		tree->size = 0;
+	}
+}
+
+uint32_t Fiber_Profiler_Tree_child(struct Fiber_Profiler_Tree *tree, uint32_t parent, uint32_t frame)
+{
+	uint64_t key = ((uint64_t)parent << 32) | frame;
+	uint32_t index;
+	
+	if (Fiber_Profiler_Map_lookup(&tree->children, key, &index)) {
+		return index;
+	}
+	
+	if (tree->size >= tree->maximum) {
+		return parent;
+	}
+	
+	if (tree->size == tree->capacity) {
+		size_t capacity = tree->capacity * 2;
+		struct Fiber_Profiler_Tree_Node *nodes = realloc(tree->nodes, capacity * sizeof(struct Fiber_Profiler_Tree_Node));
+		
+		if (nodes == NULL) return parent;
+		
+		tree->nodes = nodes;
+		tree->capacity = capacity;
+	}
+	
+	index = (uint32_t)tree->size;
+	
+	if (Fiber_Profiler_Map_insert(&tree->children, key, index)) {
+		return parent;
+	}
+	
+	struct Fiber_Profiler_Tree_Node *node = &tree->nodes[index];
+	Fiber_Profiler_Tree_Node_initialize(node, parent, frame);
+	
+	// Add the node to the parent's list of children:
+	node->next_sibling = tree->nodes[parent].first_child;
+	tree->nodes[parent].first_child = index;
+	
+	tree->size += 1;
+	
+	return index;
+}
@@ -0,0 +1,71 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Provides a prefix tree of call paths, where each node is identified by its parent and frame, used to aggregate many samples into a single call graph.
+
+// The index of the root node, which is always present in the tree.
+enum {
+	Fiber_Profiler_Tree_ROOT = 0,
+};
+
+// Indicates the end of a list of children.
+static const uint32_t Fiber_Profiler_Tree_NONE = UINT32_MAX;
+
+struct Fiber_Profiler_Tree_Node {
+	uint32_t parent;
+	uint32_t frame;
+	
+	// The children of this node, as a linked list:
+	uint32_t first_child;
+	uint32_t next_sibling;
+	
+	// The number of calls merged into this node:
+	size_t count;
+	
+	// The total (inclusive) duration of all calls merged into this node:
+	double duration;
+	
+	// The number of objects allocated directly by calls merged into this node, including by their filtered children:
+	size_t allocations;
+};
+
+struct Fiber_Profiler_Tree {
+	struct Fiber_Profiler_Tree_Node *nodes;
+	size_t size;
+	size_t capacity;
+	
+	// The maximum number of nodes, after which new call paths are merged into their nearest existing ancestor:
+	size_t maximum;
+	
+	// Maps (parent, frame) to the index of the child node:
+	struct Fiber_Profiler_Map children;
+};
+
+void Fiber_Profiler_Tree_initialize(struct Fiber_Profiler_Tree *tree, size_t maximum);
+void Fiber_Profiler_Tree_free(struct Fiber_Profiler_Tree *tree);
+
+size_t Fiber_Profiler_Tree_memory_size(const struct Fiber_Profiler_Tree *tree);
+
+// Remove all nodes except the root, retaining the allocated capacity.
+void Fiber_Profiler_Tree_clear(struct Fiber_Profiler_Tree *tree);
+
+// Whether the tree contains any nodes other than the root.
+static inline int Fiber_Profiler_Tree_empty_p(const struct Fiber_Profiler_Tree *tree)
+{
+	return tree->size <= 1;
+}
+
+// Find or add the child of the given parent for the given frame. If the tree is full, the parent is returned instead.
+uint32_t Fiber_Profiler_Tree_child(struct Fiber_Profiler_Tree *tree, uint32_t parent, uint32_t frame);
+
+static inline struct Fiber_Profiler_Tree_Node *Fiber_Profiler_Tree_get(const struct Fiber_Profiler_Tree *tree, uint32_t index)
+{
+	return &tree->nodes[index];
+}
@@ -0,0 +1,381 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "writer.h"
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// How long to wait for a non-blocking descriptor to become writable before checking whether the writer was cancelled, in milliseconds:
+static const int Fiber_Profiler_Writer_POLL_TIMEOUT = 100;
+
+void Fiber_Profiler_Writer_initialize(struct Fiber_Profiler_Writer *writer)
+{
+	writer->buffer = NULL;
+	writer->capacity = 0;
+	
+	writer->head = writer->tail = 0;
+	
+	writer->descriptor = -1;
+	writer->pid = 0;
+	writer->running = 0;
+	writer->cancelled = 0;
+	writer->detached = 0;
+	writer->dropped = 0;
+	writer->failed = writer->reported = 0;
+	writer->waiting = 0;
+	
+	writer->device = 0;
+	writer->inode = 0;
+	writer->references = 0;
+	writer->next = NULL;
+}
+
+// Copy data into the buffer at the given position, which may wrap around:
+static void Fiber_Profiler_Writer_copy_in(struct Fiber_Profiler_Writer *writer, size_t position, const void *data, size_t size)
+{
+	size_t offset = position % writer->capacity;
+	size_t first = writer->capacity - offset;
+	
+	if (first > size) first = size;
+	
+	memcpy(writer->buffer + offset, data, first);
+	memcpy(writer->buffer, (const char *)data + first, size - first);
+}
+
+static void Fiber_Profiler_Writer_copy_out(struct Fiber_Profiler_Writer *writer, size_t position, void *data, size_t size)
+{
+	size_t offset = position % writer->capacity;
+	size_t first = writer->capacity - offset;
+	
+	if (first > size) first = size;
+	
+	memcpy(data, writer->buffer + offset, first);
+	memcpy((char *)data + first, writer->buffer, size - first);
+}
+
+// Write all the data to the descriptor, retrying on partial writes, and waiting for non-blocking descriptors (e.g. pipes and sockets opened by Ruby) to become writable. Returns 0 on success, or -1 if the descriptor failed or the writer was cancelled, as there is nobody to report the error to.
+static int Fiber_Profiler_Writer_write(struct Fiber_Profiler_Writer *writer, const char *data, size_t size)
+{
+	while (size > 0) {
+		if (__atomic_load_n(&writer->cancelled, __ATOMIC_ACQUIRE)) return -1;
+		
+		ssize_t result = write(writer->descriptor, data, size);
+		
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				struct pollfd pollfd = {.fd = writer->descriptor, .events = POLLOUT};
+				poll(&pollfd, 1, Fiber_Profiler_Writer_POLL_TIMEOUT);
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		data += result;
+		size -= result;
+	}
+	
+	return 0;
+}
+
+static void Fiber_Profiler_Writer_free(struct Fiber_Profiler_Writer *writer)
+{
+	free(writer->buffer);
+	free(writer);
+}
+
+static void *Fiber_Profiler_Writer_thread(void *argument)
+{
+	struct Fiber_Profiler_Writer *writer = argument;
+	
+	while (1) {
+		size_t head = writer->head;
+		size_t tail = __atomic_load_n(&writer->tail, __ATOMIC_ACQUIRE);
+		
+		if (head == tail) {
+			pthread_mutex_lock(&writer->mutex);
+			
+			// Announce that we are waiting before checking again, so that the producer will either see that we are waiting, or we will see the data it pushed:
+			__atomic_store_n(&writer->waiting, 1, __ATOMIC_SEQ_CST);
+			tail = __atomic_load_n(&writer->tail, __ATOMIC_SEQ_CST);
+			
+			if (head == tail) {
+				if (!__atomic_load_n(&writer->running, __ATOMIC_ACQUIRE)) {
+					__atomic_store_n(&writer->waiting, 0, __ATOMIC_SEQ_CST);
+					pthread_mutex_unlock(&writer->mutex);
+					break;
+				}
+				
+				pthread_cond_wait(&writer->condition, &writer->mutex);
+			}
+			
+			__atomic_store_n(&writer->waiting, 0, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&writer->mutex);
+			continue;
+		}
+		
+		// Write the next record, which may wrap around the end of the buffer:
+		size_t size;
+		Fiber_Profiler_Writer_copy_out(writer, head, &size, sizeof(size));
+		
+		size_t offset = (head + sizeof(size)) % writer->capacity;
+		size_t first = writer->capacity - offset;
+		
+		if (first > size) first = size;
+		
+		if (Fiber_Profiler_Writer_write(writer, writer->buffer + offset, first) || Fiber_Profiler_Writer_write(writer, writer->buffer, size - first)) {
+			__atomic_add_fetch(&writer->failed, 1, __ATOMIC_RELEASE);
+		}
+		
+		__atomic_store_n(&writer->head, head + sizeof(size) + size, __ATOMIC_RELEASE);
+	}
+	
+	// The flag is set before the writer is told to stop, so it is visible here:
+	if (writer->detached) {
+		pthread_cond_destroy(&writer->condition);
+		pthread_mutex_destroy(&writer->mutex);
+		close(writer->descriptor);
+		
+		Fiber_Profiler_Writer_free(writer);
+	}
+	
+	return NULL;
+}
+
+int Fiber_Profiler_Writer_start(struct Fiber_Profiler_Writer *writer, int descriptor, size_t capacity)
+{
+	if (writer->running) return 0;
+	
+	if (capacity == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	if (writer->capacity != capacity) {
+		free(writer->buffer);
+		writer->capacity = 0;
+		
+		writer->buffer = malloc(capacity);
+		if (writer->buffer == NULL) return -1;
+		
+		writer->capacity = capacity;
+	}
+	
+	writer->descriptor = dup(descriptor);
+	if (writer->descriptor < 0) return -1;
+	
+	writer->head = writer->tail = 0;
+	writer->pid = getpid();
+	writer->waiting = 0;
+	writer->cancelled = 0;
+	
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->condition, NULL);
+	
+	writer->running = 1;
+	
+	int result = pthread_create(&writer->thread, NULL, Fiber_Profiler_Writer_thread, writer);
+	if (result) {
+		writer->running = 0;
+		
+		pthread_cond_destroy(&writer->condition);
+		pthread_mutex_destroy(&writer->mutex);
+		
+		close(writer->descriptor);
+		writer->descriptor = -1;
+		
+		errno = result;
+		return -1;
+	}
+	
+	return 0;
+}
+
+// Tell the writer thread to stop once it has written all buffered data:
+static void Fiber_Profiler_Writer_signal_stop(struct Fiber_Profiler_Writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	__atomic_store_n(&writer->running, 0, __ATOMIC_RELEASE);
+	pthread_cond_signal(&writer->condition);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+// Runs without the GVL, as the descriptor may block for as long as its reader does:
+static void *Fiber_Profiler_Writer_join(void *argument)
+{
+	struct Fiber_Profiler_Writer *writer = argument;
+	
+	pthread_join(writer->thread, NULL);
+	
+	return writer;
+}
+
+// The unblocking function, which discards the buffered data so that the writer thread finishes as soon as possible:
+static void Fiber_Profiler_Writer_cancel(void *argument)
+{
+	struct Fiber_Profiler_Writer *writer = argument;
+	
+	__atomic_store_n(&writer->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+void Fiber_Profiler_Writer_stop(struct Fiber_Profiler_Writer *writer)
+{
+	if (!writer->running) return;
+	
+	if (writer->pid == getpid()) {
+		Fiber_Profiler_Writer_signal_stop(writer);
+		
+		// If an interrupt is already pending, this returns without joining, and the interrupt is handled by the caller later:
+		if (rb_thread_call_without_gvl2(Fiber_Profiler_Writer_join, writer, Fiber_Profiler_Writer_cancel, writer) == NULL) {
+			Fiber_Profiler_Writer_cancel(writer);
+			pthread_join(writer->thread, NULL);
+		}
+		
+		pthread_cond_destroy(&writer->condition);
+		pthread_mutex_destroy(&writer->mutex);
+	} else {
+		// The writer thread does not exist in a forked child process, and the mutex may have been held at the time of the fork, so we just abandon the state inherited from the parent:
+		writer->running = 0;
+	}
+	
+	close(writer->descriptor);
+	writer->descriptor = -1;
+	
+	writer->head = writer->tail = 0;
+}
+
+// The shared writers, which are only accessed while holding the GVL:
+static struct Fiber_Profiler_Writer *Fiber_Profiler_Writer_shared = NULL;
+
+struct Fiber_Profiler_Writer *Fiber_Profiler_Writer_acquire(int descriptor, size_t capacity)
+{
+	pid_t pid = getpid();
+	
+	struct stat status;
+	if (fstat(descriptor, &status)) return NULL;
+	
+	// Writers inherited from the parent process are ignored, as their threads no longer exist:
+	for (struct Fiber_Profiler_Writer *writer = Fiber_Profiler_Writer_shared; writer; writer = writer->next) {
+		if (writer->device == status.st_dev && writer->inode == status.st_ino && writer->pid == pid && writer->running) {
+			writer->references += 1;
+			return writer;
+		}
+	}
+	
+	struct Fiber_Profiler_Writer *writer = malloc(sizeof(struct Fiber_Profiler_Writer));
+	
+	if (writer == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	Fiber_Profiler_Writer_initialize(writer);
+	
+	if (Fiber_Profiler_Writer_start(writer, descriptor, capacity)) {
+		int error = errno;
+		
+		Fiber_Profiler_Writer_free(writer);
+		
+		errno = error;
+		return NULL;
+	}
+	
+	writer->device = status.st_dev;
+	writer->inode = status.st_ino;
+	writer->references = 1;
+	
+	writer->next = Fiber_Profiler_Writer_shared;
+	Fiber_Profiler_Writer_shared = writer;
+	
+	return writer;
+}
+
+// Remove a writer from the shared writers once it has no more users. Returns 1 if it was removed:
+static int Fiber_Profiler_Writer_unshare(struct Fiber_Profiler_Writer *writer)
+{
+	writer->references -= 1;
+	
+	if (writer->references) return 0;
+	
+	for (struct Fiber_Profiler_Writer **link = &Fiber_Profiler_Writer_shared; *link; link = &(*link)->next) {
+		if (*link == writer) {
+			*link = writer->next;
+			break;
+		}
+	}
+	
+	return 1;
+}
+
+size_t Fiber_Profiler_Writer_release(struct Fiber_Profiler_Writer *writer)
+{
+	if (!Fiber_Profiler_Writer_unshare(writer)) return 0;
+	
+	Fiber_Profiler_Writer_stop(writer);
+	
+	size_t failures = Fiber_Profiler_Writer_failures(writer);
+	
+	Fiber_Profiler_Writer_free(writer);
+	
+	return failures;
+}
+
+void Fiber_Profiler_Writer_release_detached(struct Fiber_Profiler_Writer *writer)
+{
+	if (!Fiber_Profiler_Writer_unshare(writer)) return;
+	
+	if (writer->running && writer->pid == getpid()) {
+		writer->detached = 1;
+		pthread_detach(writer->thread);
+		
+		Fiber_Profiler_Writer_signal_stop(writer);
+	} else {
+		Fiber_Profiler_Writer_stop(writer);
+		Fiber_Profiler_Writer_free(writer);
+	}
+}
+
+size_t Fiber_Profiler_Writer_failures(struct Fiber_Profiler_Writer *writer)
+{
+	size_t failed = __atomic_load_n(&writer->failed, __ATOMIC_ACQUIRE);
+	size_t failures = failed - writer->reported;
+	
+	writer->reported = failed;
+	
+	return failures;
+}
+
+int Fiber_Profiler_Writer_push(struct Fiber_Profiler_Writer *writer, const char *data, size_t size)
+{
+	size_t head = __atomic_load_n(&writer->head, __ATOMIC_ACQUIRE);
+	size_t tail = writer->tail;
+	
+	if (sizeof(size) + size > writer->capacity - (tail - head)) {
+		writer->dropped += 1;
+		return 0;
+	}
+	
+	Fiber_Profiler_Writer_copy_in(writer, tail, &size, sizeof(size));
+	Fiber_Profiler_Writer_copy_in(writer, tail + sizeof(size), data, size);
+	
+	__atomic_store_n(&writer->tail, tail + sizeof(size) + size, __ATOMIC_SEQ_CST);
+	
+	// Only take the lock if the writer thread might be waiting:
+	if (__atomic_load_n(&writer->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&writer->mutex);
+		pthread_cond_signal(&writer->condition);
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	
+	return 1;
+}
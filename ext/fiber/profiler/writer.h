@@ -0,0 +1,81 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Provides a background writer, which drains a single-producer/single-consumer ring buffer to a file descriptor on a native thread, so that writing output does not block the event loop or require the GVL. Each record is preceded by its size in the buffer, so that the writer thread knows which records it failed to write.
+
+struct Fiber_Profiler_Writer {
+	// The ring buffer, which is allocated when the writer is started:
+	char *buffer;
+	size_t capacity;
+	
+	// The total number of bytes written into and read out of the buffer. The producer only updates `tail` and the consumer only updates `head`, so they can be accessed without locking:
+	size_t head, tail;
+	
+	// The file descriptor to write to, which is owned by the writer:
+	int descriptor;
+	
+	// The process which started the writer, as the thread does not survive a fork:
+	pid_t pid;
+	
+	// Whether the writer thread is running:
+	int running;
+	
+	// Set if the writer thread should discard any buffered records rather than waiting to write them, e.g. if the thread stopping the writer is interrupted:
+	int cancelled;
+	
+	// Set if the writer was released without waiting for it, in which case the writer thread frees it once it has finished:
+	int detached;
+	
+	// The number of records which were dropped because the buffer was full:
+	size_t dropped;
+	
+	// The number of buffered records which could not be written in full, which is only updated by the writer thread, and the number of those which have been reported by `Fiber_Profiler_Writer_failures`:
+	size_t failed;
+	size_t reported;
+	
+	// Only used to wake up the writer thread when it is waiting for data:
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t condition;
+	int waiting;
+	
+	// For shared writers, the file the writer was acquired for, which is identified by its device and inode rather than its descriptor (which may be reused once it is closed), the number of users, and the next shared writer:
+	dev_t device;
+	ino_t inode;
+	size_t references;
+	struct Fiber_Profiler_Writer *next;
+};
+
+void Fiber_Profiler_Writer_initialize(struct Fiber_Profiler_Writer *writer);
+
+// Start the writer thread, writing to a duplicate of the given file descriptor. Returns 0 on success, or -1 on failure with errno set.
+int Fiber_Profiler_Writer_start(struct Fiber_Profiler_Writer *writer, int descriptor, size_t capacity);
+
+// Stop the writer thread, after it has written all buffered data. The GVL is released while waiting, and if the calling thread is interrupted, any data which has not been written yet is discarded.
+void Fiber_Profiler_Writer_stop(struct Fiber_Profiler_Writer *writer);
+
+// Get a running writer for the file of the given descriptor, starting one if there isn't one already. Writers are shared by everything writing to the same file, so that records are written whole, in order, by a single thread. Returns NULL on failure with errno set. The GVL must be held, as the shared writers are not otherwise synchronized.
+struct Fiber_Profiler_Writer *Fiber_Profiler_Writer_acquire(int descriptor, size_t capacity);
+
+// Release a writer returned by `Fiber_Profiler_Writer_acquire`, stopping and freeing it once it has no more users. Returns the number of records which could not be written and have not been reported yet, if the writer was stopped.
+size_t Fiber_Profiler_Writer_release(struct Fiber_Profiler_Writer *writer);
+
+// Release a writer without waiting for it, e.g. while being garbage collected. If it has no more users, the writer thread writes the buffered data and then frees the writer.
+void Fiber_Profiler_Writer_release_detached(struct Fiber_Profiler_Writer *writer);
+
+// Get the number of buffered records which could not be written since the last call. The GVL must be held, so that shared writers report each failure once.
+size_t Fiber_Profiler_Writer_failures(struct Fiber_Profiler_Writer *writer);
+
+// Append a record, and its size, to the buffer. Shared writers may have several producers, which must hold the GVL so that they do not push concurrently. The record is written in its entirety, or dropped if there is not enough space. Returns 1 if the record was buffered, 0 if it was dropped.
+int Fiber_Profiler_Writer_push(struct Fiber_Profiler_Writer *writer, const char *data, size_t size);
+
+static inline int Fiber_Profiler_Writer_running_p(const struct Fiber_Profiler_Writer *writer)
+{
+	return writer->running;
+}
@@ -5,6 +5,7 @@
 
 require_relative "profiler/version"
 require_relative "profiler/capture"
+require_relative "profiler/scheduler"
 
 module Fiber::Profiler
 	# The default profiler to use, if any.
@@ -16,6 +17,13 @@ module Fiber::Profiler
 		Capture.default
 	end
 	
+	# All captures which are currently running, one per profiled thread. Each thread has its own capture, and {default} captures share the same output, so stall reports can be told apart using their `thread_id`.
+	#
+	# @returns [Array(Capture)]
+	def self.captures
+		Thread.list.filter_map(&:fiber_profiler_capture)
+	end
+	
 	# Execute the given block with the {default} profiler, if any.
 	#
 	# @yields {...} The block to execute.
@@ -32,4 +40,56 @@ module Fiber::Profiler
 			yield
 		end
 	end
+	
+	# The burst which is pending on the thread, if any, which starts at the next fiber switch of the thread.
+	::Thread.attr_accessor :fiber_profiler_burst
+	
+	# Install a signal handler which starts a burst of profiling on every thread when the signal is received, e.g. using `kill -USR2 $PID`. Until then, nothing is profiled and there is no overhead. Ruby runs signal handlers on the main thread, so the handler uses {burst} to ask each thread to start its own burst.
+	#
+	# Set `FIBER_PROFILER_CAPTURE_BURST_SIGNAL` (and optionally `FIBER_PROFILER_CAPTURE_BURST_DURATION`) to install the handler when the profiler is loaded.
+	#
+	# @parameter signal [String | Integer] The signal to trap.
+	# @parameter duration [Numeric] The duration of each burst in seconds.
+	# @parameter options [Hash] The options for each {Capture}, which tracks calls by default.
+	# @returns [Object] The previous handler of the signal.
+	def self.trap(signal = "USR2", duration: 10, **options)
+		::Signal.trap(signal) do
+			self.burst(duration, **options)
+		end
+	end
+	
+	# Ask every thread which isn't already being profiled to start a burst of profiling. A capture profiles the thread which starts it, so each thread starts its own capture at its next fiber switch, and stops it once the given duration has elapsed. Threads which don't switch fibers within the duration are not profiled.
+	#
+	# @parameter duration [Numeric] The duration of each burst in seconds.
+	# @parameter options [Hash] The options for each {Capture}, which tracks calls by default.
+	def self.burst(duration, **options)
+		deadline = ::Process.clock_gettime(::Process::CLOCK_MONOTONIC) + duration
+		
+		::Thread.list.each do |thread|
+			# Don't interfere with a capture which is already running, including a previous burst:
+			next if thread.fiber_profiler_capture
+			
+			# Replace any burst still pending from before:
+			thread.fiber_profiler_burst&.disable
+			
+			trace_point = ::TracePoint.new(:fiber_switch) do
+				trace_point.disable
+				thread.fiber_profiler_burst = nil
+				
+				if ::Process.clock_gettime(::Process::CLOCK_MONOTONIC) < deadline and !thread.fiber_profiler_capture
+					capture = Capture.new(track_calls: true, **options)
+					
+					# The capture's own hook doesn't see the switch which started it:
+					capture.fiber_switch if capture.burst(duration)
+				end
+			end
+			
+			thread.fiber_profiler_burst = trace_point
+			trace_point.enable(target_thread: thread)
+		end
+	end
+	
+	if signal = ENV["FIBER_PROFILER_CAPTURE_BURST_SIGNAL"]
+		self.trap(signal, duration: Float(ENV.fetch("FIBER_PROFILER_CAPTURE_BURST_DURATION", 10)))
+	end
 end
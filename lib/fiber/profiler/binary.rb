@@ -0,0 +1,240 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+module Fiber::Profiler
+	# Support for the compact binary output format, enabled using `format: :binary`.
+	#
+	# The output is a sequence of records, each consisting of a one byte type, a four byte little endian length, and the payload. Integers are BER compressed (as per `pack("w")`) and times are zigzag encoded nanoseconds. Strings are written once, the first time they are referenced, and subsequently referred to by index.
+	#
+	# Captures on different threads may write to the same output, so each capture writes its own stream, and the header, string and stall records carry the identifier of the stream they belong to. Each stream has its own string table.
+	module Binary
+		HEADER = 0
+		STRINGS = 1
+		STALL = 2
+		ANNOTATION = 3
+		
+		MAGIC = "FPRF"
+		VERSION = 2
+		
+		# The fields of each stall, in the order they are written. Each record gives the number of fields it contains, and `allocations` is only written when allocations are tracked.
+		STALL_FIELDS = ["start_time", "duration", "switches", "samples", "stalls", "skipped", "thread_id", "fiber_id", "gc_count", "gc_mark_time", "gc_sweep_time", "allocations"]
+		
+		# The fields of each call, in the order they are written. As with stalls, `allocations` is only written when allocations are tracked.
+		CALL_FIELDS = ["path", "line", "class", "method", "duration", "offset", "nesting", "skipped", "filtered", "self_time", "allocations"]
+		
+		# Fields which are times, and need to be converted from nanoseconds to seconds.
+		TIME_FIELDS = ["start_time", "duration", "offset", "self_time", "gc_mark_time", "gc_sweep_time"]
+		
+		# Fields which are indexes into the string table.
+		STRING_FIELDS = ["path", "class", "method"]
+		
+		# The first two bytes of a gzip member, as written when using `output_compression: :gzip`.
+		GZIP_MAGIC = "\x1f\x8b".b
+		
+		# Decompress a sequence of gzip members, as written when using `output_compression: :gzip`. A truncated or corrupt member at the end is decompressed as far as possible.
+		#
+		# @parameter data [String] The compressed data.
+		# @returns [String] The decompressed data.
+		def self.inflate(data)
+			require "zlib"
+			require "stringio"
+			
+			output = String.new(encoding: Encoding::BINARY)
+			
+			while data and !data.empty?
+				inflate = Zlib::Inflate.new(Zlib::MAX_WBITS + 16)
+				
+				begin
+					output << inflate.inflate(data)
+					
+					# Each report is a separate member, so continue with whatever follows this one:
+					data = inflate.finished? ? data.byteslice(inflate.total_in..) : nil
+				rescue Zlib::Error
+					data = nil
+				ensure
+					inflate.close
+				end
+			end
+			
+			return output
+		end
+		
+		# Reads stalls from a binary output stream.
+		class Reader
+			include Enumerable
+			
+			# Open the given path and read all stalls from it.
+			#
+			# @parameter path [String] The path to the binary output file.
+			# @yields {|stall| ...} Each stall, as a hash in the same format as the JSON output.
+			def self.foreach(path, &block)
+				return to_enum(:foreach, path) unless block_given?
+				
+				File.open(path, "rb") do |file|
+					if file.read(2) == GZIP_MAGIC
+						file.rewind
+						file = StringIO.new(Binary.inflate(file.read))
+					else
+						file.rewind
+					end
+					
+					self.new(file).each(&block)
+				end
+			end
+			
+			# Create a new reader for the given input stream.
+			#
+			# @parameter input [IO] The input stream to read from.
+			def initialize(input)
+				@input = input
+				@version = VERSION
+				@strings = {}
+			end
+			
+			# @attribute [Hash(Integer, Array(String | Nil))] The strings read so far, for each stream.
+			attr :strings
+			
+			# Read each stall from the input, in order. Incomplete records at the end of the input are ignored, so that files that are still being written can be read.
+			#
+			# @yields {|stall| ...} Each stall, as a hash in the same format as the JSON output.
+			def each
+				return to_enum unless block_given?
+				
+				annotation = nil
+				
+				while header = @input.read(5) and header.bytesize == 5
+					type, length = header.unpack("CL<")
+					payload = @input.read(length)
+					
+					break unless payload and payload.bytesize == length
+					
+					case type
+					when HEADER
+						read_header(payload)
+					when STRINGS
+						read_strings(payload)
+					when STALL
+						stall = read_stall(payload)
+						
+						# An annotation applies only to the stall that immediately follows it:
+						if annotation
+							stall["annotation"] = annotation
+							annotation = nil
+						end
+						
+						yield stall
+					when ANNOTATION
+						annotation = payload.force_encoding(Encoding::UTF_8)
+					end
+				end
+			end
+			
+			private
+			
+			def read_header(payload)
+				magic = payload.byteslice(0, 4)
+				
+				unless magic == MAGIC
+					raise ArgumentError, "Invalid binary profile header: #{magic.inspect}!"
+				end
+				
+				@version = payload.unpack1("w", offset: 4)
+				
+				if @version > VERSION
+					raise ArgumentError, "Unsupported binary profile version: #{@version}!"
+				end
+				
+				# Version 1 streams have no identifier, and can't be shared:
+				stream = @version >= 2 ? payload.unpack1("w", offset: 4 + integer_size(@version)) : 0
+				
+				@strings[stream] = [nil]
+			end
+			
+			def read_strings(payload)
+				offset = 0
+				
+				if @version >= 2
+					stream = payload.unpack1("w")
+					offset += integer_size(stream)
+				else
+					stream = 0
+				end
+				
+				index, count = payload.unpack("ww", offset: offset)
+				offset += integer_size(index) + integer_size(count)
+				
+				strings = (@strings[stream] ||= [nil])
+				
+				count.times do |i|
+					length = payload.unpack1("w", offset: offset)
+					offset += integer_size(length)
+					
+					strings[index + i] = payload.byteslice(offset, length).force_encoding(Encoding::UTF_8)
+					offset += length
+				end
+			end
+			
+			def read_stall(payload)
+				integers = payload.unpack("w*")
+				offset = 0
+				
+				if @version >= 2
+					strings = @strings.fetch(integers[offset], [nil])
+					offset += 1
+				else
+					strings = @strings.fetch(0, [nil])
+				end
+				
+				stall_fields = integers[offset]
+				stall = decode(STALL_FIELDS, integers, offset + 1, stall_fields, strings)
+				offset += 1 + stall_fields
+				
+				count = integers[offset]
+				call_fields = integers[offset + 1]
+				offset += 2
+				
+				stall["calls"] = Array.new(count) do |i|
+					decode(CALL_FIELDS, integers, offset + i * call_fields, call_fields, strings)
+				end
+				
+				stall.delete("skipped") if stall["skipped"] == 0
+				
+				return stall
+			end
+			
+			def decode(fields, integers, offset, count, strings)
+				result = {}
+				
+				fields.each_with_index do |field, index|
+					break if index >= count
+					
+					value = integers[offset + index]
+					
+					if TIME_FIELDS.include?(field)
+						value = ((value >> 1) ^ -(value & 1)) / 1_000_000_000.0
+					elsif STRING_FIELDS.include?(field)
+						value = strings[value]
+					end
+					
+					result[field] = value
+				end
+				
+				return result
+			end
+			
+			# The number of bytes used to encode the given integer.
+			def integer_size(value)
+				size = 1
+				
+				while value >= 0x80
+					value >>= 7
+					size += 1
+				end
+				
+				return size
+			end
+		end
+	end
+end
@@ -10,6 +10,11 @@ module Fiber::Profiler
 	# Thread-local storage for the active profiler capture.
 	::Thread.attr_accessor :fiber_profiler_capture
 	
+	# Fiber annotations, included in stall reports to identify the work the fiber was doing, e.g. a request id. This is compatible with the `fiber-annotation` gem, which also stores the annotation in `@annotation`.
+	unless ::Fiber.method_defined?(:annotation)
+		::Fiber.attr_accessor :annotation
+	end
+	
 	# Hook into Process._fork to handle fork events automatically.
 	::Process.singleton_class.prepend(ForkHandler)
 	
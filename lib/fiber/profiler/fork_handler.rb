@@ -12,18 +12,42 @@ module Fiber::Profiler
 			result = super
 			
 			if result.zero?
-				# Child process: disable the profiler for the current thread
+				# Child process: restart or disable the profiler for the current thread
 				if capture = Thread.current.fiber_profiler_capture
-					begin
-						capture.stop
-					rescue
-						# Ignore errors - the profiler may be in an invalid state after fork
+					if capture.restart_after_fork
+						ForkHandler.restart(capture)
+					else
+						begin
+							capture.stop
+						rescue
+							# Ignore errors - the profiler may be in an invalid state after fork
+						end
 					end
 				end
 			end
 			
 			return result
 		end
+		
+		# Restart the capture in the child process. If the capture writes to a file, the child writes to its own file, named after the original with the process id inserted before the extension, e.g. `stalls.1234.ndjson`.
+		def self.restart(capture)
+			output = capture.output
+			
+			if output.is_a?(::File) and path = output.path and ::File.file?(path)
+				extension = ::File.extname(path)
+				file = ::File.open("#{path.delete_suffix(extension)}.#{::Process.pid}#{extension}", "ab")
+				file.sync = output.sync
+				output = file
+			else
+				output = nil
+			end
+			
+			capture.after_fork(output)
+		rescue
+			# The child should not fail because it can't be profiled:
+			capture.stop rescue nil
+			Thread.current.fiber_profiler_capture = nil
+		end
 	end
 	
 	private_constant :ForkHandler
@@ -0,0 +1,29 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2026, by Samuel Williams.
+
+module Fiber::Profiler
+	# Marks fibers as ready to run when a fiber scheduler wakes them, so that captures created with `track_latency: true` can measure how long they wait on the run queue. Prepend it to the scheduler class:
+	#
+	# ~~~ ruby
+	# Async::Scheduler.prepend(Fiber::Profiler::Scheduler)
+	# ~~~
+	#
+	# Fibers waiting on IO are not marked, as the scheduler doesn't expose when the IO became ready, only when the fiber resumes.
+	module Scheduler
+		# The fiber will be ready once the duration has elapsed.
+		def kernel_sleep(duration = nil)
+			Capture.ready(Fiber.current, duration) if duration
+			
+			super
+		end
+		
+		# The fiber is ready as soon as it is unblocked.
+		def unblock(blocker, fiber)
+			Capture.ready(fiber)
+			
+			super
+		end
+	end
+end
@@ -0,0 +1,78 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "fiber/profiler"
+require "json"
+
+describe Fiber::Profiler do
+	with ".trap" do
+		let(:output) {StringIO.new}
+		
+		after do
+			::Signal.trap("USR2", @previous) if defined?(@previous)
+			
+			# The handler asks every thread to start a burst, including those which don't switch fibers:
+			Thread.list.each{|thread| thread.fiber_profiler_burst&.disable}
+		end
+		
+		def stall!
+			Fiber.new do
+				sleep 0.02
+			end.resume
+		end
+		
+		it "should capture a burst when the signal is received" do
+			@previous = subject.trap("USR2", duration: 0.01, stall_threshold: 0.0001, output: output)
+			
+			expect(subject.captures).to be == []
+			
+			::Process.kill("USR2", ::Process.pid)
+			
+			# Give the main thread a chance to run the handler:
+			10.times do
+				break if Thread.current.fiber_profiler_burst
+				sleep 0.001
+			end
+			
+			# The burst starts at the next fiber switch:
+			expect(Thread.current.fiber_profiler_burst).not_to be_nil
+			expect(Thread.current.fiber_profiler_capture).to be_nil
+			
+			stall!
+			
+			expect(Thread.current.fiber_profiler_capture).to be_nil
+			
+			stalls = output.string.lines.map{|line| JSON.parse(line)}
+			expect(stalls).to have_value(have_keys("calls" => have_value(have_keys("method" => be == "sleep"))))
+		end
+		
+		it "should capture a burst on every thread" do
+			@previous = subject.trap("USR2", duration: 0.01, stall_threshold: 0.0001, output: output)
+			
+			ready = Thread::Queue.new
+			
+			thread = Thread.new do
+				ready.pop
+				stall!
+				
+				Thread.current.native_thread_id
+			end
+			
+			::Process.kill("USR2", ::Process.pid)
+			
+			10.times do
+				break if thread.fiber_profiler_burst
+				sleep 0.001
+			end
+			
+			ready << true
+			thread_id = thread.value
+			
+			stalls = output.string.lines.map{|line| JSON.parse(line)}
+			expect(stalls).to have_value(have_keys("thread_id" => be == thread_id))
+			expect(subject.captures).to be == []
+		end
+	end
+end
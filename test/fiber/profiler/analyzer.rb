@@ -0,0 +1,109 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "fiber/profiler/capture"
+require "json"
+require "zlib"
+require "tempfile"
+
+describe Fiber::Profiler::Analyzer do
+	let(:log) {Tempfile.new(["samples", ".ndjson"])}
+	
+	after do
+		log.close!
+	end
+	
+	def pause
+		sleep 0.001
+	end
+	
+	def record!
+		capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: log)
+		capture.start
+		
+		3.times do
+			Fiber.new{pause}.resume
+		end
+		
+		capture.stop
+		log.flush
+	end
+	
+	it "can summarize calls by location" do
+		record!
+		
+		expected = Hash.new(0)
+		File.foreach(log.path) do |line|
+			JSON.parse(line)["calls"].each do |call|
+				expected["#{call["path"]}:#{call["line"]}"] += 1
+			end
+		end
+		
+		summary = subject.analyze(log.path, threads: 2)
+		
+		expect(summary.to_h{|location, data| [location, data[:calls]]}).to be == expected
+		
+		location, data = summary.find{|location, data| data[:method] == "sleep"}
+		expect(location).to be =~ /analyzer\.rb:\d+$/
+		expect(data).to have_keys(
+			class: be == "Kernel",
+			calls: be == expected[location],
+			duration: be >= 0.003,
+			self_time: be <= data[:duration],
+			p50: be >= 0.0009,
+			p99: be >= data[:p50],
+		)
+	end
+	
+	it "can summarize compressed logs" do
+		compressed = Tempfile.new(["samples", ".ndjson.gz"])
+		
+		capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: compressed, output_compression: :gzip)
+		capture.start
+		3.times{Fiber.new{pause}.resume}
+		capture.stop
+		compressed.flush
+		
+		summary = subject.analyze(compressed.path, threads: 2)
+		
+		location, data = summary.find{|location, data| data[:method] == "sleep"}
+		expect(data).to have_keys(
+			calls: be >= 3,
+			duration: be >= 0.003,
+		)
+	ensure
+		compressed&.close!
+	end
+	
+	it "can summarize compressed logs larger than a batch" do
+		compressed = Tempfile.new(["samples", ".ndjson.gz"])
+		
+		# Each line is ~100 bytes, so this decompresses to several batches, and lines straddle their boundaries:
+		lines = 400_000
+		Zlib::GzipWriter.open(compressed.path) do |gzip|
+			lines.times do |index|
+				gzip.write("{\"duration\":1,\"calls\":[{\"path\":\"test-#{index % 7}.rb\",\"line\":1,\"class\":\"Object\",\"method\":\"test\",\"duration\":0.5}]}\n")
+			end
+		end
+		
+		summary = subject.analyze(compressed.path, threads: 4)
+		
+		expect(summary.size).to be == 7
+		expect(summary.sum{|location, data| data[:calls]}).to be == lines
+		expect(summary.map{|location, data| data[:method]}.uniq).to be == ["test"]
+	ensure
+		compressed&.close!
+	end
+	
+	it "ignores lines which are not stalls" do
+		log.write("garbage\n{\"calls\":[]}\n{\"duration\":1,\"calls\":[{\"path\":\"test.rb\",\"line\":1,\"duration\":0.5}]}")
+		log.flush
+		
+		summary = subject.analyze(log.path)
+		
+		expect(summary.size).to be == 1
+		expect(summary.first.first).to be == "test.rb:1"
+	end
+end
@@ -0,0 +1,211 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "fiber/profiler/capture"
+require "fiber/profiler/binary"
+require "tmpdir"
+
+describe Fiber::Profiler::Binary::Reader do
+	let(:output) {StringIO.new(String.new(encoding: Encoding::BINARY))}
+	let(:capture) {Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: output, format: :binary)}
+	
+	after do
+		@capture&.stop
+	end
+	
+	def stall!
+		Fiber.new do
+			sleep 0.001
+		end.resume
+	end
+	
+	it "can read stalls" do
+		capture.start
+		2.times{stall!}
+		capture.stop
+		
+		stalls = subject.new(StringIO.new(output.string)).to_a
+		
+		expect(stalls.size).to be == capture.stalls
+		
+		stalls.each do |stall|
+			expect(stall).to have_keys(
+				"duration" => be >= 0.0001,
+				"switches" => be > 0,
+				"thread_id" => be == Thread.current.native_thread_id,
+				"gc_count" => be >= 0,
+			)
+			
+			# Allocations are not tracked, so they are not written:
+			expect(stall.key?("allocations")).to be == false
+			
+			expect(stall["calls"]).to have_value(have_keys(
+				"path" => be == __FILE__,
+				"line" => be > 0,
+				"class" => be == "Kernel",
+				"method" => be == "sleep",
+				"self_time" => be > 0,
+			))
+		end
+		
+		# Strings are only written once, for the first stall that uses them:
+		expect(output.string.scan(__FILE__).size).to be == 1
+	end
+	
+	it "can read allocations if they are tracked" do
+		capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: output, format: :binary, track_allocations: true)
+		capture.start
+		
+		Fiber.new do
+			Array.new(1000){Object.new}
+			sleep 0.001
+		end.resume
+		
+		capture.stop
+		
+		stall = subject.new(StringIO.new(output.string)).first
+		
+		expect(stall).to have_keys(
+			"allocations" => be >= 1000,
+		)
+		expect(stall["calls"]).to have_value(have_keys("allocations" => be > 0))
+	end
+	
+	it "can read compressed profiles" do
+		path = File.join(Dir.tmpdir, "fiber-profiler-#{Process.pid}.bin.gz")
+		
+		File.open(path, "wb") do |file|
+			capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: file, format: :binary, output_compression: :gzip)
+			capture.start
+			2.times{stall!}
+			capture.stop
+			
+			# Simulate a report which was only partially written:
+			file.write("\x1f\x8b\x08\x00".b)
+		end
+		
+		stalls = subject.foreach(path).to_a
+		
+		expect(stalls.size).to be == 2
+		expect(stalls.last["calls"]).to have_value(have_keys("method" => be == "sleep"))
+	ensure
+		File.unlink(path) if path and File.exist?(path)
+	end
+	
+	it "can read the worst stalls" do
+		capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, output: output, format: :binary, retain_stalls: 1)
+		capture.start
+		
+		Fiber.new{sleep 0.001}.resume
+		Fiber.new{sleep 0.01}.resume
+		
+		capture.stop
+		
+		stalls = subject.new(StringIO.new(output.string)).to_a
+		
+		# The strings of the discarded stalls are still written, as later stalls may refer to them:
+		expect(stalls.size).to be == 1
+		expect(stalls.first["duration"]).to be >= 0.01
+		expect(stalls.first["calls"]).to have_value(have_keys("method" => be == "sleep", "path" => be == __FILE__))
+	end
+	
+	it "writes the strings of dropped stalls again" do
+		klass = Class.new do
+			200.times do |i|
+				define_method("method_#{i}") {}
+			end
+		end
+		
+		object = klass.new
+		pipe = IO.pipe
+		
+		# The first stall has too many calls to fit in the buffer, so it is dropped along with the strings it introduced:
+		capture = Fiber::Profiler::Capture.new(stall_threshold: 0.0001, filter_threshold: 0, output: pipe.last, format: :binary, buffer_capacity: 4096)
+		capture.start
+		
+		Fiber.new do
+			200.times{|i| object.public_send("method_#{i}")}
+			sleep 0.001
+		end.resume
+		
+		Fiber.new do
+			object.method_0
+			sleep 0.001
+		end.resume
+		
+		capture.stop
+		pipe.last.close
+		
+		expect(capture.dropped).to be >= 1
+		
+		stalls = subject.new(StringIO.new(pipe.first.read)).to_a
+		expect(stalls.size).to be == capture.stalls - capture.dropped
+		expect(stalls.last["calls"]).to have_value(have_keys("method" => be == "method_0"))
+		
+		stalls.each do |stall|
+			stall["calls"].each do |call|
+				expect(call["path"]).not_to be_nil
+			end
+		end
+	ensure
+		pipe&.each(&:close)
+	end
+	
+	it "can read annotations" do
+		capture.start
+		
+		fiber = Fiber.new do
+			Fiber.current.annotation = "request 42"
+			sleep 0.001
+		end
+		
+		fiber.resume
+		stall!
+		
+		capture.stop
+		
+		first, second = subject.new(StringIO.new(output.string)).to_a
+		
+		expect(first).to have_keys(
+			"fiber_id" => be == fiber.object_id,
+			"annotation" => be == "request 42",
+		)
+		
+		expect(second).not_to have_keys("annotation")
+	end
+	
+	it "ignores incomplete records" do
+		capture.start
+		stall!
+		capture.stop
+		
+		truncated = output.string.byteslice(0, output.string.bytesize - 1)
+		
+		expect(subject.new(StringIO.new(truncated)).to_a).to be == []
+	end
+	
+	it "writes the header again when restarted" do
+		2.times do
+			capture.start
+			stall!
+			capture.stop
+		end
+		
+		stalls = subject.new(StringIO.new(output.string)).to_a
+		
+		expect(stalls.size).to be == 2
+		expect(stalls.last["calls"]).to have_value(have_keys(
+			"method" => be == "sleep",
+		))
+	end
+end
+
+describe Fiber::Profiler::Capture do
+	it "rejects unknown formats" do
+		expect do
+			subject.new(format: :xml)
+		end.to raise_exception(ArgumentError, message: be =~ /Unknown format/)
+	end
+end
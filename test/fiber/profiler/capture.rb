@@ -3,8 +3,9 @@
 # Released under the MIT License.
 # Copyright, 2025-2026, by Samuel Williams.
 
-require "fiber/profiler/capture"
+require "fiber/profiler"
 require "json"
+require "tmpdir"
 
 describe Fiber::Profiler::Capture do
 	let(:output) {StringIO.new}
@@ -30,30 +31,996 @@ describe Fiber::Profiler::Capture do
 		end
 	end
 	
+	with "#track_allocations" do
+		let(:capture) {subject.new(stall_threshold: 0.0001, track_allocations: true, output: output)}
+		
+		it "should return false by default" do
+			expect(subject.new).to have_attributes(
+				track_allocations: be == false
+			)
+		end
+		
+		it "should count the allocations of each call" do
+			capture.start
+			
+			Fiber.new do
+				Array.new(100){Object.new}
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			calls = stall["calls"]
+			
+			# Array.new is filtered, so its allocations are counted against the block that called it:
+			expect(calls).to have_value(have_keys(
+				"allocations" => be >= 100,
+			))
+			
+			expect(calls.sum{|call| call["allocations"]}).to be >= 100
+		end
+		
+		with "format: :folded" do
+			let(:capture) {subject.new(stall_threshold: 0.0001, track_allocations: true, output: output, format: :folded)}
+			
+			it "should weight call paths by allocations" do
+				capture.start
+				
+				Fiber.new do
+					Array.new(100){Object.new}
+					sleep 0.001
+				end.resume
+				
+				capture.stop
+				
+				weights = output.string.lines.map{|line| line.split(" ").last.to_i}
+				expect(weights.sum).to be >= 100
+				expect(output.string).not_to be =~ /Kernel#sleep/
+			end
+		end
+	end
+	
+	with "#arm_threshold" do
+		let(:capture) {subject.new(stall_threshold: 0.0001, filter_threshold: 0, arm_threshold: 0.005, output: output)}
+		
+		it "should return the arm threshold" do
+			expect(capture).to have_attributes(
+				arm_threshold: be == 0.005,
+			)
+		end
+		
+		it "should not track calls in short samples" do
+			capture.start
+			
+			Fiber.new do
+				sleep 0.0001
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			expect(stall["calls"].size).to be == 0
+		end
+		
+		it "should track calls once the arm threshold is reached" do
+			capture.start
+			
+			Fiber.new do
+				sleep 0.02
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			sleeps = stall["calls"].select{|call| call["method"] == "sleep"}
+			
+			# The first sleep was already on the stack when tracking started, and the second was tracked normally:
+			expect(sleeps.size).to be == 2
+			expect(sleeps.first["nesting"]).to be == sleeps.last["nesting"]
+		end
+	end
+	
 	with "#sample_rate" do
 		let(:capture) {subject.new(stall_threshold: 0.0001, sample_rate: 0.1, output: output)}
 		
-		it "should return the sample rate" do
-			expect(capture).to have_attributes(
-				sample_rate: be == 0.1
-			)
+		it "should return the sample rate" do
+			expect(capture).to have_attributes(
+				sample_rate: be == 0.1
+			)
+		end
+		
+		it "should sample at the given rate" do
+			capture.start
+			
+			100.times do
+				Fiber.new do
+					sleep 0.0001
+				end.resume
+			end
+			
+			capture.stop
+			
+			expect(capture).to have_attributes(
+				stalls: (be >= 1).and(be <= 50)
+			)
+		end
+	end
+	
+	with "#overhead_budget" do
+		let(:capture) {subject.new(stall_threshold: 1, output: output, overhead_budget: 0.0001)}
+		
+		it "should use the sample rate by default" do
+			capture = subject.new(sample_rate: 0.5, output: output)
+			
+			expect(capture).to have_attributes(
+				overhead_budget: be == 0,
+				effective_sample_rate: be == 0.5,
+				overhead: be == 0,
+			)
+		end
+		
+		it "should reduce the sample rate to meet the budget" do
+			capture.start
+			
+			clock = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+			
+			while Process.clock_gettime(Process::CLOCK_MONOTONIC) - clock < 0.5
+				Fiber.new do
+					100.times{|i| i.to_s}
+				end.resume
+			end
+			
+			capture.stop
+			
+			expect(capture).to have_attributes(
+				overhead_budget: be == 0.0001,
+				effective_sample_rate: be < 1,
+				overhead: be > 0,
+			)
+		end
+	end
+	
+	with "#clock" do
+		it "should use the monotonic clock by default" do
+			expect(capture).to have_attributes(
+				clock: be == :monotonic
+			)
+		end
+		
+		it "should measure stalls with a coarse clock" do
+			capture = subject.new(stall_threshold: 0.0001, output: output, clock: :coarse)
+			expect(capture.clock).to be == :coarse
+			
+			capture.start
+			
+			Fiber.new do
+				sleep 0.01
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			expect(stall["duration"]).to be >= 0.005
+		end
+		
+		it "should fall back to the monotonic clock if the time stamp counter is not available" do
+			capture = subject.new(clock: :tsc)
+			
+			expect([:tsc, :monotonic]).to have_value(be == capture.clock)
+		end
+		
+		it "rejects unknown clocks" do
+			expect do
+				subject.new(clock: :sundial)
+			end.to raise_exception(ArgumentError, message: be =~ /Unknown clock/)
+		end
+	end
+	
+	with "#output_compression" do
+		it "should not compress by default" do
+			expect(capture).to have_attributes(
+				output_compression: be == :none
+			)
+		end
+		
+		it "should compress each stall separately" do
+			require "zlib"
+			
+			capture = subject.new(stall_threshold: 0.0001, output: output, output_compression: :gzip)
+			expect(capture.output_compression).to be == :gzip
+			
+			capture.start
+			2.times{Fiber.new{sleep 0.001}.resume}
+			capture.stop
+			
+			expect(output.string.b.byteslice(0, 2)).to be == "\x1f\x8b".b
+			expect(capture.statistics[:bytes_written]).to be == output.string.bytesize
+			
+			# Each stall is a complete member, so it can be decompressed on its own:
+			members = []
+			data = output.string
+			
+			until data.empty?
+				inflate = Zlib::Inflate.new(Zlib::MAX_WBITS + 16)
+				members << JSON.parse(inflate.inflate(data))
+				data = data.byteslice(inflate.total_in..)
+				inflate.close
+			end
+			
+			expect(members.size).to be == capture.stalls
+			expect(members).to have_value(have_keys("duration" => be >= 0.001))
+		end
+		
+		it "rejects unknown compression" do
+			expect do
+				subject.new(output_compression: :lzw)
+			end.to raise_exception(ArgumentError, message: be =~ /Unknown output compression/)
+		end
+	end
+	
+	with "#max_calls" do
+		let(:capture) {subject.new(stall_threshold: 0.0001, filter_threshold: 0, output: output, max_calls: 10)}
+		
+		it "should limit the number of calls recorded per sample" do
+			capture.start
+			
+			# The sleep is recorded first, so that the calls which are truncated are counted by a call which is never skipped:
+			Fiber.new do
+				sleep 0.001
+				100.times{|i| i.to_s}
+			end.resume
+			
+			capture.stop
+			
+			expect(capture).to have_attributes(
+				max_calls: be == 10,
+				truncated: be > 0,
+			)
+			
+			stall = JSON.parse(output.string)
+			expect(stall["calls"].size).to be <= 10
+			expect(stall["calls"].sum{|call| call["filtered"]}).to be > 0
+		end
+	end
+	
+	with "#statistics" do
+		it "should count switches, samples and stalls" do
+			capture.start
+			
+			3.times do
+				Fiber.new do
+					sleep 0.001
+				end.resume
+			end
+			
+			capture.stop
+			
+			statistics = capture.statistics
+			
+			expect(statistics).to have_keys(
+				switches: be >= 6,
+				samples: be >= 3,
+				stalls: be == capture.stalls,
+				stall_duration: be >= 0.003,
+				stall_duration_maximum: be >= 0.001,
+				calls: be > 0,
+				filtered: be >= 0,
+				truncated: be == 0,
+				memory_maximum: be > 0,
+				bytes_written: be == output.string.bytesize,
+				dropped: be == 0,
+			)
+		end
+		
+		with "statistics_path:" do
+			let(:path) {File.join(Dir.tmpdir, "fiber-profiler-statistics-#{Process.pid}")}
+			let(:capture) {subject.new(stall_threshold: 0.0001, output: output, statistics_path: path)}
+			
+			after do
+				File.unlink(path) if File.exist?(path)
+			end
+			
+			it "should map the counters from a file" do
+				capture.start
+				
+				Fiber.new do
+					sleep 0.001
+				end.resume
+				
+				capture.stop
+				
+				magic, version, fields, pid, *counters = File.binread(path).unpack("a4L3Q*")
+				
+				expect(magic).to be == "FPST"
+				expect(version).to be == 1
+				expect(pid).to be == Process.pid
+				expect(counters.size).to be == fields
+				
+				switches, samples, stalls = counters
+				
+				expect(capture.statistics).to have_keys(
+					switches: be == switches,
+					samples: be == samples,
+					stalls: be == stalls,
+				)
+			end
+		end
+	end
+	
+	with "#histograms" do
+		let(:capture) {subject.new(stall_threshold: 1, histograms: 64, output: output)}
+		
+		it "should be disabled by default" do
+			expect(subject.new).to have_attributes(
+				histograms: be == 0
+			)
+			
+			expect(subject.new.histogram_summary).to be == []
+		end
+		
+		it "should summarize every call, not just stalls" do
+			capture.start
+			
+			line = __LINE__ + 3
+			10.times do
+				Fiber.new do
+					sleep 0.001
+				end.resume
+			end
+			
+			capture.stop
+			
+			expect(capture).to have_attributes(stalls: be == 0)
+			
+			location, summary = capture.histogram_summary.find{|location, summary| summary[:method] == "sleep"}
+			
+			expect(location).to be == "#{__FILE__}:#{line}"
+			expect(summary).to have_keys(
+				calls: be == 10,
+				class: be == "Kernel",
+				p50: be >= 0.001,
+				p99: be >= 0.001,
+				maximum: be >= 0.001,
+				duration: be >= 0.01,
+			)
+		end
+		
+		it "can reset the histograms" do
+			capture.start
+			
+			Fiber.new do
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			
+			expect(capture.histogram_summary(reset: true).size).to be > 0
+			expect(capture.histogram_summary).to be == []
+		end
+		
+		with "a small table" do
+			let(:capture) {subject.new(stall_threshold: 1, filter_threshold: 0, histograms: 2, output: output)}
+			
+			it "should bound the number of locations" do
+				capture.start
+				
+				Fiber.new do
+					Object.new
+					[1].map(&:to_s)
+					sleep 0.001
+				end.resume
+				
+				capture.stop
+				
+				expect(capture.histogram_summary.size).to be == 2
+			end
+		end
+	end
+	
+	with "#track_latency" do
+		let(:capture) {subject.new(stall_threshold: 1, track_latency: true, output: output)}
+		
+		it "should be disabled by default" do
+			expect(subject.new).to have_attributes(
+				track_latency: be == false
+			)
+		end
+		
+		it "should not mark fibers unless a capture is tracking latency" do
+			expect(subject.ready(Fiber.current)).to be == false
+		end
+		
+		it "should measure how long a ready fiber waits to run" do
+			capture.start
+			
+			waiter = Fiber.new do
+				Fiber.current.annotation = "waiter"
+				Fiber.yield
+			end
+			
+			waiter.resume
+			
+			blocker = Fiber.new do
+				Fiber.current.annotation = "blocker"
+				expect(subject.ready(waiter)).to be == true
+				sleep 0.01
+			end
+			
+			blocker.resume
+			waiter.resume
+			
+			capture.stop
+			
+			summary = capture.latency_summary
+			
+			expect(summary).to have_keys(
+				count: be == 1,
+				total: be >= 0.01,
+				maximum: be >= 0.01,
+				p99: be > 0.005,
+			)
+			
+			expect(summary[:worst].first).to have_keys(
+				latency: be >= 0.01,
+				fiber_id: be == waiter.object_id,
+				annotation: be == "waiter",
+				blocker_id: be == blocker.object_id,
+				blocker_annotation: be == "blocker",
+				blocker_duration: be >= 0.01,
+			)
+		end
+		
+		it "should not measure fibers resumed before they are ready" do
+			capture.start
+			
+			fiber = Fiber.new do
+				Fiber.yield
+			end
+			
+			fiber.resume
+			subject.ready(fiber, 10)
+			fiber.resume
+			
+			capture.stop
+			
+			expect(capture.latency_summary[:count]).to be == 0
+		end
+		
+		it "should ignore marks left over from before it started" do
+			fiber = Fiber.new do
+				Fiber.yield
+			end
+			
+			fiber.resume
+			
+			# The fiber is marked as ready, but the capture stops before it runs:
+			capture.start
+			subject.ready(fiber)
+			capture.stop
+			
+			sleep 0.1
+			
+			other = subject.new(stall_threshold: 1, track_latency: true, output: output)
+			other.start
+			subject.ready(fiber)
+			fiber.resume
+			other.stop
+			
+			expect(other.latency_summary).to have_keys(
+				count: be == 1,
+				maximum: be < 0.05,
+			)
+		end
+		
+		it "can reset the measurements" do
+			capture.start
+			
+			fiber = Fiber.new do
+				Fiber.yield
+			end
+			
+			fiber.resume
+			subject.ready(fiber)
+			fiber.resume
+			
+			capture.stop
+			
+			expect(capture.latency_summary(reset: true)[:count]).to be == 1
+			expect(capture.latency_summary).to have_keys(
+				count: be == 0,
+				worst: be == []
+			)
+		end
+	end
+	
+	with "#line_paths" do
+		let(:capture) {subject.new(stall_threshold: 1, track_calls: false, line_paths: [__FILE__], output: output)}
+		
+		it "should be disabled by default" do
+			expect(subject.new).to have_attributes(
+				line_paths: be == []
+			)
+			
+			expect(subject.new.line_summary).to be == []
+		end
+		
+		it "should return the line paths" do
+			expect(capture).to have_attributes(
+				line_paths: be == [__FILE__]
+			)
+		end
+		
+		it "should measure the time spent on each line" do
+			capture.start
+			
+			line = __LINE__ + 2
+			Fiber.new do
+				sleep 0.01
+				Object.new
+			end.resume
+			
+			capture.stop
+			
+			location, summary = capture.line_summary.first
+			
+			expect(location).to be == "#{__FILE__}:#{line}"
+			expect(summary).to have_keys(
+				duration: be >= 0.01,
+				count: be == 1,
+			)
+		end
+		
+		it "should include calls into other files" do
+			capture.start
+			
+			line = __LINE__ + 2
+			Fiber.new do
+				JSON.generate({"name" => "x" * 1000})
+				Object.new
+			end.resume
+			
+			capture.stop
+			
+			expect(capture.line_summary.map(&:first)).to have_value(be == "#{__FILE__}:#{line}")
+			expect(capture.line_summary.map(&:first)).not_to have_value(be =~ /json/)
+		end
+		
+		it "should not intern the paths of other files" do
+			output = StringIO.new(String.new(encoding: Encoding::BINARY))
+			capture = subject.new(stall_threshold: 0.0001, track_calls: false, line_paths: [__FILE__], output: output, format: :binary)
+			capture.start
+			
+			Fiber.new do
+				Dir.tmpdir
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			
+			expect(capture.stalls).to be > 0
+			expect(output.string).not_to be =~ /tmpdir\.rb/
+		end
+		
+		it "can reset the lines" do
+			capture.start
+			
+			Fiber.new do
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			
+			expect(capture.line_summary(reset: true).size).to be > 0
+			expect(capture.line_summary).to be == []
+		end
+	end
+	
+	with "#sample_interval" do
+		let(:capture) {subject.new(stall_threshold: 0.01, filter_threshold: 0, track_calls: false, sample_interval: 0.001, output: output)}
+		
+		def busy(duration)
+			clock = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+			
+			while Process.clock_gettime(Process::CLOCK_MONOTONIC) - clock < duration
+			end
+		end
+		
+		it "should return the sample interval" do
+			expect(capture).to have_attributes(
+				track_calls: be == false,
+				sample_interval: be == 0.001,
+			)
+		end
+		
+		it "should sample the call stack of stalled fibers" do
+			capture.start
+			
+			Fiber.new do
+				busy(0.05)
+				sleep(0.02)
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			
+			# The busy loop and the sleep are both accounted for, even though the individual calls were not traced:
+			clock_gettime = stall["calls"].find{|call| call["method"] == "clock_gettime"}
+			sleeping = stall["calls"].find{|call| call["method"] == "sleep"}
+			
+			expect(clock_gettime).to have_keys(
+				"path" => be == __FILE__,
+				"duration" => be > 0.01,
+			)
+			
+			expect(sleeping).to have_keys(
+				"duration" => be > 0.01,
+			)
+		end
+		
+		it "should not interfere with other handlers of SIGPROF" do
+			received = 0
+			previous = Signal.trap("PROF") {received += 1}
+			
+			capture.start
+			
+			Fiber.new do
+				Process.kill("PROF", Process.pid)
+				busy(0.02)
+			end.resume
+			
+			capture.stop
+			
+			expect(received).to be == 1
+			
+			# The call stack was still sampled:
+			stall = JSON.parse(output.string)
+			expect(stall["calls"].find{|call| call["method"] == "clock_gettime"}).not_to be_nil
+		ensure
+			Signal.trap("PROF", previous || "DEFAULT")
+		end
+	end
+	
+	with "#buffer_capacity" do
+		let(:pipe) {IO.pipe}
+		let(:buffer_capacity) {1024 * 64}
+		let(:capture) {subject.new(stall_threshold: 0.0001, output: pipe.last, buffer_capacity: buffer_capacity)}
+		
+		after do
+			pipe.each(&:close)
+		end
+		
+		it "should write output in the background" do
+			capture.start
+			
+			Fiber.new do
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+			pipe.last.close
+			
+			expect(capture).to have_attributes(
+				buffer_capacity: be == buffer_capacity,
+				stalls: be >= 1,
+				dropped: be == 0,
+			)
+			
+			stall = JSON.parse(pipe.first.read)
+			expect(stall).to have_keys(
+				"duration" => be >= 0.0001,
+			)
+		end
+		
+		with "a small buffer" do
+			let(:buffer_capacity) {16}
+			
+			it "should drop output that doesn't fit" do
+				capture.start
+				
+				Fiber.new do
+					sleep 0.001
+				end.resume
+				
+				capture.stop
+				pipe.last.close
+				
+				expect(capture).to have_attributes(
+					stalls: be >= 1,
+					dropped: be == capture.stalls,
+				)
+				
+				expect(pipe.first.read).to be == ""
+			end
+		end
+		
+		with "a large buffer" do
+			let(:buffer_capacity) {1024 * 1024}
+			
+			it "should wait for the pipe rather than truncating reports" do
+				capture.start
+				
+				1000.times do
+					Fiber.new{sleep 0.0001}.resume
+				end
+				
+				# The pipe is non-blocking and holds less than the buffered reports, so the writer must wait for the reader, which can only run if stopping releases the GVL:
+				reader = Thread.new{pipe.first.read}
+				capture.stop
+				pipe.last.close
+				
+				stalls = reader.value.lines.map{|line| JSON.parse(line)}
+				
+				expect(capture.dropped).to be == 0
+				expect(stalls.size).to be == capture.stalls
+			end
+		end
+		
+		it "should not share the writer of a file which was closed" do
+			path = File.join(Dir.tmpdir, "fiber-profiler-#{Process.pid}")
+			first = File.open("#{path}-first", "w")
+			
+			capture = subject.new(stall_threshold: 0.0001, output: first, buffer_capacity: buffer_capacity)
+			capture.start
+			descriptor = first.fileno
+			
+			# The writer has its own duplicate of the descriptor, so the file can be closed while it is running, and its descriptor reused:
+			first.close
+			second = File.open("#{path}-second", "w")
+			expect(second.fileno).to be == descriptor
+			
+			other = subject.new(stall_threshold: 0.0001, output: second, buffer_capacity: buffer_capacity)
+			other.start
+			Fiber.new{sleep 0.001}.resume
+			other.stop
+			
+			capture.stop
+			second.close
+			
+			expect(other.stalls).to be > 0
+			expect(File.read(second.path).lines.size).to be == other.stalls
+		ensure
+			["first", "second"].each do |name|
+				File.unlink("#{path}-#{name}") if File.exist?("#{path}-#{name}")
+			end
+		end
+		
+		it "should remain stopped if it can't be started" do
+			capture
+			limit = Process.getrlimit(Process::RLIMIT_NOFILE)
+			
+			begin
+				# The writer duplicates the output's descriptor, which fails if no more can be opened:
+				Process.setrlimit(Process::RLIMIT_NOFILE, 0, limit.last)
+				expect{capture.start}.to raise_exception(Errno::EMFILE)
+			ensure
+				Process.setrlimit(Process::RLIMIT_NOFILE, *limit)
+			end
+			
+			expect(Thread.current.fiber_profiler_capture).to be_nil
+			expect(capture.start).to be == capture
+		ensure
+			capture.stop
+		end
+		
+		it "should share the writer between threads" do
+			threads = 2.times.map do
+				Thread.new do
+					capture = subject.new(stall_threshold: 0.0001, output: pipe.last, buffer_capacity: buffer_capacity)
+					capture.start
+					
+					3.times do
+						Fiber.new do
+							sleep 0.001
+						end.resume
+					end
+					
+					capture.stop
+					
+					[Thread.current.native_thread_id, capture.stalls]
+				end
+			end
+			
+			results = threads.map(&:value)
+			pipe.last.close
+			
+			stalls = pipe.first.read.lines.map{|line| JSON.parse(line)}
+			expect(stalls.size).to be == results.sum(&:last)
+			
+			thread_ids = stalls.map{|stall| stall["thread_id"]}.uniq.sort
+			expect(thread_ids).to be == results.map(&:first).sort
 		end
 		
-		it "should sample at the given rate" do
+		it "should share the writer between threads using the binary format" do
+			require "fiber/profiler/binary"
+			
+			# Each thread blocks in a different method, so the string tables of the two streams differ:
+			blocks = {
+				"sleep" => proc{sleep(0.001)},
+				"select" => proc{IO.select(nil, nil, nil, 0.001)},
+			}
+			
+			threads = blocks.map do |name, block|
+				Thread.new do
+					capture = subject.new(stall_threshold: 0.0001, filter_threshold: 0, output: pipe.last, buffer_capacity: buffer_capacity, format: :binary)
+					capture.start
+					
+					3.times do
+						Fiber.new(&block).resume
+					end
+					
+					capture.stop
+					
+					[Thread.current.native_thread_id, name, capture.stalls]
+				end
+			end
+			
+			results = threads.map(&:value)
+			pipe.last.close
+			
+			stalls = Fiber::Profiler::Binary::Reader.new(pipe.first).to_a
+			expect(stalls.size).to be == results.sum(&:last)
+			
+			results.each do |thread_id, name, count|
+				methods = stalls.select{|stall| stall["thread_id"] == thread_id}.map do |stall|
+					stall["calls"].map{|call| call["method"]} & blocks.keys
+				end
+				
+				expect(methods).to be == [[name]] * count
+			end
+		end
+	end
+	
+	with "format: :folded" do
+		let(:flush_interval) {0}
+		let(:capture) {subject.new(stall_threshold: 0.0001, output: output, format: :folded, flush_interval: flush_interval)}
+		
+		def stall!
+			Fiber.new do
+				sleep 0.001
+			end.resume
+		end
+		
+		it "should aggregate samples until stopped" do
 			capture.start
+			3.times{stall!}
 			
-			100.times do
-				Fiber.new do
-					sleep 0.0001
-				end.resume
+			expect(output.string).to be == ""
+			
+			capture.stop
+			
+			lines = output.string.lines
+			matches = lines.grep(/Kernel#sleep \d+$/)
+			
+			# All three stalls have the same call path, so they are merged into a single line:
+			expect(matches.size).to be == 1
+			expect(matches.first.split(" ").last.to_i).to be >= 3000
+			expect(capture).to have_attributes(stalls: be >= 3)
+		end
+		
+		with "a flush interval" do
+			let(:flush_interval) {0.0001}
+			
+			it "should print the aggregated samples periodically" do
+				capture.start
+				3.times{stall!}
+				
+				expect(output.string).to be =~ /Kernel#sleep \d+$/
+				
+				capture.stop
+				
+				expect(capture).to have_attributes(flush_interval: be == flush_interval)
 			end
+		end
+	end
+	
+	with "#retain_stalls" do
+		let(:flush_interval) {0}
+		let(:capture) {subject.new(stall_threshold: 0.0001, output: output, retain_stalls: 2, flush_interval: flush_interval)}
+		
+		def stall!(duration)
+			Fiber.new do
+				sleep duration
+			end.resume
+		end
+		
+		it "should be disabled by default" do
+			expect(subject.new).to have_attributes(retain_stalls: be == 0)
+		end
+		
+		it "should only write the worst stalls when stopped" do
+			capture.start
+			[0.001, 0.02, 0.001, 0.01, 0.001].each{|duration| stall!(duration)}
+			
+			expect(output.string).to be == ""
 			
 			capture.stop
 			
-			expect(capture).to have_attributes(
-				stalls: (be >= 1).and(be <= 50)
+			stalls = output.string.lines.map{|line| JSON.parse(line)}
+			expect(stalls.size).to be == 2
+			
+			# The worst stalls are written in the order they happened:
+			expect(stalls.map{|stall| stall["duration"]}).to have_value(be >= 0.02)
+			expect(stalls.first["start_time"]).to be < stalls.last["start_time"]
+			expect(stalls.last["duration"]).to be >= 0.01
+			
+			expect(capture.statistics).to have_keys(
+				discarded: be == capture.stalls - 2,
 			)
 		end
+		
+		with "a flush interval" do
+			let(:flush_interval) {0.0001}
+			
+			it "should write the worst stalls periodically" do
+				capture.start
+				3.times{stall!(0.001)}
+				
+				expect(output.string).not_to be == ""
+				
+				capture.stop
+				
+				expect(capture).to have_attributes(retain_stalls: be == 2)
+			end
+		end
+	end
+	
+	with "#burst" do
+		def stall!
+			Fiber.new do
+				sleep 0.02
+			end.resume
+		end
+		
+		it "should stop itself once the duration has elapsed" do
+			expect(capture.burst(0.01)).to be_truthy
+			expect(Fiber::Profiler.captures).to have_value(be == capture)
+			
+			# The stall is printed before the capture stops:
+			stall!
+			
+			expect(Fiber::Profiler.captures).not_to have_value(be == capture)
+			expect(capture.stalls).to be >= 1
+			
+			stall = JSON.parse(output.string.lines.first)
+			expect(stall["calls"]).to have_value(have_keys("method" => be == "sleep"))
+			
+			# Once stopped, nothing more is captured:
+			stalls = capture.stalls
+			stall!
+			expect(capture.stalls).to be == stalls
+		end
+		
+		it "should stop itself even if no fiber switches" do
+			capture.burst(0.01)
+			
+			clock = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+			while Process.clock_gettime(Process::CLOCK_MONOTONIC) - clock < 0.05
+			end
+			
+			expect(Fiber::Profiler.captures).not_to have_value(be == capture)
+		end
+		
+		it "can be started again" do
+			capture.burst(0.01)
+			stall!
+			
+			expect(capture.start).to be_truthy
+			stall!
+			
+			# A normal start is not limited by the previous burst:
+			expect(Fiber::Profiler.captures).to have_value(be == capture)
+		ensure
+			capture.stop
+		end
+		
+		it "rejects durations which are not positive" do
+			expect do
+				capture.burst(0)
+			end.to raise_exception(ArgumentError, message: be =~ /must be positive/)
+		end
 	end
 	
 	with "#start" do
@@ -73,6 +1040,7 @@ describe Fiber::Profiler::Capture do
 			stall = JSON.parse(output.string)
 			expect(stall).to have_keys(
 				"duration" => be >= 0.0001,
+				"thread_id" => be == Thread.current.native_thread_id,
 			)
 			
 			calls = stall["calls"]
@@ -84,6 +1052,105 @@ describe Fiber::Profiler::Capture do
 			))
 		end
 		
+		it "should locate methods defined in Ruby" do
+			capture.start
+			
+			object = Object.new
+			
+			line = __LINE__ + 1
+			def object.stall
+				sleep 0.001
+			end
+			
+			Fiber.new do
+				object.stall
+				object.stall
+			end.resume
+			
+			capture.stop
+			
+			calls = JSON.parse(output.string)["calls"]
+			expect(calls).to have_value(have_keys(
+				"path" => be == __FILE__,
+				"line" => be >= line,
+				"method" => be == "stall",
+			))
+		end
+		
+		it "should identify and annotate the stalled fiber" do
+			capture.start
+			
+			fiber = Fiber.new do
+				Fiber.current.annotation = "request \"42\""
+				sleep 0.001
+			end
+			
+			fiber.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			expect(stall).to have_keys(
+				"fiber_id" => be == fiber.object_id,
+				"annotation" => be == "request \"42\"",
+			)
+		end
+		
+		it "should be listed in the running captures" do
+			capture.start
+			expect(Fiber::Profiler.captures).to be == [capture]
+			
+			capture.stop
+			expect(Fiber::Profiler.captures).to be == []
+		end
+		
+		it "should track calls in every sample" do
+			capture.start
+			
+			3.times do
+				Fiber.new do
+					sleep 0.001
+				end.resume
+			end
+			
+			capture.stop
+			
+			stalls = output.string.lines.map{|line| JSON.parse(line)}
+			expect(stalls.size).to be == 3
+			
+			stalls.each do |stall|
+				expect(stall["calls"]).to have_value(have_keys(
+					"method" => be == "sleep",
+				))
+			end
+		end
+		
+		it "should record the self time of each call" do
+			# Garbage collection is tracked as a call, which would otherwise make this test sensitive to the allocations of earlier tests:
+			GC.disable
+			
+			capture.start
+			
+			Fiber.new do
+				sleep 0.001
+			end.resume
+			
+			capture.stop
+		ensure
+			GC.enable
+			
+			calls = JSON.parse(output.string)["calls"]
+			
+			calls.each do |call|
+				expect(call["self_time"]).to be <= call["duration"]
+			end
+			
+			# The time is spent in sleep, not in the block which calls it:
+			leaf = calls.find{|call| call["method"] == "sleep"}
+			expect(leaf["self_time"]).to be == leaf["duration"]
+			expect(calls.first["self_time"]).to be < leaf["self_time"]
+		end
+		
 		def nested(n = 100, &block)
 			if n == 0
 				return yield
@@ -118,6 +1185,52 @@ describe Fiber::Profiler::Capture do
 			)
 		end
 		
+		with "format: :json" do
+			let(:capture) {subject.new(stall_threshold: 0.0001, format: :json, output: output)}
+			
+			it "should follow parents across pages of the call log" do
+				capture.start
+				
+				Fiber.new do
+					nested(1000) do
+						sleep 0.01
+					end
+				end.resume
+				
+				capture.stop
+				
+				stall = JSON.parse(output.string)
+				call = stall["calls"].find{|call| call["method"] == "sleep"}
+				
+				# Each enclosing call is the only child of its parent, so most of them are skipped, and the rest are printed, but either way the leaf is nested within all of them:
+				expect(stall["calls"].sum{|call| call["skipped"]} + call["nesting"]).to be >= 1000
+				expect(call["skipped"]).to be > 0
+			end
+			
+			it "should escape names which are not valid JSON" do
+				klass = Class.new do
+					define_method(:"quoted\"\\name\n") do
+						sleep 0.01
+					end
+				end
+				
+				capture.start
+				
+				Fiber.new do
+					klass.new.send(:"quoted\"\\name\n")
+					sleep 0.001
+				end.resume
+				
+				capture.stop
+				
+				stall = JSON.parse(output.string)
+				
+				expect(stall["calls"]).to have_value(have_keys(
+					"method" => be == "quoted\"\\name\n"
+				))
+			end
+		end
+		
 		it "can detect garbage collection stalls" do
 			capture.start
 			
@@ -138,6 +1251,101 @@ describe Fiber::Profiler::Capture do
 				"path" => be =~ /internal:gc/,
 			))
 		end
+		
+		it "should account for garbage collection in each stall" do
+			capture.start
+			
+			Fiber.new do
+				Array.new(1000){Object.new}
+				GC.start
+			end.resume
+			
+			Fiber.new do
+				sleep(0.001)
+			end.resume
+			
+			capture.stop
+			
+			collected, slept = output.string.lines.map{|line| JSON.parse(line)}
+			
+			# The garbage collector's steps are timed using the capture's clock, so the times are much finer than milliseconds:
+			expect(collected).to have_keys(
+				"gc_count" => be >= 1,
+				"gc_mark_time" => be > 0,
+				"gc_sweep_time" => be >= 0,
+			)
+			
+			# Allocations are only measured when they are tracked, so they are left out rather than reported as 0:
+			expect(collected.key?("allocations")).to be == false
+			
+			expect(collected["gc_mark_time"] + collected["gc_sweep_time"]).to be <= collected["duration"]
+			
+			expect(slept).to have_keys(
+				"gc_count" => be == 0,
+				"gc_mark_time" => be == 0,
+			)
+		end
+		
+		it "should count the allocations of each stall if allocations are tracked" do
+			capture = subject.new(stall_threshold: 0.0001, output: output, track_allocations: true)
+			capture.start
+			
+			Fiber.new do
+				Array.new(1000){Object.new}
+				sleep(0.001)
+			end.resume
+			
+			capture.stop
+			
+			stall = JSON.parse(output.string)
+			expect(stall).to have_keys(
+				"allocations" => be >= 1000,
+			)
+		end
+	end
+	
+	with "frames" do
+		let(:classes) {ObjectSpace::WeakMap.new}
+		
+		def call_anonymous_classes(count)
+			count.times do |index|
+				klass = Class.new do
+					def call = nil
+				end
+				
+				classes[index] = klass
+				
+				Fiber.new do
+					klass.new.call
+				end.resume
+			end
+		end
+		
+		it "should not retain classes after stopping" do
+			capture.start
+			call_anonymous_classes(1000)
+			capture.stop
+			
+			2.times{GC.start}
+			
+			# A few may still be referenced conservatively from the machine stack:
+			expect(classes.keys.count{|index| classes.key?(index)}).to be < 100
+		end
+		
+		with "a flush interval" do
+			let(:capture) {subject.new(stall_threshold: 0.0001, output: output, format: :folded, flush_interval: 0.0001)}
+			
+			it "should not retain classes after flushing" do
+				capture.start
+				call_anonymous_classes(1000)
+				
+				2.times{GC.start}
+				
+				expect(classes.keys.count{|index| classes.key?(index)}).to be < 100
+			ensure
+				capture.stop
+			end
+		end
 	end
 	
 	with "Process.fork" do
@@ -184,5 +1392,80 @@ describe Fiber::Profiler::Capture do
 			expect(Thread.current.fiber_profiler_capture).to be_nil
 			expect(capture.stop).to be == false
 		end
+		
+		with "restart_after_fork: true" do
+			let(:capture) {subject.new(stall_threshold: 0.0001, restart_after_fork: true, output: output)}
+			
+			it "should be disabled by default" do
+				expect(subject.new).to have_attributes(
+					restart_after_fork: be == false
+				)
+			end
+			
+			it "should restart the profiler in the child process after fork" do
+				capture.start
+				
+				Fiber.new do
+					sleep 0.001
+				end.resume
+				
+				pid = fork do
+					exit(1) unless Thread.current.fiber_profiler_capture == capture
+					
+					# The counters of the parent are not carried over:
+					exit(2) unless capture.stalls == 0
+					
+					Fiber.new do
+						sleep 0.001
+					end.resume
+					
+					exit(3) unless capture.stalls == 1
+					exit(4) unless capture.stop
+					
+					exit(0)
+				end
+				
+				_, status = Process.wait2(pid)
+				expect(status.exitstatus).to be == 0
+				
+				expect(Thread.current.fiber_profiler_capture).to be == capture
+				expect(capture.stalls).to be == 1
+				
+				capture.stop
+			end
+			
+			it "should write to a file for each process" do
+				Dir.mktmpdir do |root|
+					path = File.join(root, "stalls.ndjson")
+					
+					File.open(path, "a") do |file|
+						capture = subject.new(stall_threshold: 0.0001, restart_after_fork: true, output: file)
+						capture.start
+						
+						pid = fork do
+							Fiber.new do
+								sleep 0.001
+							end.resume
+							
+							capture.stop
+							
+							exit(0)
+						end
+						
+						_, status = Process.wait2(pid)
+						expect(status.exitstatus).to be == 0
+						
+						capture.stop
+						
+						child = File.read(File.join(root, "stalls.#{pid}.ndjson"))
+						expect(JSON.parse(child.lines.first)).to have_keys(
+							"duration" => be >= 0.0001,
+						)
+						
+						expect(File.read(path)).to be == ""
+					end
+				end
+			end
+		end
 	end
 end
@@ -0,0 +1,63 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2026, by Samuel Williams.
+
+require "fiber/profiler"
+
+class TestScheduler
+	attr :unblocked
+	
+	def kernel_sleep(duration = nil)
+		@slept = duration
+	end
+	
+	def unblock(blocker, fiber)
+		@unblocked = fiber
+	end
+	
+	prepend Fiber::Profiler::Scheduler
+end
+
+describe Fiber::Profiler::Scheduler do
+	let(:output) {StringIO.new}
+	let(:capture) {Fiber::Profiler::Capture.new(stall_threshold: 1, track_latency: true, output: output)}
+	let(:scheduler) {TestScheduler.new}
+	
+	it "should mark unblocked fibers as ready" do
+		capture.start
+		
+		fiber = Fiber.new do
+			Fiber.yield
+		end
+		
+		fiber.resume
+		scheduler.unblock(nil, fiber)
+		fiber.resume
+		
+		capture.stop
+		
+		expect(scheduler.unblocked).to be == fiber
+		expect(capture.latency_summary[:count]).to be == 1
+	end
+	
+	it "should mark sleeping fibers as ready once they wake up" do
+		capture.start
+		
+		fiber = Fiber.new do
+			scheduler.kernel_sleep(0.001)
+			Fiber.yield
+		end
+		
+		fiber.resume
+		sleep 0.01
+		fiber.resume
+		
+		capture.stop
+		
+		expect(capture.latency_summary).to have_keys(
+			count: be == 1,
+			maximum: be >= 0.005
+		)
+	end
+end